@@ -0,0 +1,50 @@
+# Copyright (C) 2014 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+ifeq ($(TARGET_DEVICE),epicmtd)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := camerabench.c
+LOCAL_SHARED_LIBRARIES := libcutils libdl
+LOCAL_MODULE := camerabench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# for stand-in modules, see -m
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := camerabench.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -ldl -lrt -lpthread
+LOCAL_MODULE := camerabench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# camerabench -m $(HOST_OUT)/camerabench
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := v4l2_standin.c
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE := camera.default
+LOCAL_MODULE_PATH := $(HOST_OUT)/camerabench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+endif
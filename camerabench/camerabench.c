@@ -0,0 +1,845 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * camerabench: shutter lag of the camera HAL, in scripted scenarios.
+ *
+ * Every run of a scenario loads the camera module in a fresh child process
+ * and drives the device through the same entry points the camera service
+ * uses:
+ *
+ *   single   open, first preview frame, auto focus, one picture, preview
+ *            restart, close
+ *   burst    five pictures in a row, restarting preview after each
+ *   switch   picture -> video mode -> picture (recording-hint), then back ->
+ *            front -> back camera when there are two
+ *   record   recording with a video snapshot, when the camera supports it
+ *
+ * No preview window is set: "first frame" is the first preview callback
+ * after start_preview(). The camera is shared with the running system,
+ * stop media before benchmarking.
+ *
+ * The report has one tab separated line per scenario and metric, with the
+ * median, minimum and maximum of all samples in ms and the sample count;
+ * metrics a camera can't measure have "-" and no samples. -b compares the
+ * medians with an earlier report, lists the ones that grew by more than
+ * -t percent (10 by default) on stderr and exits with 2 if there are any,
+ * so a report checked in with a change shows its cost in review.
+ *
+ * -m points at a directory of stand-in modules instead of /system/lib/hw.
+ * The camera.default stand-in built from v4l2_standin.c runs the scenarios
+ * on any V4L2 capture device, such as vivid or a webcam on a host.
+ *
+ * Usage: camerabench [-n runs] [-s scenario,...] [-c camera] [-m module_dir]
+ *                    [-o report] [-b baseline] [-t percent]
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cutils/properties.h>
+#include <hardware/camera.h>
+#include <hardware/hardware.h>
+
+#define MAX_RUNS            32
+#define MAX_SAMPLES         8       /* of a metric, per run */
+#define BURST_SHOTS         5
+#define RECORD_MS           1000    /* recording before and after the snapshot */
+#define EVENT_TIMEOUT       5000    /* ms */
+#define SCENARIO_TIMEOUT    60      /* seconds */
+
+enum {
+    M_OPEN,
+    M_FIRST_FRAME,
+    M_FOCUS,
+    M_SHUTTER_LAG,
+    M_SHUTTER_TO_JPEG,
+    M_SHOT_TO_SHOT,
+    M_PREVIEW_RESTART,
+    M_MODE_SWITCH,
+    M_CAMERA_SWITCH,
+    M_RECORD_START,
+    M_VIDEO_SNAPSHOT,
+    M_RECORD_STOP,
+    M_CLOSE,
+    M_CNT
+};
+
+static const char *metric_names[M_CNT] = {
+    "open",
+    "first_frame",
+    "focus",
+    "shutter_lag",
+    "shutter_to_jpeg",
+    "shot_to_shot",
+    "preview_restart",
+    "mode_switch",
+    "camera_switch",
+    "record_start",
+    "video_snapshot",
+    "record_stop",
+    "close",
+};
+
+struct result {
+    int status;                 /* 0 or -errno, from the child */
+    int n[M_CNT];
+    double ms[M_CNT][MAX_SAMPLES];
+};
+
+struct scenario {
+    const char *name;
+    unsigned metrics;           /* reported, 1 << M_* */
+    int (*run)(const camera_module_t *cam, int id, struct result *res);
+};
+
+/* a callback the child waits for, see arm() */
+struct event {
+    int armed;
+    double ms;                  /* of the first occurrence since arm() */
+    int32_t ext;
+};
+
+struct bench_memory {
+    camera_memory_t mem;
+    size_t buf_size;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static struct event preview_frame, focus, shutter, jpeg, video_frame;
+static camera_device_t *device;
+
+static const char *variant_keys[] = {
+    "ro.hardware",
+    "ro.product.board",
+    "ro.board.platform",
+    "ro.arch",
+};
+
+static const char *module_dirs[] = {
+    "/vendor/lib/hw",
+    "/system/lib/hw",
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void add_sample(struct result *res, int metric, double ms)
+{
+    if (res->n[metric] < MAX_SAMPLES)
+        res->ms[metric][res->n[metric]++] = ms;
+}
+
+/*****************************************************************************/
+
+static void arm(struct event *ev)
+{
+    pthread_mutex_lock(&lock);
+    ev->armed = 1;
+    pthread_mutex_unlock(&lock);
+}
+
+static void fire(struct event *ev, int32_t ext)
+{
+    pthread_mutex_lock(&lock);
+    if (ev->armed) {
+        ev->armed = 0;
+        ev->ms = now_ms();
+        ev->ext = ext;
+        pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* returns the time of the event, or -ETIMEDOUT */
+static double wait_event(struct event *ev)
+{
+    struct timespec ts;
+    double ms;
+    int err = 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += EVENT_TIMEOUT / 1000;
+    ts.tv_nsec += (EVENT_TIMEOUT % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (ev->armed && err == 0)
+        err = pthread_cond_timedwait(&cond, &lock, &ts);
+    ms = ev->armed ? -ETIMEDOUT : ev->ms;
+    ev->armed = 0;
+    pthread_mutex_unlock(&lock);
+    return ms;
+}
+
+static void camera_memory_release(struct camera_memory *mem)
+{
+    munmap(mem->data, mem->size);
+    free(mem);
+}
+
+static camera_memory_t *camera_get_memory(int fd, size_t buf_size, unsigned int num_bufs,
+                                          void *user)
+{
+    struct bench_memory *bm = calloc(1, sizeof(*bm));
+
+    if (bm == NULL)
+        return NULL;
+    bm->buf_size = buf_size;
+    bm->mem.size = buf_size * num_bufs;
+    bm->mem.data = mmap(NULL, bm->mem.size, PROT_READ | PROT_WRITE,
+                        fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    if (bm->mem.data == MAP_FAILED) {
+        free(bm);
+        return NULL;
+    }
+    bm->mem.release = camera_memory_release;
+    return &bm->mem;
+}
+
+static void camera_notify(int32_t msg_type, int32_t ext1, int32_t ext2, void *user)
+{
+    if (msg_type == CAMERA_MSG_SHUTTER)
+        fire(&shutter, 0);
+    else if (msg_type == CAMERA_MSG_FOCUS)
+        fire(&focus, ext1);
+}
+
+static void camera_data(int32_t msg_type, const camera_memory_t *data, unsigned int index,
+                        camera_frame_metadata_t *metadata, void *user)
+{
+    if (msg_type & CAMERA_MSG_PREVIEW_FRAME)
+        fire(&preview_frame, 0);
+    else if (msg_type & CAMERA_MSG_COMPRESSED_IMAGE)
+        fire(&jpeg, 0);
+}
+
+/* frames go back right away, like a recorder that keeps up */
+static void camera_data_timestamp(int64_t timestamp, int32_t msg_type,
+                                  const camera_memory_t *data, unsigned int index, void *user)
+{
+    const struct bench_memory *bm = (const struct bench_memory *)data;
+
+    fire(&video_frame, 0);
+    device->ops->release_recording_frame(device, (char *)data->data + index * bm->buf_size);
+}
+
+/*****************************************************************************/
+
+static int open_camera(const camera_module_t *cam, int id)
+{
+    char name[12];
+    int err;
+
+    snprintf(name, sizeof(name), "%d", id);
+    err = cam->common.methods->open(&cam->common, name, (struct hw_device_t **)&device);
+    if (err)
+        return err;
+    device->ops->set_callbacks(device, camera_notify, camera_data, camera_data_timestamp,
+                               camera_get_memory, NULL);
+    device->ops->enable_msg_type(device, CAMERA_MSG_PREVIEW_FRAME | CAMERA_MSG_FOCUS |
+                                 CAMERA_MSG_SHUTTER | CAMERA_MSG_COMPRESSED_IMAGE);
+    return 0;
+}
+
+static void close_camera(void)
+{
+    device->ops->release(device);
+    device->common.close(&device->common);
+    device = NULL;
+}
+
+/* returns the time of the first preview frame, or -errno */
+static double start_preview(void)
+{
+    int err;
+
+    arm(&preview_frame);
+    err = device->ops->start_preview(device);
+    if (err)
+        return err < 0 ? err : -EIO;
+    return wait_event(&preview_frame);
+}
+
+static int get_param(const char *key, char *value, size_t len)
+{
+    char *params = device->ops->get_parameters(device);
+    const char *p = params;
+    size_t klen = strlen(key);
+    int err = -ENOENT;
+
+    while (p != NULL && *p != '\0') {
+        if (strncmp(p, key, klen) == 0 && p[klen] == '=') {
+            size_t vlen = strcspn(p + klen + 1, ";");
+            if (vlen >= len)
+                vlen = len - 1;
+            memcpy(value, p + klen + 1, vlen);
+            value[vlen] = '\0';
+            err = 0;
+            break;
+        }
+        p = strchr(p, ';');
+        if (p != NULL)
+            p++;
+    }
+    if (device->ops->put_parameters)
+        device->ops->put_parameters(device, params);
+    else
+        free(params);
+    return err;
+}
+
+static int set_param(const char *key, const char *value)
+{
+    char *params = device->ops->get_parameters(device);
+    char *out, *p, *o;
+    size_t klen = strlen(key), len;
+    int err;
+
+    if (params == NULL)
+        return -ENOMEM;
+    len = strlen(params) + klen + strlen(value) + 3;
+    out = malloc(len);
+    if (out == NULL) {
+        err = -ENOMEM;
+        goto put;
+    }
+
+    /* every pair but key, then key */
+    o = out;
+    for (p = params; *p != '\0'; ) {
+        size_t plen = strcspn(p, ";");
+        if (plen > 0 && !(strncmp(p, key, klen) == 0 && p[klen] == '=')) {
+            memcpy(o, p, plen);
+            o += plen;
+            *o++ = ';';
+        }
+        p += plen;
+        if (*p == ';')
+            p++;
+    }
+    sprintf(o, "%s=%s", key, value);
+
+    err = device->ops->set_parameters(device, out);
+    free(out);
+put:
+    if (device->ops->put_parameters)
+        device->ops->put_parameters(device, params);
+    else
+        free(params);
+    return err;
+}
+
+/* takes a picture with preview running, returns the time of the jpeg */
+static double take_picture(struct result *res)
+{
+    double t, ts, tj;
+    int err;
+
+    arm(&shutter);
+    arm(&jpeg);
+    t = now_ms();
+    err = device->ops->take_picture(device);
+    if (err)
+        return err < 0 ? err : -EIO;
+    ts = wait_event(&shutter);
+    if (ts < 0)
+        return ts;
+    tj = wait_event(&jpeg);
+    if (tj < 0)
+        return tj;
+
+    add_sample(res, M_SHUTTER_LAG, ts - t);
+    add_sample(res, M_SHUTTER_TO_JPEG, tj - ts);
+    return tj;
+}
+
+static int restart_preview(struct result *res)
+{
+    double t = now_ms(), tf = start_preview();
+
+    if (tf < 0)
+        return tf;
+    add_sample(res, M_PREVIEW_RESTART, tf - t);
+    return 0;
+}
+
+static int finish(struct result *res)
+{
+    double t;
+
+    device->ops->stop_preview(device);
+    t = now_ms();
+    close_camera();
+    add_sample(res, M_CLOSE, now_ms() - t);
+    return 0;
+}
+
+/*****************************************************************************/
+
+static int run_single(const camera_module_t *cam, int id, struct result *res)
+{
+    double t, tf, tj;
+    int err;
+
+    t = now_ms();
+    err = open_camera(cam, id);
+    if (err)
+        return err;
+    add_sample(res, M_OPEN, now_ms() - t);
+    tf = start_preview();
+    if (tf < 0)
+        goto fail;
+    add_sample(res, M_FIRST_FRAME, tf - t);
+
+    arm(&focus);
+    t = now_ms();
+    err = device->ops->auto_focus(device);
+    if (err) {
+        tf = err < 0 ? err : -EIO;
+        goto fail;
+    }
+    tf = wait_event(&focus);
+    if (tf < 0)
+        goto fail;
+    add_sample(res, M_FOCUS, tf - t);
+
+    tj = take_picture(res);
+    if (tj < 0) {
+        tf = tj;
+        goto fail;
+    }
+    err = restart_preview(res);
+    if (err) {
+        tf = err;
+        goto fail;
+    }
+    return finish(res);
+
+fail:
+    close_camera();
+    return tf;
+}
+
+static int run_burst(const camera_module_t *cam, int id, struct result *res)
+{
+    double tf, tj, last = 0;
+    int err, i;
+
+    err = open_camera(cam, id);
+    if (err)
+        return err;
+    tf = start_preview();
+    if (tf < 0)
+        goto fail;
+
+    for (i = 0; i < BURST_SHOTS; i++) {
+        tj = take_picture(res);
+        if (tj < 0) {
+            tf = tj;
+            goto fail;
+        }
+        if (i > 0)
+            add_sample(res, M_SHOT_TO_SHOT, tj - last);
+        last = tj;
+        err = restart_preview(res);
+        if (err) {
+            tf = err;
+            goto fail;
+        }
+    }
+    return finish(res);
+
+fail:
+    close_camera();
+    return tf;
+}
+
+static int run_switch(const camera_module_t *cam, int id, struct result *res)
+{
+    static const char *hints[] = { "true", "false" };
+    double t, tf;
+    int err, i, other = -1;
+
+    err = open_camera(cam, id);
+    if (err)
+        return err;
+    tf = start_preview();
+    if (tf < 0)
+        goto fail;
+
+    for (i = 0; i < 2; i++) {
+        t = now_ms();
+        device->ops->stop_preview(device);
+        err = set_param("recording-hint", hints[i]);
+        if (err) {
+            tf = err < 0 ? err : -EINVAL;
+            goto fail;
+        }
+        tf = start_preview();
+        if (tf < 0)
+            goto fail;
+        add_sample(res, M_MODE_SWITCH, tf - t);
+    }
+
+    if (cam->get_number_of_cameras() > 1)
+        other = id == 0 ? 1 : 0;
+    for (i = 0; other >= 0 && i < 2; i++) {
+        t = now_ms();
+        device->ops->stop_preview(device);
+        close_camera();
+        err = open_camera(cam, i == 0 ? other : id);
+        if (err)
+            return err;
+        tf = start_preview();
+        if (tf < 0)
+            goto fail;
+        add_sample(res, M_CAMERA_SWITCH, tf - t);
+    }
+    return finish(res);
+
+fail:
+    close_camera();
+    return tf;
+}
+
+static int run_record(const camera_module_t *cam, int id, struct result *res)
+{
+    char snapshot[8];
+    double t, tf;
+    int err;
+
+    err = open_camera(cam, id);
+    if (err)
+        return err;
+    err = set_param("recording-hint", "true");
+    if (err) {
+        tf = err < 0 ? err : -EINVAL;
+        goto fail;
+    }
+    tf = start_preview();
+    if (tf < 0)
+        goto fail;
+
+    /* kMetadataBufferTypeCameraSource buffers, as the recorder asks for;
+     * a camera without them records into its frames */
+    device->ops->store_meta_data_in_buffers(device, 1);
+    device->ops->enable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+    arm(&video_frame);
+    t = now_ms();
+    err = device->ops->start_recording(device);
+    if (err) {
+        tf = err < 0 ? err : -EIO;
+        goto fail;
+    }
+    tf = wait_event(&video_frame);
+    if (tf < 0)
+        goto fail;
+    add_sample(res, M_RECORD_START, tf - t);
+    usleep(RECORD_MS * 1000);
+
+    if (get_param("video-snapshot-supported", snapshot, sizeof(snapshot)) == 0 &&
+        strcmp(snapshot, "true") == 0) {
+        arm(&jpeg);
+        t = now_ms();
+        err = device->ops->take_picture(device);
+        if (err) {
+            tf = err < 0 ? err : -EIO;
+            goto fail;
+        }
+        tf = wait_event(&jpeg);
+        if (tf < 0)
+            goto fail;
+        add_sample(res, M_VIDEO_SNAPSHOT, tf - t);
+        usleep(RECORD_MS * 1000);
+    }
+
+    t = now_ms();
+    device->ops->stop_recording(device);
+    add_sample(res, M_RECORD_STOP, now_ms() - t);
+    device->ops->disable_msg_type(device, CAMERA_MSG_VIDEO_FRAME);
+    return finish(res);
+
+fail:
+    if (device->ops->recording_enabled(device))
+        device->ops->stop_recording(device);
+    close_camera();
+    return tf;
+}
+
+#define BIT(m)  (1u << (m))
+
+static const struct scenario scenarios[] = {
+    { "single", BIT(M_OPEN) | BIT(M_FIRST_FRAME) | BIT(M_FOCUS) | BIT(M_SHUTTER_LAG) |
+                BIT(M_SHUTTER_TO_JPEG) | BIT(M_PREVIEW_RESTART) | BIT(M_CLOSE),
+      run_single },
+    { "burst",  BIT(M_SHUTTER_LAG) | BIT(M_SHUTTER_TO_JPEG) | BIT(M_SHOT_TO_SHOT) |
+                BIT(M_PREVIEW_RESTART),
+      run_burst },
+    { "switch", BIT(M_MODE_SWITCH) | BIT(M_CAMERA_SWITCH),
+      run_switch },
+    { "record", BIT(M_RECORD_START) | BIT(M_VIDEO_SNAPSHOT) | BIT(M_RECORD_STOP),
+      run_record },
+};
+
+/*****************************************************************************/
+
+/* The same lookup as hw_get_module(), except for -m */
+static int find_module(const char *stem, const char *dir, char *path, size_t len)
+{
+    char variant[PROPERTY_VALUE_MAX];
+    size_t i, d, ndirs = dir ? 1 : sizeof(module_dirs) / sizeof(module_dirs[0]);
+
+    for (i = 0; i <= sizeof(variant_keys) / sizeof(variant_keys[0]); i++) {
+        if (i < sizeof(variant_keys) / sizeof(variant_keys[0])) {
+            if (property_get(variant_keys[i], variant, NULL) <= 0)
+                continue;
+        } else {
+            strcpy(variant, "default");
+        }
+        for (d = 0; d < ndirs; d++) {
+            snprintf(path, len, "%s/%s.%s.so", dir ? dir : module_dirs[d], stem, variant);
+            if (access(path, R_OK) == 0)
+                return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static int run_child(const struct scenario *sc, const char *path, int id, struct result *res)
+{
+    const camera_module_t *cam;
+    void *handle;
+
+    alarm(SCENARIO_TIMEOUT);
+
+    handle = dlopen(path, RTLD_NOW);
+    if (handle == NULL) {
+        fprintf(stderr, "%s: %s\n", path, dlerror());
+        return -ENOEXEC;
+    }
+    cam = dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR);
+    if (cam == NULL)
+        return -ENOEXEC;
+    if (id >= cam->get_number_of_cameras())
+        return -ENODEV;
+
+    return sc->run(cam, id, res);
+}
+
+static int run_once(const struct scenario *sc, const char *path, int id, struct result *res)
+{
+    char *p = (char *)res;
+    size_t got = 0;
+    ssize_t n;
+    int fds[2], status;
+    pid_t pid;
+
+    memset(res, 0, sizeof(*res));
+    if (pipe(fds) < 0)
+        return -errno;
+
+    pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -errno;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        res->status = run_child(sc, path, id, res);
+        write(fds[1], res, sizeof(*res));
+        _exit(0);
+    }
+
+    close(fds[1]);
+    while (got < sizeof(*res) && (n = read(fds[0], p + got, sizeof(*res) - got)) > 0)
+        got += n;
+    if (got != sizeof(*res)) {
+        memset(res, 0, sizeof(*res));
+        res->status = -EPIPE;
+    }
+    close(fds[0]);
+
+    if (waitpid(pid, &status, 0) == pid && WIFSIGNALED(status))
+        res->status = WTERMSIG(status) == SIGALRM ? -ETIMEDOUT : -EINTR;
+    return res->status;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(*v), compare_double);
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* returns the median of scenario/metric in a report, or -1 */
+static double baseline_median(FILE *base, const char *scenario, const char *metric)
+{
+    char line[256], s[64], m[64], med[32];
+
+    rewind(base);
+    while (fgets(line, sizeof(line), base) != NULL) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%63s %63s %31s", s, m, med) != 3)
+            continue;
+        if (strcmp(s, scenario) == 0 && strcmp(m, metric) == 0)
+            return strcmp(med, "-") == 0 ? -1 : atof(med);
+    }
+    return -1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: camerabench [-n runs] [-s scenario,...] [-c camera] "
+            "[-m module_dir]\n                   [-o report] [-b baseline] [-t percent]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *only = NULL, *dir = NULL, *out_path = NULL, *base_path = NULL;
+    char path[PATH_MAX];
+    int runs = 3, id = 0, regressions = 0;
+    double threshold = 10;
+    FILE *out = stdout, *base = NULL;
+    size_t s;
+    int c, r, m, i;
+
+    while ((c = getopt(argc, argv, "n:s:c:m:o:b:t:")) != -1) {
+        switch (c) {
+        case 'n': runs = atoi(optarg); break;
+        case 's': only = optarg; break;
+        case 'c': id = atoi(optarg); break;
+        case 'm': dir = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'b': base_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (runs < 1 || runs > MAX_RUNS || id < 0 || threshold < 0) {
+        usage();
+        return 1;
+    }
+    if (find_module(CAMERA_HARDWARE_MODULE_ID, dir, path, sizeof(path))) {
+        fprintf(stderr, "camerabench: no camera module\n");
+        return 1;
+    }
+    if (base_path != NULL) {
+        base = fopen(base_path, "r");
+        if (base == NULL) {
+            perror(base_path);
+            return 1;
+        }
+    }
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    fprintf(out, "# camerabench: %s, camera %d, %d runs, ms\n", path, id, runs);
+    fprintf(out, "# scenario\tmetric\tmedian\tmin\tmax\tsamples\n");
+
+    for (s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        const struct scenario *sc = &scenarios[s];
+        static double v[M_CNT][MAX_RUNS * MAX_SAMPLES];
+        int n[M_CNT], ok = 0, err = 0;
+
+        if (only != NULL) {
+            const char *p = strstr(only, sc->name);
+            size_t len = strlen(sc->name);
+            if (p == NULL || (p != only && p[-1] != ',') || (p[len] != '\0' && p[len] != ','))
+                continue;
+        }
+
+        memset(n, 0, sizeof(n));
+        for (r = 0; r < runs; r++) {
+            struct result res;
+            if (run_once(sc, path, id, &res)) {
+                err = res.status;
+                continue;
+            }
+            for (m = 0; m < M_CNT; m++)
+                for (i = 0; i < res.n[m]; i++)
+                    v[m][n[m]++] = res.ms[m][i];
+            ok++;
+        }
+
+        if (ok < runs)
+            fprintf(out, "# %s: %d/%d runs failed: %s\n", sc->name, runs - ok, runs,
+                    strerror(-err));
+        for (m = 0; m < M_CNT; m++) {
+            double med, was;
+
+            if (!(sc->metrics & BIT(m)))
+                continue;
+            if (n[m] == 0) {
+                fprintf(out, "%s\t%s\t-\t-\t-\t0\n", sc->name, metric_names[m]);
+                continue;
+            }
+            med = median(v[m], n[m]);
+            fprintf(out, "%s\t%s\t%.2f\t%.2f\t%.2f\t%d\n", sc->name, metric_names[m],
+                    med, v[m][0], v[m][n[m] - 1], n[m]);
+
+            if (base == NULL)
+                continue;
+            was = baseline_median(base, sc->name, metric_names[m]);
+            if (was > 0 && med > was * (1 + threshold / 100)) {
+                fprintf(stderr, "camerabench: %s %s %.2f -> %.2f ms (+%.0f%%)\n", sc->name,
+                        metric_names[m], was, med, (med - was) * 100 / was);
+                regressions++;
+            }
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    if (base != NULL)
+        fclose(base);
+    return regressions ? 2 : 0;
+}
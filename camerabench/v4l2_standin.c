@@ -0,0 +1,662 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A stand-in camera HAL for camerabench, on a plain V4L2 capture device
+ * ($CAMERABENCH_VIDEO, /dev/video0 by default) streaming YUYV.
+ *
+ * It follows the capture sequence of libcamera: preview streams at the
+ * preview size; a picture stops preview, streams one frame at the picture
+ * size and hands it out as the compressed image, unencoded. While recording,
+ * preview frames are also video frames, and a picture is the next of them.
+ * Focus completes on the next preview frame.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+#include <hardware/camera.h>
+#include <hardware/hardware.h>
+
+#define NUM_BUFS        4
+#define DQBUF_TIMEOUT   2000    /* ms */
+
+#define DEFAULT_PARAMETERS \
+    "preview-size=640x480;preview-format=yuv422i-yuyv;" \
+    "picture-size=1280x720;picture-format=jpeg;" \
+    "recording-hint=false;video-snapshot-supported=true"
+
+struct standin {
+    camera_device_t dev;
+    int fd;
+
+    pthread_mutex_t lock;
+    char *params;
+    int preview_width, preview_height;
+    int picture_width, picture_height;
+    int32_t msg_enabled;
+
+    camera_notify_callback notify_cb;
+    camera_data_callback data_cb;
+    camera_data_timestamp_callback data_cb_timestamp;
+    camera_request_memory get_memory;
+    void *user;
+
+    void *bufs[NUM_BUFS];
+    size_t buf_len[NUM_BUFS];
+    int nbufs;
+
+    pthread_t preview_thread;
+    int previewing;
+    int recording;
+    int focus_pending;
+    int snapshot_pending;
+    camera_memory_t *preview_heap;
+    camera_memory_t *record_heap;
+    unsigned record_index;
+
+    pthread_t picture_thread;
+    int picture_running;
+};
+
+static struct standin *to_standin(struct camera_device *dev)
+{
+    return (struct standin *)dev;
+}
+
+/*****************************************************************************/
+
+static int stream_on(struct standin *s, int width, int height)
+{
+    struct v4l2_format fmt;
+    struct v4l2_requestbuffers req;
+    struct v4l2_buffer buf;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    int i;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    if (ioctl(s->fd, VIDIOC_S_FMT, &fmt) < 0)
+        return -errno;
+
+    memset(&req, 0, sizeof(req));
+    req.count = NUM_BUFS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(s->fd, VIDIOC_REQBUFS, &req) < 0)
+        return -errno;
+
+    for (i = 0; i < (int)req.count && i < NUM_BUFS; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (ioctl(s->fd, VIDIOC_QUERYBUF, &buf) < 0)
+            goto fail;
+        s->bufs[i] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd,
+                          buf.m.offset);
+        if (s->bufs[i] == MAP_FAILED)
+            goto fail;
+        s->buf_len[i] = buf.length;
+        s->nbufs = i + 1;
+        if (ioctl(s->fd, VIDIOC_QBUF, &buf) < 0)
+            goto fail;
+    }
+    if (ioctl(s->fd, VIDIOC_STREAMON, &type) < 0)
+        goto fail;
+    return 0;
+
+fail:
+    i = -errno;
+    while (s->nbufs > 0) {
+        s->nbufs--;
+        munmap(s->bufs[s->nbufs], s->buf_len[s->nbufs]);
+    }
+    return i;
+}
+
+static void stream_off(struct standin *s)
+{
+    struct v4l2_requestbuffers req;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    ioctl(s->fd, VIDIOC_STREAMOFF, &type);
+    while (s->nbufs > 0) {
+        s->nbufs--;
+        munmap(s->bufs[s->nbufs], s->buf_len[s->nbufs]);
+    }
+    memset(&req, 0, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    ioctl(s->fd, VIDIOC_REQBUFS, &req);
+}
+
+static int stream_get(struct standin *s, struct v4l2_buffer *buf)
+{
+    struct pollfd pfd = { s->fd, POLLIN, 0 };
+    int n;
+
+    n = poll(&pfd, 1, DQBUF_TIMEOUT);
+    if (n <= 0)
+        return n == 0 ? -ETIMEDOUT : -errno;
+    memset(buf, 0, sizeof(*buf));
+    buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf->memory = V4L2_MEMORY_MMAP;
+    if (ioctl(s->fd, VIDIOC_DQBUF, buf) < 0)
+        return -errno;
+    return 0;
+}
+
+static void stream_put(struct standin *s, struct v4l2_buffer *buf)
+{
+    ioctl(s->fd, VIDIOC_QBUF, buf);
+}
+
+/* the frame in a buffer of the callback's own, as libcamera does */
+static camera_memory_t *copy_frame(struct standin *s, const struct v4l2_buffer *buf)
+{
+    camera_memory_t *mem = s->get_memory(-1, buf->bytesused, 1, s->user);
+
+    if (mem != NULL)
+        memcpy(mem->data, s->bufs[buf->index], buf->bytesused);
+    return mem;
+}
+
+/*****************************************************************************/
+
+static void *preview_thread(void *arg)
+{
+    struct standin *s = arg;
+    struct v4l2_buffer buf;
+    struct timespec ts;
+    int32_t msgs;
+    int focus, snapshot, recording;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        if (!s->previewing) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (stream_get(s, &buf))
+            continue;
+
+        pthread_mutex_lock(&s->lock);
+        msgs = s->msg_enabled;
+        recording = s->recording;
+        focus = s->focus_pending;
+        snapshot = s->snapshot_pending;
+        s->focus_pending = 0;
+        s->snapshot_pending = 0;
+        pthread_mutex_unlock(&s->lock);
+
+        if ((msgs & CAMERA_MSG_PREVIEW_FRAME) && s->preview_heap != NULL) {
+            size_t len = buf.bytesused < s->preview_heap->size ? buf.bytesused
+                                                               : s->preview_heap->size;
+            memcpy(s->preview_heap->data, s->bufs[buf.index], len);
+            s->data_cb(CAMERA_MSG_PREVIEW_FRAME, s->preview_heap, 0, NULL, s->user);
+        }
+        if (recording && (msgs & CAMERA_MSG_VIDEO_FRAME)) {
+            unsigned i = s->record_index++ % NUM_BUFS;
+            size_t size = s->record_heap->size / NUM_BUFS;
+
+            memcpy((char *)s->record_heap->data + i * size, s->bufs[buf.index],
+                   buf.bytesused < size ? buf.bytesused : size);
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            s->data_cb_timestamp(ts.tv_sec * 1000000000LL + ts.tv_nsec, CAMERA_MSG_VIDEO_FRAME,
+                                 s->record_heap, i, s->user);
+        }
+        if (focus && (msgs & CAMERA_MSG_FOCUS))
+            s->notify_cb(CAMERA_MSG_FOCUS, 1, 0, s->user);
+        if (snapshot) {
+            camera_memory_t *mem = copy_frame(s, &buf);
+
+            if (msgs & CAMERA_MSG_SHUTTER)
+                s->notify_cb(CAMERA_MSG_SHUTTER, 0, 0, s->user);
+            if (mem != NULL && (msgs & CAMERA_MSG_COMPRESSED_IMAGE))
+                s->data_cb(CAMERA_MSG_COMPRESSED_IMAGE, mem, 0, NULL, s->user);
+            if (mem != NULL)
+                mem->release(mem);
+        }
+
+        stream_put(s, &buf);
+    }
+    return NULL;
+}
+
+static void *picture_thread(void *arg)
+{
+    struct standin *s = arg;
+    struct v4l2_buffer buf;
+    camera_memory_t *mem = NULL;
+    int32_t msgs = 0;
+
+    if (stream_on(s, s->picture_width, s->picture_height))
+        return NULL;
+    if (stream_get(s, &buf) == 0) {
+        pthread_mutex_lock(&s->lock);
+        msgs = s->msg_enabled;
+        pthread_mutex_unlock(&s->lock);
+
+        if (msgs & CAMERA_MSG_SHUTTER)
+            s->notify_cb(CAMERA_MSG_SHUTTER, 0, 0, s->user);
+        mem = copy_frame(s, &buf);
+        stream_put(s, &buf);
+    }
+    stream_off(s);
+
+    if (mem != NULL) {
+        if (msgs & CAMERA_MSG_COMPRESSED_IMAGE)
+            s->data_cb(CAMERA_MSG_COMPRESSED_IMAGE, mem, 0, NULL, s->user);
+        mem->release(mem);
+    }
+    return NULL;
+}
+
+static void join_picture(struct standin *s)
+{
+    if (s->picture_running) {
+        pthread_join(s->picture_thread, NULL);
+        s->picture_running = 0;
+    }
+}
+
+/*****************************************************************************/
+
+static int standin_set_preview_window(struct camera_device *dev,
+                                      struct preview_stream_ops *window)
+{
+    return 0;
+}
+
+static void standin_set_callbacks(struct camera_device *dev,
+                                  camera_notify_callback notify_cb,
+                                  camera_data_callback data_cb,
+                                  camera_data_timestamp_callback data_cb_timestamp,
+                                  camera_request_memory get_memory, void *user)
+{
+    struct standin *s = to_standin(dev);
+
+    s->notify_cb = notify_cb;
+    s->data_cb = data_cb;
+    s->data_cb_timestamp = data_cb_timestamp;
+    s->get_memory = get_memory;
+    s->user = user;
+}
+
+static void standin_enable_msg_type(struct camera_device *dev, int32_t msg_type)
+{
+    struct standin *s = to_standin(dev);
+
+    pthread_mutex_lock(&s->lock);
+    s->msg_enabled |= msg_type;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void standin_disable_msg_type(struct camera_device *dev, int32_t msg_type)
+{
+    struct standin *s = to_standin(dev);
+
+    pthread_mutex_lock(&s->lock);
+    s->msg_enabled &= ~msg_type;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int standin_msg_type_enabled(struct camera_device *dev, int32_t msg_type)
+{
+    struct standin *s = to_standin(dev);
+    int enabled;
+
+    pthread_mutex_lock(&s->lock);
+    enabled = (s->msg_enabled & msg_type) == msg_type;
+    pthread_mutex_unlock(&s->lock);
+    return enabled;
+}
+
+static int standin_start_preview(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+    size_t size = s->preview_width * s->preview_height * 2;
+    int err;
+
+    join_picture(s);
+    if (s->previewing)
+        return 0;
+
+    if (s->preview_heap == NULL || s->preview_heap->size != size) {
+        if (s->preview_heap != NULL)
+            s->preview_heap->release(s->preview_heap);
+        s->preview_heap = s->get_memory(-1, size, 1, s->user);
+        if (s->preview_heap == NULL)
+            return -ENOMEM;
+    }
+
+    err = stream_on(s, s->preview_width, s->preview_height);
+    if (err)
+        return err;
+    s->previewing = 1;
+    err = pthread_create(&s->preview_thread, NULL, preview_thread, s);
+    if (err) {
+        s->previewing = 0;
+        stream_off(s);
+        return -err;
+    }
+    return 0;
+}
+
+static void stop_streaming(struct standin *s)
+{
+    if (!s->previewing)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->previewing = 0;
+    s->recording = 0;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->preview_thread, NULL);
+    stream_off(s);
+}
+
+static void standin_stop_preview(struct camera_device *dev)
+{
+    stop_streaming(to_standin(dev));
+}
+
+static int standin_preview_enabled(struct camera_device *dev)
+{
+    return to_standin(dev)->previewing;
+}
+
+static int standin_store_meta_data_in_buffers(struct camera_device *dev, int enable)
+{
+    return enable ? -EINVAL : 0;
+}
+
+static int standin_start_recording(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+    size_t size = s->preview_width * s->preview_height * 2;
+
+    if (!s->previewing)
+        return -EINVAL;
+    if (s->record_heap == NULL || s->record_heap->size != size * NUM_BUFS) {
+        if (s->record_heap != NULL)
+            s->record_heap->release(s->record_heap);
+        s->record_heap = s->get_memory(-1, size, NUM_BUFS, s->user);
+        if (s->record_heap == NULL)
+            return -ENOMEM;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->recording = 1;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static void standin_stop_recording(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+
+    pthread_mutex_lock(&s->lock);
+    s->recording = 0;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int standin_recording_enabled(struct camera_device *dev)
+{
+    return to_standin(dev)->recording;
+}
+
+static void standin_release_recording_frame(struct camera_device *dev, const void *opaque)
+{
+}
+
+static int standin_auto_focus(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+
+    pthread_mutex_lock(&s->lock);
+    s->focus_pending = 1;
+    pthread_mutex_unlock(&s->lock);
+    return s->previewing ? 0 : -EINVAL;
+}
+
+static int standin_cancel_auto_focus(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+
+    pthread_mutex_lock(&s->lock);
+    s->focus_pending = 0;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static int standin_take_picture(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+    int err;
+
+    if (s->recording) {
+        pthread_mutex_lock(&s->lock);
+        s->snapshot_pending = 1;
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    stop_streaming(s);
+    join_picture(s);
+    err = pthread_create(&s->picture_thread, NULL, picture_thread, s);
+    if (err)
+        return -err;
+    s->picture_running = 1;
+    return 0;
+}
+
+static int standin_cancel_picture(struct camera_device *dev)
+{
+    join_picture(to_standin(dev));
+    return 0;
+}
+
+static void parse_size(const char *params, const char *key, int *width, int *height)
+{
+    const char *p = params;
+    size_t len = strlen(key);
+
+    while (p != NULL) {
+        if (strncmp(p, key, len) == 0 && p[len] == '=') {
+            sscanf(p + len + 1, "%dx%d", width, height);
+            return;
+        }
+        p = strchr(p, ';');
+        if (p != NULL)
+            p++;
+    }
+}
+
+static int standin_set_parameters(struct camera_device *dev, const char *params)
+{
+    struct standin *s = to_standin(dev);
+    char *copy = strdup(params);
+
+    if (copy == NULL)
+        return -ENOMEM;
+    pthread_mutex_lock(&s->lock);
+    free(s->params);
+    s->params = copy;
+    parse_size(copy, "preview-size", &s->preview_width, &s->preview_height);
+    parse_size(copy, "picture-size", &s->picture_width, &s->picture_height);
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static char *standin_get_parameters(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+    char *params;
+
+    pthread_mutex_lock(&s->lock);
+    params = strdup(s->params);
+    pthread_mutex_unlock(&s->lock);
+    return params;
+}
+
+static void standin_put_parameters(struct camera_device *dev, char *params)
+{
+    free(params);
+}
+
+static int standin_send_command(struct camera_device *dev, int32_t cmd, int32_t arg1,
+                                int32_t arg2)
+{
+    return -EINVAL;
+}
+
+static void standin_release(struct camera_device *dev)
+{
+    struct standin *s = to_standin(dev);
+
+    stop_streaming(s);
+    join_picture(s);
+}
+
+static int standin_dump(struct camera_device *dev, int fd)
+{
+    return 0;
+}
+
+static camera_device_ops_t standin_ops = {
+    .set_preview_window = standin_set_preview_window,
+    .set_callbacks = standin_set_callbacks,
+    .enable_msg_type = standin_enable_msg_type,
+    .disable_msg_type = standin_disable_msg_type,
+    .msg_type_enabled = standin_msg_type_enabled,
+    .start_preview = standin_start_preview,
+    .stop_preview = standin_stop_preview,
+    .preview_enabled = standin_preview_enabled,
+    .store_meta_data_in_buffers = standin_store_meta_data_in_buffers,
+    .start_recording = standin_start_recording,
+    .stop_recording = standin_stop_recording,
+    .recording_enabled = standin_recording_enabled,
+    .release_recording_frame = standin_release_recording_frame,
+    .auto_focus = standin_auto_focus,
+    .cancel_auto_focus = standin_cancel_auto_focus,
+    .take_picture = standin_take_picture,
+    .cancel_picture = standin_cancel_picture,
+    .set_parameters = standin_set_parameters,
+    .get_parameters = standin_get_parameters,
+    .put_parameters = standin_put_parameters,
+    .send_command = standin_send_command,
+    .release = standin_release,
+    .dump = standin_dump,
+};
+
+/*****************************************************************************/
+
+static int standin_close(struct hw_device_t *device)
+{
+    struct standin *s = (struct standin *)device;
+
+    standin_release(&s->dev);
+    if (s->preview_heap != NULL)
+        s->preview_heap->release(s->preview_heap);
+    if (s->record_heap != NULL)
+        s->record_heap->release(s->record_heap);
+    close(s->fd);
+    pthread_mutex_destroy(&s->lock);
+    free(s->params);
+    free(s);
+    return 0;
+}
+
+static int standin_open(const struct hw_module_t *module, const char *id,
+                        struct hw_device_t **device)
+{
+    const char *path = getenv("CAMERABENCH_VIDEO");
+    struct standin *s;
+
+    if (strcmp(id, "0") != 0)
+        return -ENODEV;
+
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return -ENOMEM;
+    s->fd = open(path != NULL ? path : "/dev/video0", O_RDWR | O_NONBLOCK);
+    if (s->fd < 0) {
+        free(s);
+        return -errno;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    if (standin_set_parameters(&s->dev, DEFAULT_PARAMETERS)) {
+        standin_close(&s->dev.common);
+        return -ENOMEM;
+    }
+
+    s->dev.common.tag = HARDWARE_DEVICE_TAG;
+    s->dev.common.version = CAMERA_DEVICE_API_VERSION_1_0;
+    s->dev.common.module = (struct hw_module_t *)module;
+    s->dev.common.close = standin_close;
+    s->dev.ops = &standin_ops;
+    *device = &s->dev.common;
+    return 0;
+}
+
+static int standin_get_number_of_cameras(void)
+{
+    return 1;
+}
+
+static int standin_get_camera_info(int camera_id, struct camera_info *info)
+{
+    if (camera_id != 0)
+        return -ENODEV;
+    info->facing = CAMERA_FACING_BACK;
+    info->orientation = 0;
+    return 0;
+}
+
+static struct hw_module_methods_t standin_module_methods = {
+    .open = standin_open,
+};
+
+camera_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = CAMERA_MODULE_API_VERSION_1_0,
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = CAMERA_HARDWARE_MODULE_ID,
+        .name = "camerabench V4L2 stand-in",
+        .author = "The CyanogenMod Project",
+        .methods = &standin_module_methods,
+    },
+    .get_number_of_cameras = standin_get_number_of_cameras,
+    .get_camera_info = standin_get_camera_info,
+};
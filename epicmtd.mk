@@ -71,6 +71,9 @@ PRODUCT_PACKAGES += \
     power.victory \
     audio.primary.s5pc110 \
     audio_policy.s5pc110 \
+    libsecpreprocessing \
+    libhaltrace \
+    libhalsched \
     audio.a2dp.default \
     audio.usb.default \
     sensors.s5pc110 \
@@ -78,7 +81,9 @@ PRODUCT_PACKAGES += \
     hwcomposer.s5pc110
 
 PRODUCT_COPY_FILES += \
-    device/samsung/epicmtd/libaudio/audio_policy.conf:system/etc/audio_policy.conf
+    device/samsung/epicmtd/libaudio/audio_policy.conf:system/etc/audio_policy.conf \
+    device/samsung/epicmtd/libaudio/audio_effects.conf:system/vendor/etc/audio_effects.conf \
+    device/samsung/epicmtd/libhalsched/halsched.conf:system/etc/halsched.conf
 
 # update utilities
 PRODUCT_PACKAGES += \
@@ -89,6 +94,16 @@ PRODUCT_PACKAGES += \
 PRODUCT_PACKAGES += \
 	bdaddr_read
 
+# HAL profiling, kept out of user builds
+ifneq ($(TARGET_BUILD_VARIANT),user)
+PRODUCT_PACKAGES += \
+	halprofile \
+	camerabench
+
+PRODUCT_COPY_FILES += \
+  device/samsung/epicmtd/init.victory.debug.rc:root/init.victory.debug.rc
+endif
+
 # Camera
 PRODUCT_PACKAGES += \
     sensors.s5pc110 \
@@ -131,6 +146,10 @@ PRODUCT_DEFAULT_PROPERTY_OVERRIDES := \
 PRODUCT_PROPERTY_OVERRIDES := \
     ro.opengles.version=131072
 
+# Primary output rate, 44100 if the codec refuses it
+PRODUCT_PROPERTY_OVERRIDES += \
+    audio.output.rate=48000
+
 # Telephony property for CDMA
 PRODUCT_PROPERTY_OVERRIDES += \
     ro.config.vc_call_vol_steps=15 \
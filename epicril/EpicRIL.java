@@ -19,28 +19,125 @@ package com.android.internal.telephony;
 import static com.android.internal.telephony.RILConstants.*;
 
 import android.content.Context;
+import android.os.AsyncResult;
+import android.os.Handler;
+import android.os.Looper;
 import android.os.Message;
 import android.os.Parcel;
+import android.os.SystemClock;
 import android.os.SystemProperties;
 import android.telephony.SignalStrength;
 import android.text.TextUtils;
 import android.util.Log;
 
 import java.util.ArrayList;
+import java.util.Arrays;
 
 /**
 * {@hide}
 */
 public class EpicRIL extends SamsungExynos3RIL implements CommandsInterface {
+    /* Unsolicited signal strength updates that scale to what was last
+     * reported are dropped. Changes are passed on at most once every
+     * SIGNAL_STRENGTH_INTERVAL_MS, the latest one when the interval ends. */
+    private static final int SIGNAL_STRENGTH_INTERVAL_MS = 2000;
+    private static final int EVENT_SIGNAL_STRENGTH_TRAILING = 1;
+
+    /* only touched by the receiver thread */
+    private final int[] mSignalStrengthScratch = new int[7];
+
+    private final Object mSignalStrengthLock = new Object();
+    private final int[] mSignalStrengthReported = new int[7];
+    private final int[] mSignalStrengthPending = new int[7];
+    private boolean mSignalStrengthReportedValid;
+    private long mSignalStrengthReportedTime;
+
+    private final Handler mSignalStrengthHandler = new Handler(Looper.getMainLooper()) {
+        @Override
+        public void handleMessage(Message msg) {
+            if (msg.what == EVENT_SIGNAL_STRENGTH_TRAILING) {
+                synchronized (mSignalStrengthLock) {
+                    notifySignalStrengthLocked(mSignalStrengthPending);
+                }
+            }
+        }
+    };
+
     public EpicRIL(Context context, int networkMode, int cdmaSubscription) {
         super(context, networkMode, cdmaSubscription);
     }
 
+    @Override
+    public void setOnSignalStrengthUpdate(Handler h, int what, Object obj) {
+        super.setOnSignalStrengthUpdate(h, what, obj);
+        // A new registrant hasn't seen anything yet
+        synchronized (mSignalStrengthLock) {
+            mSignalStrengthReportedValid = false;
+        }
+    }
+
     @Override
     protected Object
     responseSignalStrength(Parcel p) {
+        // Solicited, the poll result is what the framework has now
+        readSignalStrength(p, mSignalStrengthScratch);
+        synchronized (mSignalStrengthLock) {
+            System.arraycopy(mSignalStrengthScratch, 0, mSignalStrengthReported, 0, 7);
+            mSignalStrengthReportedValid = true;
+        }
+        return newSignalStrength(mSignalStrengthScratch);
+    }
+
+    private void
+    processSignalStrength(Parcel p) {
+        int[] response = mSignalStrengthScratch;
+        readSignalStrength(p, response);
+
+        synchronized (mSignalStrengthLock) {
+            if (mSignalStrengthReportedValid &&
+                    Arrays.equals(response, mSignalStrengthReported)) {
+                // Back to what was reported, nothing left to send
+                mSignalStrengthHandler.removeMessages(EVENT_SIGNAL_STRENGTH_TRAILING);
+                return;
+            }
+
+            long wait = mSignalStrengthReportedTime + SIGNAL_STRENGTH_INTERVAL_MS
+                    - SystemClock.elapsedRealtime();
+            if (mSignalStrengthReportedValid && wait > 0) {
+                System.arraycopy(response, 0, mSignalStrengthPending, 0, 7);
+                if (!mSignalStrengthHandler.hasMessages(EVENT_SIGNAL_STRENGTH_TRAILING)) {
+                    mSignalStrengthHandler.sendEmptyMessageDelayed(
+                            EVENT_SIGNAL_STRENGTH_TRAILING, wait);
+                }
+                return;
+            }
+
+            mSignalStrengthHandler.removeMessages(EVENT_SIGNAL_STRENGTH_TRAILING);
+            notifySignalStrengthLocked(response);
+        }
+    }
 
-        int[] response = new int[7];
+    private void
+    notifySignalStrengthLocked(int[] response) {
+        System.arraycopy(response, 0, mSignalStrengthReported, 0, 7);
+        mSignalStrengthReportedValid = true;
+        mSignalStrengthReportedTime = SystemClock.elapsedRealtime();
+
+        if (mSignalStrengthRegistrant != null) {
+            mSignalStrengthRegistrant.notifyRegistrant(
+                    new AsyncResult(null, newSignalStrength(response), null));
+        }
+    }
+
+    private static SignalStrength
+    newSignalStrength(int[] response) {
+        return new SignalStrength(
+            response[0], response[1], response[2], response[3], response[4],
+            response[5], response[6], false);
+    }
+
+    private static void
+    readSignalStrength(Parcel p, int[] response) {
         for (int i = 0 ; i < 7 ; i++) {
             response[i] = p.readInt();
         //    Log.d(LOG_TAG, "SignalStrength: response[" + i + "]: " + response[i]);
@@ -57,11 +154,6 @@ public class EpicRIL extends SamsungExynos3RIL implements CommandsInterface {
            response[2] = ((response[2]-96)/2)+96;
         }
         // Framework takes care of the rest for us.
-
-        SignalStrength signalStrength = new SignalStrength(
-            response[0], response[1], response[2], response[3], response[4],
-            response[5], response[6], false);
-        return signalStrength;
     }
 
     @Override
@@ -76,6 +168,7 @@ public class EpicRIL extends SamsungExynos3RIL implements CommandsInterface {
         switch(response) {
 
             case RIL_UNSOL_DATA_CALL_LIST_CHANGED: ret =  responseVoid(p); break;
+            case RIL_UNSOL_SIGNAL_STRENGTH: processSignalStrength(p); return;
 
             default:
                 // Rewind the Parcel
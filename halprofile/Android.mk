@@ -0,0 +1,59 @@
+# Copyright (C) 2014 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+ifeq ($(TARGET_DEVICE),epicmtd)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := halprofile.c
+LOCAL_SHARED_LIBRARIES := libcutils libdl
+LOCAL_MODULE := halprofile
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# for stand-in modules, see -m
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := halprofile.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -ldl -lrt
+LOCAL_MODULE := halprofile
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# halprofile -m $(HOST_OUT)/halprofile, checked by standin_check.sh
+define halprofile-standin
+include $$(CLEAR_VARS)
+
+LOCAL_SRC_FILES := hal_standin.c
+LOCAL_CFLAGS := -DSTANDIN_$(1)
+LOCAL_MODULE := halprofile_standin_$(2)
+LOCAL_MODULE_STEM := $(2).default
+LOCAL_MODULE_PATH := $$(HOST_OUT)/halprofile
+LOCAL_MODULE_TAGS := optional
+
+include $$(BUILD_HOST_SHARED_LIBRARY)
+endef
+
+$(eval $(call halprofile-standin,AUDIO,audio.primary))
+$(eval $(call halprofile-standin,CAMERA,camera))
+$(eval $(call halprofile-standin,SENSORS,sensors))
+$(eval $(call halprofile-standin,LIGHTS,lights))
+$(eval $(call halprofile-standin,POWER,power))
+
+endif
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in HAL modules for halprofile -m, built once per HAL with
+ * -DSTANDIN_<HAL>. Each implements only what halprofile calls, takes
+ * STANDIN_OPEN_MS to open and STANDIN_USE_MS for the first request, so
+ * standin_check.sh can tell the profiler measures the right spans.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hardware/hardware.h>
+
+#define STANDIN_OPEN_MS     5
+#define STANDIN_USE_MS      10
+
+#define STANDIN_MODULE(hal_id, hal_name) \
+        .tag = HARDWARE_MODULE_TAG, \
+        .version_major = 1, \
+        .version_minor = 0, \
+        .id = hal_id, \
+        .name = hal_name, \
+        .author = "The CyanogenMod Project", \
+        .methods = &standin_methods
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+/* the power HAL has no device */
+#if !defined(STANDIN_POWER)
+static int standin_close(struct hw_device_t *dev)
+{
+    free(dev);
+    return 0;
+}
+
+static struct hw_device_t *standin_alloc(const struct hw_module_t *module, size_t size)
+{
+    struct hw_device_t *dev = calloc(1, size);
+
+    if (dev == NULL)
+        return NULL;
+    dev->tag = HARDWARE_DEVICE_TAG;
+    dev->module = (struct hw_module_t *)module;
+    dev->close = standin_close;
+    sleep_ms(STANDIN_OPEN_MS);
+    return dev;
+}
+#endif
+
+/*****************************************************************************/
+
+#if defined(STANDIN_AUDIO)
+
+#include <hardware/audio.h>
+
+static int out_standby(struct audio_stream *stream)
+{
+    return 0;
+}
+
+static ssize_t out_write(struct audio_stream_out *stream, const void *buffer, size_t bytes)
+{
+    sleep_ms(STANDIN_USE_MS);
+    return bytes;
+}
+
+static int adev_init_check(const struct audio_hw_device *dev)
+{
+    return 0;
+}
+
+static int adev_open_output_stream(struct audio_hw_device *dev, audio_io_handle_t handle,
+                                   audio_devices_t devices, audio_output_flags_t flags,
+                                   struct audio_config *config,
+                                   struct audio_stream_out **stream_out)
+{
+    struct audio_stream_out *out = calloc(1, sizeof(*out));
+
+    if (out == NULL)
+        return -ENOMEM;
+    out->common.standby = out_standby;
+    out->write = out_write;
+    *stream_out = out;
+    return 0;
+}
+
+static void adev_close_output_stream(struct audio_hw_device *dev,
+                                     struct audio_stream_out *stream)
+{
+    free(stream);
+}
+
+static int standin_open(const struct hw_module_t *module, const char *name,
+                        struct hw_device_t **device)
+{
+    struct audio_hw_device *adev;
+
+    if (strcmp(name, AUDIO_HARDWARE_INTERFACE))
+        return -EINVAL;
+    adev = (struct audio_hw_device *)standin_alloc(module, sizeof(*adev));
+    if (adev == NULL)
+        return -ENOMEM;
+    adev->init_check = adev_init_check;
+    adev->open_output_stream = adev_open_output_stream;
+    adev->close_output_stream = adev_close_output_stream;
+    *device = &adev->common;
+    return 0;
+}
+
+static struct hw_module_methods_t standin_methods = {
+    .open = standin_open,
+};
+
+struct audio_module HAL_MODULE_INFO_SYM = {
+    .common = {
+        STANDIN_MODULE(AUDIO_HARDWARE_MODULE_ID, "halprofile audio stand-in"),
+    },
+};
+
+#elif defined(STANDIN_CAMERA)
+
+#include <hardware/camera.h>
+
+static void cam_set_callbacks(struct camera_device *dev, camera_notify_callback notify_cb,
+                              camera_data_callback data_cb,
+                              camera_data_timestamp_callback data_cb_timestamp,
+                              camera_request_memory get_memory, void *user)
+{
+}
+
+static int cam_start_preview(struct camera_device *dev)
+{
+    sleep_ms(STANDIN_USE_MS);
+    return 0;
+}
+
+static void cam_stop_preview(struct camera_device *dev)
+{
+}
+
+static void cam_release(struct camera_device *dev)
+{
+}
+
+static camera_device_ops_t cam_ops = {
+    .set_callbacks = cam_set_callbacks,
+    .start_preview = cam_start_preview,
+    .stop_preview = cam_stop_preview,
+    .release = cam_release,
+};
+
+static int get_number_of_cameras(void)
+{
+    return 1;
+}
+
+static int standin_open(const struct hw_module_t *module, const char *name,
+                        struct hw_device_t **device)
+{
+    camera_device_t *cam;
+
+    if (strcmp(name, "0"))
+        return -EINVAL;
+    cam = (camera_device_t *)standin_alloc(module, sizeof(*cam));
+    if (cam == NULL)
+        return -ENOMEM;
+    cam->ops = &cam_ops;
+    *device = &cam->common;
+    return 0;
+}
+
+static struct hw_module_methods_t standin_methods = {
+    .open = standin_open,
+};
+
+camera_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        STANDIN_MODULE(CAMERA_HARDWARE_MODULE_ID, "halprofile camera stand-in"),
+    },
+    .get_number_of_cameras = get_number_of_cameras,
+};
+
+#elif defined(STANDIN_SENSORS)
+
+#include <hardware/sensors.h>
+
+static const struct sensor_t sensor_list[] = {
+    { "Stand-in accelerometer", "halprofile", 1, 0, SENSOR_TYPE_ACCELEROMETER,
+      19.6f, 0.01f, 0.2f, 10000, 0, 0, { } },
+};
+
+static int active;
+
+static int sensors_activate(struct sensors_poll_device_t *dev, int handle, int enabled)
+{
+    if (handle != 0)
+        return -EINVAL;
+    active = enabled;
+    return 0;
+}
+
+static int sensors_set_delay(struct sensors_poll_device_t *dev, int handle, int64_t ns)
+{
+    return 0;
+}
+
+/* the first event a request's time after the activation, then none */
+static int sensors_poll(struct sensors_poll_device_t *dev, sensors_event_t *data, int count)
+{
+    if (!active)
+        return 0;
+    sleep_ms(STANDIN_USE_MS);
+    memset(data, 0, sizeof(*data));
+    data->version = sizeof(*data);
+    data->type = SENSOR_TYPE_ACCELEROMETER;
+    data->acceleration.z = 9.81f;
+    active = 0;
+    return 1;
+}
+
+static int get_sensors_list(struct sensors_module_t *module, struct sensor_t const **list)
+{
+    *list = sensor_list;
+    return sizeof(sensor_list) / sizeof(sensor_list[0]);
+}
+
+static int standin_open(const struct hw_module_t *module, const char *name,
+                        struct hw_device_t **device)
+{
+    struct sensors_poll_device_t *dev;
+
+    if (strcmp(name, SENSORS_HARDWARE_POLL))
+        return -EINVAL;
+    dev = (struct sensors_poll_device_t *)standin_alloc(module, sizeof(*dev));
+    if (dev == NULL)
+        return -ENOMEM;
+    dev->activate = sensors_activate;
+    dev->setDelay = sensors_set_delay;
+    dev->poll = sensors_poll;
+    *device = &dev->common;
+    return 0;
+}
+
+static struct hw_module_methods_t standin_methods = {
+    .open = standin_open,
+};
+
+struct sensors_module_t HAL_MODULE_INFO_SYM = {
+    .common = {
+        STANDIN_MODULE(SENSORS_HARDWARE_MODULE_ID, "halprofile sensors stand-in"),
+    },
+    .get_sensors_list = get_sensors_list,
+};
+
+#elif defined(STANDIN_LIGHTS)
+
+#include <hardware/lights.h>
+
+static int set_light(struct light_device_t *dev, struct light_state_t const *state)
+{
+    sleep_ms(STANDIN_USE_MS);
+    return 0;
+}
+
+static int standin_open(const struct hw_module_t *module, const char *name,
+                        struct hw_device_t **device)
+{
+    struct light_device_t *dev;
+
+    if (strcmp(name, LIGHT_ID_BUTTONS))
+        return -EINVAL;
+    dev = (struct light_device_t *)standin_alloc(module, sizeof(*dev));
+    if (dev == NULL)
+        return -ENOMEM;
+    dev->set_light = set_light;
+    *device = &dev->common;
+    return 0;
+}
+
+static struct hw_module_methods_t standin_methods = {
+    .open = standin_open,
+};
+
+struct hw_module_t HAL_MODULE_INFO_SYM = {
+    STANDIN_MODULE(LIGHTS_HARDWARE_MODULE_ID, "halprofile lights stand-in"),
+};
+
+#elif defined(STANDIN_POWER)
+
+#include <hardware/power.h>
+
+/* init() is the power HAL's open */
+static void power_init(struct power_module *module)
+{
+    sleep_ms(STANDIN_OPEN_MS);
+}
+
+static void power_hint(struct power_module *module, power_hint_t hint, void *data)
+{
+    sleep_ms(STANDIN_USE_MS);
+}
+
+static struct hw_module_methods_t standin_methods = {
+    .open = NULL,
+};
+
+struct power_module HAL_MODULE_INFO_SYM = {
+    .common = {
+        STANDIN_MODULE(POWER_HARDWARE_MODULE_ID, "halprofile power stand-in"),
+    },
+    .init = power_init,
+    .powerHint = power_hint,
+};
+
+#else
+#error "build with one of -DSTANDIN_AUDIO, _CAMERA, _SENSORS, _LIGHTS or _POWER"
+#endif
@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * halprofile: cold start cost of the HALs of this device.
+ *
+ * Every HAL is loaded in a fresh child process, which measures dlopen(),
+ * the device open and a first request typical for the HAL, then closes it:
+ *
+ *   audio    open_output_stream() and a 20ms write
+ *   camera   start_preview() / stop_preview() on camera 0
+ *   sensors  activate the first sensor and wait for its first event
+ *   lights   switch the button lights off
+ *   power    an interaction hint
+ *
+ * The report has one line per HAL with the median of all runs, in ms, and
+ * the largest RSS the child reached. The HALs share the hardware with the
+ * running system: stop media before profiling audio and camera. In-process
+ * cold start numbers of the real HAL instances are logged by libhaltrace
+ * ("coldstart" lines) on every boot and restart.
+ *
+ * -m points at a directory of stand-in modules instead of /system/lib/hw,
+ * to run the profiler off the device: the host build comes with some
+ * (hal_standin.c), and standin_check.sh checks the report against them.
+ *
+ * Usage: halprofile [-n runs] [-H hal,...] [-m module_dir] [-o report]
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cutils/properties.h>
+#include <hardware/audio.h>
+#include <hardware/camera.h>
+#include <hardware/hardware.h>
+#include <hardware/lights.h>
+#include <hardware/power.h>
+#include <hardware/sensors.h>
+
+#define MAX_RUNS        32
+#define PROBE_TIMEOUT   10      /* seconds */
+
+enum {
+    T_DLOPEN,
+    T_OPEN,
+    T_USE,
+    T_CLOSE,
+    T_CNT
+};
+
+struct result {
+    int status;                 /* 0 or -errno, from the child */
+    double ms[T_CNT];
+    long maxrss_kb;
+};
+
+struct hal {
+    const char *name;
+    const char *module;         /* file name stem, id[.class] */
+    int (*probe)(const struct hw_module_t *module, double *ms);
+};
+
+static const char *variant_keys[] = {
+    "ro.hardware",
+    "ro.product.board",
+    "ro.board.platform",
+    "ro.arch",
+};
+
+static const char *module_dirs[] = {
+    "/vendor/lib/hw",
+    "/system/lib/hw",
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*****************************************************************************/
+
+static int probe_audio(const struct hw_module_t *module, double *ms)
+{
+    struct audio_hw_device *dev;
+    struct audio_stream_out *out;
+    struct audio_config config;
+    char silence[44100 / 50 * 4];
+    double t;
+    int err;
+
+    t = now_ms();
+    err = module->methods->open(module, AUDIO_HARDWARE_INTERFACE, (struct hw_device_t **)&dev);
+    if (err)
+        return err;
+    err = dev->init_check(dev);
+    ms[T_OPEN] = now_ms() - t;
+    if (err)
+        goto close;
+
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = 44100;
+    config.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    memset(silence, 0, sizeof(silence));
+
+    t = now_ms();
+    err = dev->open_output_stream(dev, 0, AUDIO_DEVICE_OUT_SPEAKER,
+                                  AUDIO_OUTPUT_FLAG_PRIMARY, &config, &out);
+    if (err)
+        goto close;
+    if (out->write(out, silence, sizeof(silence)) < 0)
+        err = -EIO;
+    ms[T_USE] = now_ms() - t;
+    out->common.standby(&out->common);
+    dev->close_output_stream(dev, out);
+
+close:
+    t = now_ms();
+    audio_hw_device_close(dev);
+    ms[T_CLOSE] = now_ms() - t;
+    return err;
+}
+
+static void camera_memory_release(struct camera_memory *mem)
+{
+    munmap(mem->data, mem->size);
+    free(mem);
+}
+
+static camera_memory_t *camera_get_memory(int fd, size_t buf_size, unsigned int num_bufs,
+                                          void *user)
+{
+    camera_memory_t *mem = calloc(1, sizeof(*mem));
+
+    if (mem == NULL)
+        return NULL;
+    mem->size = buf_size * num_bufs;
+    mem->data = mmap(NULL, mem->size, PROT_READ | PROT_WRITE,
+                     fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    if (mem->data == MAP_FAILED) {
+        free(mem);
+        return NULL;
+    }
+    mem->release = camera_memory_release;
+    return mem;
+}
+
+static void camera_notify(int32_t msg_type, int32_t ext1, int32_t ext2, void *user)
+{
+}
+
+static void camera_data(int32_t msg_type, const camera_memory_t *data, unsigned int index,
+                        camera_frame_metadata_t *metadata, void *user)
+{
+}
+
+static void camera_data_timestamp(int64_t timestamp, int32_t msg_type,
+                                  const camera_memory_t *data, unsigned int index, void *user)
+{
+}
+
+static int probe_camera(const struct hw_module_t *module, double *ms)
+{
+    const camera_module_t *cam = (const camera_module_t *)module;
+    camera_device_t *dev;
+    double t;
+    int err;
+
+    t = now_ms();
+    if (cam->get_number_of_cameras() < 1)
+        return -ENODEV;
+    err = module->methods->open(module, "0", (struct hw_device_t **)&dev);
+    if (err)
+        return err;
+    dev->ops->set_callbacks(dev, camera_notify, camera_data, camera_data_timestamp,
+                            camera_get_memory, NULL);
+    ms[T_OPEN] = now_ms() - t;
+
+    t = now_ms();
+    err = dev->ops->start_preview(dev);
+    if (!err)
+        dev->ops->stop_preview(dev);
+    ms[T_USE] = now_ms() - t;
+
+    t = now_ms();
+    dev->ops->release(dev);
+    dev->common.close(&dev->common);
+    ms[T_CLOSE] = now_ms() - t;
+    return err;
+}
+
+static int probe_sensors(const struct hw_module_t *module, double *ms)
+{
+    const struct sensors_module_t *sm = (const struct sensors_module_t *)module;
+    struct sensors_poll_device_t *dev;
+    struct sensor_t const *list;
+    sensors_event_t events[16];
+    double t;
+    int err, count, n;
+
+    t = now_ms();
+    count = sm->get_sensors_list((struct sensors_module_t *)sm, &list);
+    err = module->methods->open(module, SENSORS_HARDWARE_POLL, (struct hw_device_t **)&dev);
+    if (err)
+        return err;
+    ms[T_OPEN] = now_ms() - t;
+    if (count < 1) {
+        err = -ENODEV;
+        goto close;
+    }
+
+    t = now_ms();
+    err = dev->activate(dev, list[0].handle, 1);
+    if (!err) {
+        /* the alarm covers a sensor that never reports */
+        do {
+            n = dev->poll(dev, events, 16);
+        } while (n == 0);
+        if (n < 0)
+            err = n;
+        dev->activate(dev, list[0].handle, 0);
+    }
+    ms[T_USE] = now_ms() - t;
+
+close:
+    t = now_ms();
+    dev->common.close(&dev->common);
+    ms[T_CLOSE] = now_ms() - t;
+    return err;
+}
+
+static int probe_lights(const struct hw_module_t *module, double *ms)
+{
+    struct light_device_t *dev;
+    struct light_state_t state;
+    double t;
+    int err;
+
+    t = now_ms();
+    err = module->methods->open(module, LIGHT_ID_BUTTONS, (struct hw_device_t **)&dev);
+    if (err)
+        return err;
+    ms[T_OPEN] = now_ms() - t;
+
+    memset(&state, 0, sizeof(state));
+    t = now_ms();
+    err = dev->set_light(dev, &state);
+    ms[T_USE] = now_ms() - t;
+
+    t = now_ms();
+    dev->common.close(&dev->common);
+    ms[T_CLOSE] = now_ms() - t;
+    return err;
+}
+
+static int probe_power(const struct hw_module_t *module, double *ms)
+{
+    struct power_module *pm = (struct power_module *)module;
+    double t;
+
+    t = now_ms();
+    if (pm->init)
+        pm->init(pm);
+    ms[T_OPEN] = now_ms() - t;
+
+    t = now_ms();
+    if (pm->powerHint)
+        pm->powerHint(pm, POWER_HINT_INTERACTION, NULL);
+    ms[T_USE] = now_ms() - t;
+    return 0;
+}
+
+static const struct hal hals[] = {
+    { "audio",      "audio.primary",    probe_audio },
+    { "camera",     "camera",           probe_camera },
+    { "sensors",    "sensors",          probe_sensors },
+    { "lights",     "lights",           probe_lights },
+    { "power",      "power",            probe_power },
+};
+
+/*****************************************************************************/
+
+/* The same lookup as hw_get_module(), except for -m */
+static int find_module(const char *stem, const char *dir, char *path, size_t len)
+{
+    char variant[PROPERTY_VALUE_MAX];
+    size_t i, d, ndirs = dir ? 1 : sizeof(module_dirs) / sizeof(module_dirs[0]);
+
+    for (i = 0; i <= sizeof(variant_keys) / sizeof(variant_keys[0]); i++) {
+        if (i < sizeof(variant_keys) / sizeof(variant_keys[0])) {
+            if (property_get(variant_keys[i], variant, NULL) <= 0)
+                continue;
+        } else {
+            strcpy(variant, "default");
+        }
+        for (d = 0; d < ndirs; d++) {
+            snprintf(path, len, "%s/%s.%s.so", dir ? dir : module_dirs[d], stem, variant);
+            if (access(path, R_OK) == 0)
+                return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static int run_child(const struct hal *hal, const char *path, double *ms)
+{
+    struct hw_module_t *module;
+    void *handle;
+    double t;
+
+    alarm(PROBE_TIMEOUT);
+
+    t = now_ms();
+    handle = dlopen(path, RTLD_NOW);
+    if (handle == NULL) {
+        fprintf(stderr, "%s: %s\n", hal->name, dlerror());
+        return -ENOEXEC;
+    }
+    module = dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR);
+    ms[T_DLOPEN] = now_ms() - t;
+    if (module == NULL)
+        return -ENOEXEC;
+
+    return hal->probe(module, ms);
+}
+
+static int run_once(const struct hal *hal, const char *path, struct result *res)
+{
+    struct rusage usage;
+    int fds[2], status;
+    pid_t pid;
+
+    memset(res, 0, sizeof(*res));
+    if (pipe(fds) < 0)
+        return -errno;
+
+    pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -errno;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        res->status = run_child(hal, path, res->ms);
+        write(fds[1], res, sizeof(*res));
+        _exit(0);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], res, sizeof(*res)) != sizeof(*res))
+        res->status = -EPIPE;
+    close(fds[0]);
+
+    if (wait4(pid, &status, 0, &usage) == pid) {
+        res->maxrss_kb = usage.ru_maxrss;
+        if (WIFSIGNALED(status))
+            res->status = WTERMSIG(status) == SIGALRM ? -ETIMEDOUT : -EINTR;
+    }
+    return res->status;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(*v), compare_double);
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: halprofile [-n runs] [-H hal,...] [-m module_dir] [-o report]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *only = NULL, *dir = NULL, *out_path = NULL;
+    int runs = 3;
+    FILE *out = stdout;
+    size_t h;
+    int c, r, t;
+
+    while ((c = getopt(argc, argv, "n:H:m:o:")) != -1) {
+        switch (c) {
+        case 'n': runs = atoi(optarg); break;
+        case 'H': only = optarg; break;
+        case 'm': dir = optarg; break;
+        case 'o': out_path = optarg; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (runs < 1 || runs > MAX_RUNS) {
+        usage();
+        return 1;
+    }
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    fprintf(out, "# halprofile: median of %d runs, ms\n", runs);
+    fprintf(out, "%-8s %8s %8s %8s %8s %8s %9s  %s\n", "hal", "dlopen", "open", "use",
+            "close", "total", "maxrss_kb", "status");
+
+    for (h = 0; h < sizeof(hals) / sizeof(hals[0]); h++) {
+        const struct hal *hal = &hals[h];
+        char path[PATH_MAX];
+        double v[T_CNT][MAX_RUNS], m[T_CNT], total = 0;
+        long maxrss = 0;
+        int ok = 0, err = 0;
+
+        if (only != NULL) {
+            const char *p = strstr(only, hal->name);
+            size_t len = strlen(hal->name);
+            if (p == NULL || (p != only && p[-1] != ',') || (p[len] != '\0' && p[len] != ','))
+                continue;
+        }
+        if (find_module(hal->module, dir, path, sizeof(path))) {
+            fprintf(out, "%-8s %8s %8s %8s %8s %8s %9s  no module\n", hal->name,
+                    "-", "-", "-", "-", "-", "-");
+            continue;
+        }
+
+        for (r = 0; r < runs; r++) {
+            struct result res;
+            if (run_once(hal, path, &res)) {
+                err = res.status;
+                continue;
+            }
+            for (t = 0; t < T_CNT; t++)
+                v[t][ok] = res.ms[t];
+            if (res.maxrss_kb > maxrss)
+                maxrss = res.maxrss_kb;
+            ok++;
+        }
+
+        if (ok == 0) {
+            fprintf(out, "%-8s %8s %8s %8s %8s %8s %9s  %s\n", hal->name,
+                    "-", "-", "-", "-", "-", "-", strerror(-err));
+            continue;
+        }
+        for (t = 0; t < T_CNT; t++) {
+            m[t] = median(v[t], ok);
+            total += m[t];
+        }
+        fprintf(out, "%-8s %8.2f %8.2f %8.2f %8.2f %8.2f %9ld  ", hal->name,
+                m[T_DLOPEN], m[T_OPEN], m[T_USE], m[T_CLOSE], total, maxrss);
+        if (ok == runs)
+            fprintf(out, "ok\n");
+        else
+            fprintf(out, "%d/%d failed: %s\n", runs - ok, runs, strerror(-err));
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+
+# Copyright (C) 2014 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs the host halprofile against the stand-in modules of hal_standin.c and
+# fails unless every HAL is profiled and its open and first request come out
+# at the stand-in's STANDIN_OPEN_MS and STANDIN_USE_MS.
+#
+# Usage: standin_check.sh [halprofile] [module_dir]
+
+HALPROFILE=${1:-$ANDROID_HOST_OUT/bin/halprofile}
+MODULES=${2:-$ANDROID_HOST_OUT/halprofile}
+OPEN_MS=5
+USE_MS=10
+# scheduling noise of a loaded host
+SLACK_MS=20
+
+REPORT=$("$HALPROFILE" -n 3 -m "$MODULES") || exit 1
+echo "$REPORT"
+
+echo "$REPORT" | awk -v open_ms=$OPEN_MS -v use_ms=$USE_MS -v slack=$SLACK_MS '
+    /^#/ || $1 == "hal" { next }
+    {
+        seen++
+        if ($NF != "ok") {
+            print $1 ": not profiled"
+            failed++
+        } else if ($3 < open_ms || $3 > open_ms + slack) {
+            print $1 ": open " $3 " ms, expected " open_ms
+            failed++
+        } else if ($4 < use_ms || $4 > use_ms + slack) {
+            print $1 ": use " $4 " ms, expected " use_ms
+            failed++
+        }
+    }
+    END {
+        if (seen != 5) {
+            print seen + 0 " HALs in the report, expected 5"
+            failed++
+        }
+        exit failed ? 1 : 0
+    }'
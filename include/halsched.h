@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HALSCHED_H
+#define ANDROID_HALSCHED_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Scheduling policy for HAL worker threads
+ *
+ * A HAL thread attaches itself to a role; libhalsched applies the role's
+ * scheduling class and priority and accounts the thread's CPU time. On a
+ * single core a thread at a real-time class can starve everything else, so
+ * fifo roles carry a budget: the share of each accounting window the thread
+ * may use while it runs SCHED_FIFO. A monitor thread demotes a thread that
+ * goes over it to the scheduling it had before it attached (SCHED_OTHER at
+ * the fallback nice if that was SCHED_FIFO too) and restores the role after
+ * RESTORE_WINDOWS windows within budget. The monitor only wakes up while
+ * some thread runs SCHED_FIFO or is demoted.
+ *
+ * The policy is read from /system/etc/halsched.conf when a process attaches
+ * its first thread, one line per role:
+ *
+ *   <role> <fifo|other|idle> <priority> [budget %] [fallback nice]
+ *
+ * priority is the SCHED_FIFO priority or the nice value. A fifo role falls
+ * back to SCHED_OTHER at the fallback nice where the process may not use
+ * SCHED_FIFO; a thread on its fallback nice is not held to the budget.
+ * "window <ms>" and "monitor <fifo priority>" set up the monitor.
+ * persist.halsched.<role> overrides a role with the rest of such a line, and
+ * persist.halsched.enable=0 leaves priorities alone but keeps accounting.
+ */
+
+enum halsched_role {
+    HALSCHED_AUDIO_IO,          /* stream read and write */
+    HALSCHED_CAMERA_CAPTURE,    /* preview and recording frames */
+    HALSCHED_CAMERA_CONTROL,    /* autofocus */
+    HALSCHED_ENCODE,            /* JPEG encode and format conversion */
+    HALSCHED_SENSORS,           /* sensor polling and report channels */
+    HALSCHED_DEBUG,             /* trace and dump writers */
+    HALSCHED_ROLE_CNT
+};
+
+/*
+ * Apply a role to a thread the HAL created. Returns 0 or -errno; the thread
+ * is accounted even when the policy could not be applied.
+ */
+int halsched_attach(int role);
+/*
+ * Account the calling thread under a role without touching its scheduling,
+ * for threads the HAL does not own such as AudioFlinger's playback threads.
+ * Cheap when the thread is already accounted, so it can be called on every
+ * request.
+ */
+int halsched_account(int role);
+/* Stop accounting the calling thread, its scheduling is left as it is */
+void halsched_detach(void);
+
+/* Per thread CPU use, run queue latency and budget overruns */
+void halsched_dump(int fd);
+
+__END_DECLS
+
+#endif  // ANDROID_HALSCHED_H
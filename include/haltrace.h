@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HALTRACE_H
+#define ANDROID_HALTRACE_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Lightweight cross-HAL tracing
+ *
+ * Every HAL of this device records into libhaltrace, which keeps a ring of
+ * fixed-size binary records per thread. Recording never takes a lock and
+ * costs a single test while tracing is off.
+ *
+ *   setprop debug.haltrace.enable 1     start recording in every process
+ *   setprop debug.haltrace.export 1     each process writes its rings to
+ *                                       /data/misc/haltrace/<pid>-<n>.htrc
+ *                                       (bump the value to export again)
+ *
+ * haltrace2json on the host merges the files into Chrome trace JSON. All
+ * timestamps are CLOCK_MONOTONIC, so events line up across processes.
+ */
+
+/* Events are registered here, at build time. Append only: ids are stored in
+ * the trace files, names are too so old traces still decode. */
+#define HALTRACE_EVENTS(X) \
+    X(CAMERA_PREVIEW_FRAME) \
+    X(CAMERA_PREVIEW_CALLBACK) \
+    X(CAMERA_TAKE_PICTURE) \
+    X(AUDIO_OUT_WRITE) \
+    X(AUDIO_OUT_STANDBY) \
+    X(AUDIO_IN_READ) \
+    X(AUDIO_ROUTE) \
+    X(AUDIO_MODE) \
+    X(SENSORS_POLL) \
+    X(SENSORS_ACTIVATE) \
+    X(POWER_HINT) \
+    X(POWER_INTERACTIVE) \
+    X(LIGHTS_SET) \
+    X(SCHED_OVERRUN) \
+    X(CAMERA_PREVIEW_RESUME) \
+    X(CAMERA_RECORD_STARVED)
+
+#define HALTRACE_ENUM(name) HALTRACE_##name,
+enum haltrace_event {
+    HALTRACE_EVENTS(HALTRACE_ENUM)
+    HALTRACE_EVENT_CNT
+};
+#undef HALTRACE_ENUM
+
+enum haltrace_type {
+    HALTRACE_TYPE_BEGIN,
+    HALTRACE_TYPE_END,
+    HALTRACE_TYPE_INSTANT,
+    HALTRACE_TYPE_COUNTER,
+};
+
+struct haltrace_record {
+    uint64_t timestamp;     /* ns, CLOCK_MONOTONIC */
+    uint16_t event;
+    uint8_t type;
+    uint8_t reserved;
+    int32_t arg0;
+    int32_t arg1;
+    uint32_t reserved2;
+};
+
+/*
+ * Trace file: a header, event_count names of HALTRACE_NAME_LEN bytes, then
+ * per thread a haltrace_thread_header followed by its records, oldest first.
+ */
+#define HALTRACE_MAGIC          0x43525448  /* "HTRC" */
+#define HALTRACE_VERSION        1
+#define HALTRACE_NAME_LEN       32
+
+struct haltrace_file_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t event_count;
+    uint32_t thread_count;
+    uint32_t record_size;
+    char process[HALTRACE_NAME_LEN];
+};
+
+struct haltrace_thread_header {
+    int32_t tid;
+    uint32_t record_count;
+    uint32_t lost;          /* records overwritten before the export */
+    char name[HALTRACE_NAME_LEN];
+};
+
+extern volatile int32_t haltrace_enabled;
+
+void haltrace_record(int event, int type, int32_t arg0, int32_t arg1);
+/* Write this process's rings to path, returns 0 or -errno. */
+int haltrace_export(const char *path);
+
+#define HALTRACE(event, type, arg0, arg1) \
+    do { \
+        if (__builtin_expect(haltrace_enabled, 0)) \
+            haltrace_record(HALTRACE_##event, type, arg0, arg1); \
+    } while (0)
+
+#define HALTRACE_BEGIN(event, arg0, arg1)   HALTRACE(event, HALTRACE_TYPE_BEGIN, arg0, arg1)
+#define HALTRACE_END(event, arg0, arg1)     HALTRACE(event, HALTRACE_TYPE_END, arg0, arg1)
+#define HALTRACE_INSTANT(event, arg0, arg1) HALTRACE(event, HALTRACE_TYPE_INSTANT, arg0, arg1)
+#define HALTRACE_COUNTER(event, value)      HALTRACE(event, HALTRACE_TYPE_COUNTER, value, 0)
+
+/*
+ * Cold start milestones, recorded whether tracing is on or not. Only the
+ * first occurrence of each counts, so every process start (boot, a
+ * mediaserver or system_server restart) logs one line per HAL once the HAL
+ * served its first request:
+ *   coldstart camera: loaded +1523.4 ms, open 85.2 ms, first use 40.1 ms
+ * where loaded is relative to the start of the process.
+ */
+enum haltrace_hal {
+    HALTRACE_HAL_AUDIO,
+    HALTRACE_HAL_CAMERA,
+    HALTRACE_HAL_SENSORS,
+    HALTRACE_HAL_LIGHTS,
+    HALTRACE_HAL_POWER,
+    HALTRACE_HAL_CNT
+};
+
+enum haltrace_coldstart {
+    HALTRACE_COLDSTART_LOADED,      /* the module's constructors ran */
+    HALTRACE_COLDSTART_OPEN_BEGIN,
+    HALTRACE_COLDSTART_OPEN_END,
+    HALTRACE_COLDSTART_USE_BEGIN,   /* first request served */
+    HALTRACE_COLDSTART_USE_END,
+    HALTRACE_COLDSTART_CNT
+};
+
+void haltrace_coldstart(int hal, int milestone);
+
+/* Place once in a module's sources to mark when it was loaded */
+#define HALTRACE_COLDSTART_MODULE(hal) \
+    static void __attribute__((constructor)) haltrace_coldstart_loaded(void) \
+    { \
+        haltrace_coldstart(HALTRACE_HAL_##hal, HALTRACE_COLDSTART_LOADED); \
+    }
+
+#define HALTRACE_COLDSTART(hal, milestone) \
+    haltrace_coldstart(HALTRACE_HAL_##hal, HALTRACE_COLDSTART_##milestone)
+
+__END_DECLS
+
+#ifdef __cplusplus
+/* Begin/end pair around a C++ scope, for functions with many returns */
+class HalTraceScope {
+    int mEvent;
+    int32_t mArg0;
+public:
+    HalTraceScope(int event, int32_t arg0) : mEvent(event), mArg0(arg0) {
+        if (__builtin_expect(haltrace_enabled, 0))
+            haltrace_record(mEvent, HALTRACE_TYPE_BEGIN, mArg0, 0);
+    }
+    ~HalTraceScope() {
+        if (__builtin_expect(haltrace_enabled, 0))
+            haltrace_record(mEvent, HALTRACE_TYPE_END, mArg0, 0);
+    }
+};
+
+#define HALTRACE_SCOPE(event, arg0) HalTraceScope __haltrace_scope(HALTRACE_##event, arg0)
+
+/* Marks the first call of a C++ function as the HAL's first use */
+class HalColdStartUse {
+    int mHal;
+public:
+    HalColdStartUse(int hal) : mHal(hal) {
+        haltrace_coldstart(mHal, HALTRACE_COLDSTART_USE_BEGIN);
+    }
+    ~HalColdStartUse() {
+        haltrace_coldstart(mHal, HALTRACE_COLDSTART_USE_END);
+    }
+};
+
+#define HALTRACE_COLDSTART_USE(hal) HalColdStartUse __haltrace_use(HALTRACE_HAL_##hal)
+#endif
+
+#endif  // ANDROID_HALTRACE_H
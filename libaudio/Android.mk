@@ -4,23 +4,29 @@ ifeq ($(TARGET_DEVICE),epicmtd)
 
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
-	AudioHardware.cpp
+	AudioHardware.cpp \
+	AudioTap.cpp \
+	SecVoiceProcessing.cpp
 
 LOCAL_MODULE := audio.primary.s5pc110
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_STATIC_LIBRARIES:= libmedia_helper
 LOCAL_SHARED_LIBRARIES:= \
         liblog \
+	libcutils \
 	libutils \
 	libhardware_legacy \
 	libtinyalsa \
-	libaudioutils
+	libaudioutils \
+	libhaltrace \
+	libhalsched
 
 LOCAL_WHOLE_STATIC_LIBRARIES := libaudiohw_legacy
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_SHARED_LIBRARIES += libdl
 LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../include \
 	external/tinyalsa/include \
 	$(call include-path-for, audio-effects) \
 	$(call include-path-for, audio-utils)
@@ -39,4 +45,28 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	SecPreProcessing.cpp \
+	SecVoiceProcessing.cpp
+LOCAL_SHARED_LIBRARIES := liblog libutils
+LOCAL_MODULE := libsecpreprocessing
+LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/soundfx
+LOCAL_MODULE_TAGS := optional
+LOCAL_C_INCLUDES += \
+	$(call include-path-for, audio-effects)
+
+include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	voiceproc_bench.cpp \
+	SecVoiceProcessing.cpp
+LOCAL_MODULE := voiceproc_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
 endif
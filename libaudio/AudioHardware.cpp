@@ -21,6 +21,7 @@
 
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <cutils/properties.h>
 
 #include <stdio.h>
 #include <unistd.h>
@@ -32,12 +33,17 @@
 #include <fcntl.h>
 
 #include "AudioHardware.h"
+#include <halsched.h>
+#include <haltrace.h>
 #include <audio_effects/effect_aec.h>
+#include <audio_effects/effect_agc.h>
+#include <audio_effects/effect_ns.h>
 
 extern "C" {
 #include <tinyalsa/asoundlib.h>
 }
 
+HALTRACE_COLDSTART_MODULE(AUDIO)
 
 namespace android_audio_legacy {
 
@@ -50,6 +56,12 @@ const uint32_t AudioHardware::inputConfigTable[][AudioHardware::INPUT_CONFIG_CNT
         {44100, 1}
 };
 
+const uint32_t AudioHardware::inputProfileTable[][AudioHardware::INPUT_PROFILE_CFG_CNT] = {
+        {AUDIO_HW_IN_PERIOD_SZ, AUDIO_HW_IN_PERIOD_CNT},                // INPUT_PROFILE_DEFAULT
+        {AUDIO_HW_IN_PERIOD_SZ_VOIP, AUDIO_HW_IN_PERIOD_CNT_VOIP},      // INPUT_PROFILE_VOIP
+        {AUDIO_HW_IN_PERIOD_SZ_RECORD, AUDIO_HW_IN_PERIOD_CNT_RECORD}   // INPUT_PROFILE_RECORD
+};
+
 //  trace driver operations for dump
 //
 #define DRIVER_TRACE
@@ -86,6 +98,7 @@ AudioHardware::AudioHardware() :
     mPcm(NULL),
     mMixer(NULL),
     mPcmOpenCnt(0),
+    mPcmOutRate(AUDIO_HW_OUT_SAMPLERATE),
     mMixerOpenCnt(0),
     mInCallAudioMode(false),
     mVoiceVol(1.0f),
@@ -98,7 +111,12 @@ AudioHardware::AudioHardware() :
     mEchoReference(NULL),
     mDriverOp(DRV_NONE)
 {
+    char value[PROPERTY_VALUE_MAX];
+
     loadRILD();
+    if (property_get("audio.tap", value, NULL) > 0) {
+        mTaps.setEnabled(value);
+    }
     mInit = true;
 }
 
@@ -328,6 +346,7 @@ void AudioHardware::closeInputStream(AudioStreamIn* in) {
 
 status_t AudioHardware::setMode(int mode)
 {
+    HALTRACE_SCOPE(AUDIO_MODE, mode);
     sp<AudioStreamOutALSA> spOut;
     sp<AudioStreamInALSA> spIn;
     status_t status;
@@ -397,7 +416,9 @@ status_t AudioHardware::setMode(int mode)
             }
 
             ALOGV("setMode() openPcmOut_l()");
-            openPcmOut_l();
+            // keep the rate the output stream was configured for so that
+            // tones played during the call are not pitch shifted
+            openPcmOut_l(spOut != 0 ? spOut->sampleRate() : AUDIO_HW_OUT_SAMPLERATE);
             openMixer_l();
             setInputSource_l(AUDIO_SOURCE_DEFAULT);
             setVoiceVolume_l(mVoiceVol);
@@ -488,6 +509,7 @@ status_t AudioHardware::setParameters(const String8& keyValuePairs)
     const char TTY_MODE_VALUE_VCO[] = "tty_vco";
     const char TTY_MODE_VALUE_HCO[] = "tty_hco";
     const char TTY_MODE_VALUE_FULL[] = "tty_full";
+    const char AUDIO_TAP_KEY[] = "audio_tap";
 
     key = String8(BT_NREC_KEY);
     if (param.get(key, value) == NO_ERROR) {
@@ -526,6 +548,15 @@ status_t AudioHardware::setParameters(const String8& keyValuePairs)
         param.remove(String8(TTY_MODE_KEY));
      }
 
+    key = String8(AUDIO_TAP_KEY);
+    if (param.get(key, value) == NO_ERROR) {
+        status_t status = mTaps.setEnabled(value.string());
+        param.remove(key);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+
     return NO_ERROR;
 }
 
@@ -536,6 +567,12 @@ String8 AudioHardware::getParameters(const String8& keys)
 
     ALOGV("getParameters() %s", keys.string());
 
+    String8 key = String8("audio_tap");
+    String8 value;
+    if (request.get(key, value) == NO_ERROR) {
+        reply.add(key, mTaps.getEnabled());
+    }
+
     return reply.toString();
 }
 
@@ -555,7 +592,8 @@ size_t AudioHardware::getInputBufferSize(uint32_t sampleRate, int format, int ch
         return 0;
     }
 
-    return AudioStreamInALSA::getBufferSize(sampleRate, channelCount);
+    return AudioStreamInALSA::getBufferSize(sampleRate, channelCount,
+                                            getInputProfile(sampleRate, channelCount));
 }
 
 status_t AudioHardware::setVoiceVolume(float volume)
@@ -682,6 +720,7 @@ status_t AudioHardware::dump(int fd, const Vector<String16>& args)
     result.append(buffer);
     snprintf(buffer, SIZE, "\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
+    result.append(mTaps.dump());
 
     snprintf(buffer, SIZE, "\n\tmOutput %p dump:\n", mOutput.get());
     result.append(buffer);
@@ -698,6 +737,9 @@ status_t AudioHardware::dump(int fd, const Vector<String16>& args)
         mInputs[i]->dump(fd, args);
     }
 
+    write(fd, "\n", 1);
+    halsched_dump(fd);
+
     return NO_ERROR;
 }
 
@@ -767,9 +809,12 @@ status_t AudioHardware::setIncallPath_l(uint32_t device)
     return NO_ERROR;
 }
 
-struct pcm *AudioHardware::openPcmOut_l()
+// The pcm is shared with the in call path: if it is already open, it is
+// returned at the rate it was opened with and the caller must check
+// pcmOutRate().
+struct pcm *AudioHardware::openPcmOut_l(uint32_t sampleRate)
 {
-    ALOGD("openPcmOut_l() mPcmOpenCnt: %d", mPcmOpenCnt);
+    ALOGD("openPcmOut_l() mPcmOpenCnt: %d rate: %d", mPcmOpenCnt, sampleRate);
     if (mPcmOpenCnt++ == 0) {
         if (mPcm != NULL) {
             ALOGE("openPcmOut_l() mPcmOpenCnt == 0 and mPcm == %p\n", mPcm);
@@ -780,8 +825,8 @@ struct pcm *AudioHardware::openPcmOut_l()
 
         struct pcm_config config = {
             channels : 2,
-            rate : AUDIO_HW_OUT_SAMPLERATE,
-            period_size : AUDIO_HW_OUT_PERIOD_SZ,
+            rate : sampleRate,
+            period_size : getOutputPeriodSize(sampleRate),
             period_count : AUDIO_HW_OUT_PERIOD_CNT,
             format : PCM_FORMAT_S16_LE,
             start_threshold : 0,
@@ -800,11 +845,32 @@ struct pcm *AudioHardware::openPcmOut_l()
             TRACE_DRIVER_OUT
             mPcmOpenCnt--;
             mPcm = NULL;
+        } else {
+            mPcmOutRate = sampleRate;
         }
     }
     return mPcm;
 }
 
+// Check that the codec accepts sampleRate before a stream commits to it.
+// Only possible while nobody holds the pcm: INVALID_OPERATION if it is busy,
+// BAD_VALUE if the driver refused the rate.
+status_t AudioHardware::probePcmOutRate_l(uint32_t sampleRate)
+{
+    if (!isOutputSampleRateSupported(sampleRate)) {
+        return BAD_VALUE;
+    }
+    if (mPcmOpenCnt != 0) {
+        return mPcmOutRate == sampleRate ? NO_ERROR : INVALID_OPERATION;
+    }
+    if (openPcmOut_l(sampleRate) == NULL) {
+        ALOGW("probePcmOutRate_l() codec refused %d Hz", sampleRate);
+        return BAD_VALUE;
+    }
+    closePcmOut_l();
+    return NO_ERROR;
+}
+
 void AudioHardware::closePcmOut_l()
 {
     ALOGD("closePcmOut_l() mPcmOpenCnt: %d", mPcmOpenCnt);
@@ -959,6 +1025,18 @@ uint32_t AudioHardware::getInputSampleRate(uint32_t sampleRate)
     return inputConfigTable[i-1][INPUT_CONFIG_SAMPLE_RATE];
 }
 
+bool AudioHardware::isOutputSampleRateSupported(uint32_t sampleRate)
+{
+    return sampleRate == AUDIO_HW_OUT_SAMPLERATE ||
+           sampleRate == AUDIO_HW_OUT_SAMPLERATE_48K;
+}
+
+size_t AudioHardware::getOutputPeriodSize(uint32_t sampleRate)
+{
+    return sampleRate == AUDIO_HW_OUT_SAMPLERATE_48K ?
+            AUDIO_HW_OUT_PERIOD_SZ_48K : AUDIO_HW_OUT_PERIOD_SZ;
+}
+
 // getActiveInput_l() must be called with mLock held
 sp <AudioHardware::AudioStreamInALSA> AudioHardware::getActiveInput_l()
 {
@@ -976,6 +1054,33 @@ sp <AudioHardware::AudioStreamInALSA> AudioHardware::getActiveInput_l()
     return spIn;
 }
 
+AudioHardware::input_profile AudioHardware::getInputProfile(audio_source source)
+{
+    switch (source) {
+    case AUDIO_SOURCE_VOICE_COMMUNICATION:
+        return INPUT_PROFILE_VOIP;
+    case AUDIO_SOURCE_MIC:          // intended fall-through
+    case AUDIO_SOURCE_CAMCORDER:
+        return INPUT_PROFILE_RECORD;
+    default:
+        return INPUT_PROFILE_DEFAULT;
+    }
+}
+
+/*
+ * The input source only comes with setParameters() after the open, but
+ * AudioFlinger sizes its reads from bufferSize() at the open. Mono at voice
+ * rates is what VoIP opens with, so such an input starts on the VoIP
+ * profile and reads in chunks that short.
+ */
+AudioHardware::input_profile AudioHardware::getInputProfile(uint32_t sampleRate,
+                                                            int channelCount)
+{
+    if (channelCount == 1 && sampleRate <= 16000)
+        return INPUT_PROFILE_VOIP;
+    return INPUT_PROFILE_DEFAULT;
+}
+
 status_t AudioHardware::setInputSource_l(audio_source source)
 {
      ALOGV("setInputSource_l(%d)", source);
@@ -1064,6 +1169,8 @@ AudioHardware::AudioStreamOutALSA::AudioStreamOutALSA() :
     mHardware(0), mPcm(0), mMixer(0), mRouteCtl(0),
     mStandby(true), mDevices(0), mChannels(AUDIO_HW_OUT_CHANNELS),
     mSampleRate(AUDIO_HW_OUT_SAMPLERATE), mBufferSize(AUDIO_HW_OUT_PERIOD_BYTES),
+    mPeriodSize(AUDIO_HW_OUT_PERIOD_SZ), mPeriodCount(AUDIO_HW_OUT_PERIOD_CNT),
+    mFramesWritten(0), mFramesWrittenActive(0),
     mDriverOp(DRV_NONE), mStandbyCnt(0), mSleepReq(false), mEchoReference(NULL)
 {
 }
@@ -1079,15 +1186,30 @@ status_t AudioHardware::AudioStreamOutALSA::set(
     mHardware = hw;
     mDevices = devices;
 
-    // fix up defaults
+    // fix up defaults; the policy opens the primary output without a rate,
+    // which gets audio.output.rate if the codec runs at it
     if (lFormat == 0) lFormat = format();
     if (lChannels == 0) lChannels = channels();
-    if (lRate == 0) lRate = sampleRate();
+    if (lRate == 0) {
+        char value[PROPERTY_VALUE_MAX];
+
+        lRate = sampleRate();
+        if (property_get("audio.output.rate", value, NULL) > 0) {
+            uint32_t rate = (uint32_t)atoi(value);
+            if (rate != lRate && hw->probePcmOutRate_l(rate) != NO_ERROR) {
+                ALOGW("AudioStreamOutALSA::set() audio.output.rate %s refused, using %d Hz",
+                      value, lRate);
+            } else {
+                lRate = rate;
+            }
+        }
+    }
 
-    // check values
+    // check values; 48kHz falls back to the default rate if the codec
+    // will not run at it
     if ((lFormat != format()) ||
         (lChannels != channels()) ||
-        (lRate != sampleRate())) {
+        (lRate != sampleRate() && hw->probePcmOutRate_l(lRate) != NO_ERROR)) {
         if (pFormat) *pFormat = format();
         if (pChannels) *pChannels = channels();
         if (pRate) *pRate = sampleRate();
@@ -1099,8 +1221,7 @@ status_t AudioHardware::AudioStreamOutALSA::set(
     if (pRate) *pRate = lRate;
 
     mChannels = lChannels;
-    mSampleRate = lRate;
-    mBufferSize = AUDIO_HW_OUT_PERIOD_BYTES;
+    setSampleRate_l(lRate);
 
     return NO_ERROR;
 }
@@ -1110,12 +1231,40 @@ AudioHardware::AudioStreamOutALSA::~AudioStreamOutALSA()
     standby();
 }
 
+void AudioHardware::AudioStreamOutALSA::setSampleRate_l(uint32_t rate)
+{
+    mSampleRate = rate;
+    mPeriodSize = getOutputPeriodSize(rate);
+    mBufferSize = mPeriodSize * frameSize();
+}
+
+// frames queued in the kernel buffer but not yet rendered, and the time
+// the driver last updated its position
+int AudioHardware::AudioStreamOutALSA::getKernelFrames_l(size_t *frames,
+                                                        struct timespec *timestamp)
+{
+    size_t avail;
+
+    if (mPcm == NULL) {
+        return -ENODEV;
+    }
+
+    int rc = pcm_get_htimestamp(mPcm, &avail, timestamp);
+    if (rc < 0) {
+        return rc;
+    }
+
+    size_t bufferFr = pcm_get_buffer_size(mPcm);
+    *frames = avail < bufferFr ? bufferFr - avail : 0;
+    return 0;
+}
+
 int AudioHardware::AudioStreamOutALSA::getPlaybackDelay(size_t frames,
                                                         struct echo_reference_buffer *buffer)
 {
     size_t kernelFr;
 
-    int rc = pcm_get_htimestamp(mPcm, &kernelFr, &buffer->time_stamp);
+    int rc = getKernelFrames_l(&kernelFr, &buffer->time_stamp);
     if (rc < 0) {
         buffer->time_stamp.tv_sec  = 0;
         buffer->time_stamp.tv_nsec = 0;
@@ -1124,12 +1273,10 @@ int AudioHardware::AudioStreamOutALSA::getPlaybackDelay(size_t frames,
         return rc;
     }
 
-    kernelFr = pcm_get_buffer_size(mPcm) - kernelFr;
-
     // adjust render time stamp with delay added by current driver buffer.
     // Add the duration of current frame as we want the render time of the last
     // sample being written.
-    long delayNs = (long)(((int64_t)(kernelFr + frames)* 1000000000) /AUDIO_HW_OUT_SAMPLERATE);
+    long delayNs = (long)(((int64_t)(kernelFr + frames)* 1000000000) / mSampleRate);
 
     ALOGV("AudioStreamOutALSA::getPlaybackDelay delayNs: [%ld], "\
          "kernelFr:[%d], frames:[%d], buffSize:[%d], time_stamp:[%ld].[%ld]",
@@ -1144,6 +1291,9 @@ int AudioHardware::AudioStreamOutALSA::getPlaybackDelay(size_t frames,
 ssize_t AudioHardware::AudioStreamOutALSA::write(const void* buffer, size_t bytes)
 {
     ALOGV("-----AudioStreamInALSA::write(%p, %d) START", buffer, (int)bytes);
+    HALTRACE_SCOPE(AUDIO_OUT_WRITE, bytes);
+    HALTRACE_COLDSTART_USE(AUDIO);
+    halsched_account(HALSCHED_AUDIO_IO);
     status_t status = NO_INIT;
     const uint8_t* p = static_cast<const uint8_t*>(buffer);
     int ret;
@@ -1209,11 +1359,15 @@ ssize_t AudioHardware::AudioStreamOutALSA::write(const void* buffer, size_t byte
             mEchoReference->write(mEchoReference, &b);
         }
 
+        AUDIO_TAP(mHardware->taps(), AUDIO_TAP_OUT_WRITE, p, bytes, mSampleRate, 2);
+
         TRACE_DRIVER_IN(DRV_PCM_WRITE)
         ret = pcm_write(mPcm,(void*) p, bytes);
         TRACE_DRIVER_OUT
 
         if (ret == 0) {
+            mFramesWritten += bytes / frameSize();
+            mFramesWrittenActive += bytes / frameSize();
             ALOGV("-----AudioStreamInALSA::write(%p, %d) END", buffer, (int)bytes);
             return bytes;
         }
@@ -1254,10 +1408,14 @@ void AudioHardware::AudioStreamOutALSA::doStandby_l()
 
     if (!mStandby) {
         ALOGD("AudioHardware pcm playback is going to standby.");
+        HALTRACE_INSTANT(AUDIO_OUT_STANDBY, 0, 0);
         // stop echo reference capture
         if (mEchoReference != NULL) {
             mEchoReference->write(mEchoReference, NULL);
         }
+        // whatever is still queued is dropped with the pcm; count it as
+        // presented so the position keeps moving with what was written
+        mFramesWrittenActive = 0;
         mStandby = true;
     }
 
@@ -1280,10 +1438,18 @@ void AudioHardware::AudioStreamOutALSA::close_l()
 status_t AudioHardware::AudioStreamOutALSA::open_l()
 {
     ALOGV("open pcm_out driver");
-    mPcm = mHardware->openPcmOut_l();
+    mPcm = mHardware->openPcmOut_l(mSampleRate);
     if (mPcm == NULL) {
         return NO_INIT;
     }
+    if (mHardware->pcmOutRate() != mSampleRate) {
+        // only when the in call path already holds the pcm at another rate
+        ALOGW("open_l() pcm is running at %d Hz, stream at %d Hz",
+              mHardware->pcmOutRate(), mSampleRate);
+    }
+    // the driver may round the buffer; latency follows what it granted
+    mPeriodCount = AUDIO_HW_OUT_PERIOD_CNT;
+    mPeriodSize = pcm_get_buffer_size(mPcm) / mPeriodCount;
 
     mMixer = mHardware->openMixer_l();
     if (mMixer) {
@@ -1335,6 +1501,12 @@ status_t AudioHardware::AudioStreamOutALSA::dump(int fd, const Vector<String16>&
     result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmBufferSize: %d\n", mBufferSize);
     result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tperiods: %d x %d frames, latency %d ms\n",
+             (int)mPeriodCount, (int)mPeriodSize, latency());
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tframes written: %llu (%llu since standby)\n",
+             (unsigned long long)mFramesWritten, (unsigned long long)mFramesWrittenActive);
+    result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
 
@@ -1364,6 +1536,7 @@ status_t AudioHardware::AudioStreamOutALSA::setParameters(const String8& keyValu
         if (param.getInt(String8(AudioParameter::keyRouting), device) == NO_ERROR)
         {
             if (device != 0) {
+                HALTRACE_SCOPE(AUDIO_ROUTE, device);
                 AutoMutex hwLock(mHardware->lock());
 
                 if (mDevices != (uint32_t)device) {
@@ -1378,6 +1551,28 @@ status_t AudioHardware::AudioStreamOutALSA::setParameters(const String8& keyValu
             }
             param.remove(String8(AudioParameter::keyRouting));
         }
+        int rate;
+        if (param.getInt(String8(AudioParameter::keySamplingRate), rate) == NO_ERROR)
+        {
+            if ((uint32_t)rate != mSampleRate) {
+                AutoMutex hwLock(mHardware->lock());
+                if (mEchoReference != NULL) {
+                    // the capture side resamples the reference from the
+                    // rate it was created with; switch once AEC has stopped
+                    status = INVALID_OPERATION;
+                } else {
+                    // reopened at the new rate by the next write()
+                    doStandby_l();
+                    status = mHardware->probePcmOutRate_l((uint32_t)rate);
+                    if (status == NO_ERROR) {
+                        ALOGD("AudioStreamOutALSA::setParameters() rate %d -> %d",
+                              mSampleRate, rate);
+                        setSampleRate_l((uint32_t)rate);
+                    }
+                }
+            }
+            param.remove(String8(AudioParameter::keySamplingRate));
+        }
     }
 
     if (param.size()) {
@@ -1399,14 +1594,56 @@ String8 AudioHardware::AudioStreamOutALSA::getParameters(const String8& keys)
         param.addInt(key, (int)mDevices);
     }
 
+    key = String8(AudioParameter::keySamplingRate);
+    if (param.get(key, value) == NO_ERROR) {
+        param.addInt(key, (int)mSampleRate);
+    }
+
+    key = String8("sup_sampling_rates");
+    if (param.get(key, value) == NO_ERROR) {
+        param.add(key, String8("44100|48000"));
+    }
+
     ALOGV("AudioStreamOutALSA::getParameters() %s", param.toString().string());
     return param.toString();
 }
 
 status_t AudioHardware::AudioStreamOutALSA::getRenderPosition(uint32_t *dspFrames)
 {
-    //TODO
-    return INVALID_OPERATION;
+    AutoMutex lock(mLock);
+    size_t kernelFr = 0;
+    struct timespec timestamp;
+
+    if (dspFrames == NULL) {
+        return BAD_VALUE;
+    }
+
+    if (!mStandby && getKernelFrames_l(&kernelFr, &timestamp) < 0) {
+        return INVALID_OPERATION;
+    }
+
+    uint64_t rendered = mFramesWrittenActive > kernelFr ? mFramesWrittenActive - kernelFr : 0;
+    *dspFrames = (uint32_t)rendered;
+    return NO_ERROR;
+}
+
+status_t AudioHardware::AudioStreamOutALSA::getPresentationPosition(uint64_t *frames,
+                                                                  struct timespec *timestamp)
+{
+    AutoMutex lock(mLock);
+    size_t kernelFr;
+
+    if (frames == NULL || timestamp == NULL) {
+        return BAD_VALUE;
+    }
+
+    // only meaningful while the DAC is running; standby has no timestamp
+    if (mStandby || getKernelFrames_l(&kernelFr, timestamp) < 0) {
+        return INVALID_OPERATION;
+    }
+
+    *frames = mFramesWritten > kernelFr ? mFramesWritten - kernelFr : 0;
+    return NO_ERROR;
 }
 
 int AudioHardware::AudioStreamOutALSA::prepareLock()
@@ -1453,10 +1690,12 @@ AudioHardware::AudioStreamInALSA::AudioStreamInALSA() :
     mHardware(0), mPcm(0), mMixer(0), mRouteCtl(0),
     mStandby(true), mDevices(0), mChannels(AUDIO_HW_IN_CHANNELS), mChannelCount(1),
     mSampleRate(AUDIO_HW_IN_SAMPLERATE), mBufferSize(AUDIO_HW_IN_PERIOD_BYTES),
-    mDownSampler(NULL), mReadStatus(NO_ERROR), mInputBuf(NULL),
+    mDownSampler(NULL), mReadStatus(NO_ERROR),
+    mProfile(INPUT_PROFILE_DEFAULT), mPeriodSize(AUDIO_HW_IN_PERIOD_SZ), mInputBuf(NULL),
     mDriverOp(DRV_NONE), mStandbyCnt(0), mSleepReq(false),
     mProcBuf(NULL), mProcBufSize(0), mRefBuf(NULL), mRefBufSize(0),
-    mEchoReference(NULL), mNeedEchoReference(false)
+    mEchoReference(NULL), mNeedEchoReference(false),
+    mBuiltinNs(NULL), mBuiltinAgc(NULL)
 {
 }
 
@@ -1487,16 +1726,17 @@ status_t AudioHardware::AudioStreamInALSA::set(
 
     ALOGV("AudioStreamInALSA::set(%d, %d, %u)", *pFormat, *pChannels, *pRate);
 
-    mBufferSize = getBufferSize(*pRate, AudioSystem::popCount(*pChannels));
+    mProfile = getInputProfile(*pRate, AudioSystem::popCount(*pChannels));
+    mBufferSize = getBufferSize(*pRate, AudioSystem::popCount(*pChannels), mProfile);
     mDevices = devices;
     mChannels = *pChannels;
     mChannelCount = AudioSystem::popCount(mChannels);
     mSampleRate = rate;
-    if (mSampleRate != AUDIO_HW_OUT_SAMPLERATE) {
+    if (mSampleRate != AUDIO_HW_IN_SAMPLERATE) {
         mBufferProvider.mProvider.get_next_buffer = getNextBufferStatic;
         mBufferProvider.mProvider.release_buffer = releaseBufferStatic;
         mBufferProvider.mInputStream = this;
-        int status = create_resampler(AUDIO_HW_OUT_SAMPLERATE,
+        int status = create_resampler(AUDIO_HW_IN_SAMPLERATE,
                                                     mSampleRate,
                                                     mChannelCount,
                                                     RESAMPLER_QUALITY_VOIP,
@@ -1508,7 +1748,13 @@ status_t AudioHardware::AudioStreamInALSA::set(
             return status;
         }
     }
-    mInputBuf = new int16_t[AUDIO_HW_IN_PERIOD_SZ * mChannelCount];
+    // large enough for any profile, the source may change between reads
+    mInputBuf = new int16_t[AUDIO_HW_IN_PERIOD_SZ_RECORD * mChannelCount];
+
+    // the built-in NS/AGC only handle mono voice rates
+    if (mChannelCount != 1 || mVoiceProc.init(mSampleRate) != 0) {
+        ALOGV("AudioStreamInALSA::set() no built-in voice processing at %u Hz", mSampleRate);
+    }
 
     return NO_ERROR;
 }
@@ -1556,6 +1802,8 @@ ssize_t AudioHardware::AudioStreamInALSA::readFrames(void* buffer, ssize_t frame
         }
         framesWr += framesRd;
     }
+    AUDIO_TAP(mHardware->taps(), AUDIO_TAP_IN_RESAMPLED, buffer, framesWr * frameSize(),
+              mSampleRate, mChannelCount);
     return framesWr;
 }
 
@@ -1645,6 +1893,8 @@ int32_t AudioHardware::AudioStreamInALSA::updateEchoReference(size_t frames)
 
         if (mEchoReference->read(mEchoReference, &b) == NO_ERROR)
         {
+            AUDIO_TAP(mHardware->taps(), AUDIO_TAP_ECHO_REF, b.raw,
+                      b.frame_count * frameSize(), mSampleRate, mChannelCount);
             mRefFramesIn += b.frame_count;
             ALOGV("updateEchoReference2: mRefFramesIn:[%d], mRefBufSize:[%d], "\
                  "frames:[%d], b.frame_count:[%d]", mRefFramesIn, mRefBufSize,frames,b.frame_count);
@@ -1724,6 +1974,38 @@ status_t AudioHardware::AudioStreamInALSA::setPreprocessorParam(effect_handle_t
     return status;
 }
 
+status_t AudioHardware::AudioStreamInALSA::getPreprocessorParam(effect_handle_t handle,
+                                                                uint32_t paramId,
+                                                                void *value,
+                                                                uint32_t size)
+{
+    uint32_t buf[sizeof(effect_param_t) / sizeof(uint32_t) + 2];
+    effect_param_t *param = (effect_param_t *)buf;
+    uint32_t replySize = sizeof(buf);
+
+    if (size > sizeof(uint32_t)) {
+        return BAD_VALUE;
+    }
+
+    param->psize = sizeof(uint32_t);
+    param->vsize = size;
+    *(uint32_t *)param->data = paramId;
+
+    status_t status = (*handle)->command(handle,
+                                           EFFECT_CMD_GET_PARAM,
+                                           sizeof(effect_param_t) + sizeof(uint32_t),
+                                           param,
+                                           &replySize,
+                                           param);
+    if (status == NO_ERROR) {
+        status = param->status;
+    }
+    if (status == NO_ERROR) {
+        memcpy(value, param->data + sizeof(uint32_t), size);
+    }
+    return status;
+}
+
 void AudioHardware::AudioStreamInALSA::getCaptureDelay(size_t frames,
                                                        struct echo_reference_buffer *buffer)
 {
@@ -1769,6 +2051,8 @@ void AudioHardware::AudioStreamInALSA::getCaptureDelay(size_t frames,
 ssize_t AudioHardware::AudioStreamInALSA::read(void* buffer, ssize_t bytes)
 {
     ALOGV("-----AudioStreamInALSA::read(%p, %d) START", buffer, (int)bytes);
+    HALTRACE_SCOPE(AUDIO_IN_READ, bytes);
+    halsched_account(HALSCHED_AUDIO_IO);
     status_t status = NO_INIT;
 
     if (mHardware == NULL) return NO_INIT;
@@ -1839,6 +2123,14 @@ ssize_t AudioHardware::AudioStreamInALSA::read(void* buffer, ssize_t bytes)
             framesRd = processFrames(buffer, framesRq);
         }
 
+        if (framesRd > 0 && mVoiceProc.isEnabled()) {
+            mVoiceProc.process((int16_t *)buffer, framesRd);
+        }
+        if (framesRd > 0) {
+            AUDIO_TAP(mHardware->taps(), AUDIO_TAP_IN_PROCESSED, buffer,
+                      framesRd * frameSize(), mSampleRate, mChannelCount);
+        }
+
         if (framesRd >= 0) {
             ALOGV("-----AudioStreamInALSA::read(%p, %d) END", buffer, (int)bytes);
             return framesRd * mChannelCount * sizeof(int16_t);
@@ -1935,8 +2227,8 @@ status_t AudioHardware::AudioStreamInALSA::open_l()
     struct pcm_config config = {
         channels : mChannelCount,
         rate : AUDIO_HW_IN_SAMPLERATE,
-        period_size : AUDIO_HW_IN_PERIOD_SZ,
-        period_count : AUDIO_HW_IN_PERIOD_CNT,
+        period_size : inputProfileTable[mProfile][INPUT_PROFILE_PERIOD_SIZE],
+        period_count : inputProfileTable[mProfile][INPUT_PROFILE_PERIOD_COUNT],
         format : PCM_FORMAT_S16_LE,
         start_threshold : 0,
         stop_threshold : 0,
@@ -1960,6 +2252,8 @@ status_t AudioHardware::AudioStreamInALSA::open_l()
     if (mDownSampler != NULL) {
         mDownSampler->reset(mDownSampler);
     }
+    mVoiceProc.reset();
+    mPeriodSize = inputProfileTable[mProfile][INPUT_PROFILE_PERIOD_SIZE];
     mInputFramesIn = 0;
 
     mProcBufSize = 0;
@@ -2016,6 +2310,15 @@ status_t AudioHardware::AudioStreamInALSA::dump(int fd, const Vector<String16>&
     result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmBufferSize: %d\n", mBufferSize);
     result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tprofile: %d, %d x %d frames, %d ms\n", mProfile,
+             inputProfileTable[mProfile][INPUT_PROFILE_PERIOD_COUNT],
+             inputProfileTable[mProfile][INPUT_PROFILE_PERIOD_SIZE],
+             getLatency(mProfile));
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\t\tbuilt-in NS %s (level %d), AGC %s (gain %d mB)\n",
+             mVoiceProc.nsEnabled() ? "on" : "off", mVoiceProc.nsLevel(),
+             mVoiceProc.agcEnabled() ? "on" : "off", mVoiceProc.agcGain());
+    result.append(buffer);
     snprintf(buffer, SIZE, "\t\tmDriverOp: %d\n", mDriverOp);
     result.append(buffer);
     write(fd, result.string(), result.size());
@@ -2050,12 +2353,24 @@ status_t AudioHardware::AudioStreamInALSA::setParameters(const String8& keyValue
             mHardware->setInputSource_l((audio_source)value);
             mHardware->closeMixer_l();
 
+            // only the kernel periods follow the source: AudioFlinger read
+            // bufferSize() at the open and keeps reading in that chunk
+            input_profile profile = getInputProfile((audio_source)value);
+            if (profile != mProfile) {
+                // the kernel buffer is sized at open, so reopen on next read
+                doStandby_l();
+                mProfile = profile;
+                ALOGV("AudioStreamInALSA::setParameters() profile %d latency %d ms",
+                      mProfile, getLatency(mProfile));
+            }
+
             param.remove(String8(AudioParameter::keyInputSource));
         }
 
         if (param.getInt(String8(AudioParameter::keyRouting), value) == NO_ERROR)
         {
             if (value != 0) {
+                HALTRACE_SCOPE(AUDIO_ROUTE, value);
                 AutoMutex hwLock(mHardware->lock());
 
                 if (mDevices != (uint32_t)value) {
@@ -2088,6 +2403,11 @@ String8 AudioHardware::AudioStreamInALSA::getParameters(const String8& keys)
         param.addInt(key, (int)mDevices);
     }
 
+    key = String8("latency");
+    if (param.get(key, value) == NO_ERROR) {
+        param.addInt(key, (int)getLatency(mProfile));
+    }
+
     ALOGV("AudioStreamInALSA::getParameters() %s", param.toString().string());
     return param.toString();
 }
@@ -2110,16 +2430,68 @@ status_t AudioHardware::AudioStreamInALSA::addAudioEffect(effect_handle_t effect
     }
 
     AutoMutex lock(mLock);
+    if (status == 0 && addBuiltinEffect_l(effect, &desc)) {
+        return NO_ERROR;
+    }
     mPreprocessors.add(effect);
     return NO_ERROR;
 }
 
+// Our own NS and AGC are not called through process(): they run in place on
+// the read buffer, which also spares processFrames() when nothing else is
+// attached. Settings are taken from the effect instance when it is added.
+bool AudioHardware::AudioStreamInALSA::addBuiltinEffect_l(effect_handle_t effect,
+                                                          const effect_descriptor_t *desc)
+{
+    static const effect_uuid_t nsUuid = SEC_NS_UUID_INIT;
+    static const effect_uuid_t agcUuid = SEC_AGC_UUID_INIT;
+
+    if (mVoiceProc.sampleRate() == 0) {
+        return false;
+    }
+
+    if (memcmp(&desc->uuid, &nsUuid, sizeof(effect_uuid_t)) == 0) {
+        uint32_t level;
+        if (getPreprocessorParam(effect, NS_PARAM_LEVEL, &level, sizeof(level)) == NO_ERROR) {
+            mVoiceProc.setNsLevel(level);
+        }
+        mBuiltinNs = effect;
+        mVoiceProc.setNsEnabled(true);
+        return true;
+    }
+
+    if (memcmp(&desc->uuid, &agcUuid, sizeof(effect_uuid_t)) == 0) {
+        int16_t value;
+        if (getPreprocessorParam(effect, AGC_PARAM_TARGET_LEVEL, &value, sizeof(value)) == NO_ERROR) {
+            mVoiceProc.setAgcTargetLevel(value);
+        }
+        if (getPreprocessorParam(effect, AGC_PARAM_COMP_GAIN, &value, sizeof(value)) == NO_ERROR) {
+            mVoiceProc.setAgcMaxGain(value);
+        }
+        mBuiltinAgc = effect;
+        mVoiceProc.setAgcEnabled(true);
+        return true;
+    }
+
+    return false;
+}
+
 status_t AudioHardware::AudioStreamInALSA::removeAudioEffect(effect_handle_t effect)
 {
     status_t status = INVALID_OPERATION;
     ALOGV("AudioStreamInALSA::removeAudioEffect() %p", effect);
     {
         AutoMutex lock(mLock);
+        if (effect == mBuiltinNs) {
+            mVoiceProc.setNsEnabled(false);
+            mBuiltinNs = NULL;
+            return NO_ERROR;
+        }
+        if (effect == mBuiltinAgc) {
+            mVoiceProc.setAgcEnabled(false);
+            mBuiltinAgc = NULL;
+            return NO_ERROR;
+        }
         for (size_t i = 0; i < mPreprocessors.size(); i++) {
             if (mPreprocessors[i] == effect) {
                 mPreprocessors.removeAt(i);
@@ -2173,18 +2545,20 @@ status_t AudioHardware::AudioStreamInALSA::getNextBuffer(struct resampler_buffer
 
     if (mInputFramesIn == 0) {
         TRACE_DRIVER_IN(DRV_PCM_READ)
-        mReadStatus = pcm_read(mPcm,(void*) mInputBuf, AUDIO_HW_IN_PERIOD_SZ * frameSize());
+        mReadStatus = pcm_read(mPcm,(void*) mInputBuf, mPeriodSize * frameSize());
         TRACE_DRIVER_OUT
         if (mReadStatus != 0) {
             buffer->raw = NULL;
             buffer->frame_count = 0;
             return mReadStatus;
         }
-        mInputFramesIn = AUDIO_HW_IN_PERIOD_SZ;
+        mInputFramesIn = mPeriodSize;
+        AUDIO_TAP(mHardware->taps(), AUDIO_TAP_IN_READ, mInputBuf, mPeriodSize * frameSize(),
+                  AUDIO_HW_IN_SAMPLERATE, mChannelCount);
     }
 
     buffer->frame_count = (buffer->frame_count > mInputFramesIn) ? mInputFramesIn:buffer->frame_count;
-    buffer->i16 = mInputBuf + (AUDIO_HW_IN_PERIOD_SZ - mInputFramesIn) * mChannelCount;
+    buffer->i16 = mInputBuf + (mPeriodSize - mInputFramesIn) * mChannelCount;
 
     return mReadStatus;
 }
@@ -2194,14 +2568,16 @@ void AudioHardware::AudioStreamInALSA::releaseBuffer(struct resampler_buffer *bu
     mInputFramesIn -= buffer->frame_count;
 }
 
-size_t AudioHardware::AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int channelCount)
+size_t AudioHardware::AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int channelCount,
+                                                     input_profile profile)
 {
     size_t i;
     size_t size = sizeof(inputConfigTable)/sizeof(uint32_t)/INPUT_CONFIG_CNT;
+    size_t periodSize = inputProfileTable[profile][INPUT_PROFILE_PERIOD_SIZE];
 
     for (i = 0; i < size; i++) {
         if (sampleRate == inputConfigTable[i][INPUT_CONFIG_SAMPLE_RATE]) {
-            return (AUDIO_HW_IN_PERIOD_SZ*channelCount*sizeof(int16_t)) /
+            return (periodSize*channelCount*sizeof(int16_t)) /
                     inputConfigTable[i][INPUT_CONFIG_BUFFER_RATIO];
         }
     }
@@ -2211,6 +2587,13 @@ size_t AudioHardware::AudioStreamInALSA::getBufferSize(uint32_t sampleRate, int
     return 0;
 }
 
+uint32_t AudioHardware::AudioStreamInALSA::getLatency(input_profile profile)
+{
+    return (inputProfileTable[profile][INPUT_PROFILE_PERIOD_SIZE] *
+            inputProfileTable[profile][INPUT_PROFILE_PERIOD_COUNT] * 1000) /
+            AUDIO_HW_IN_SAMPLERATE;
+}
+
 int AudioHardware::AudioStreamInALSA::prepareLock()
 {
     // request sleep next time read() is called so that caller can acquire
@@ -2234,7 +2617,10 @@ void AudioHardware::AudioStreamInALSA::unlock() {
 //------------------------------------------------------------------------------
 
 extern "C" AudioHardwareInterface* createAudioHardware(void) {
-    return new AudioHardware();
+    HALTRACE_COLDSTART(AUDIO, OPEN_BEGIN);
+    AudioHardwareInterface *hw = new AudioHardware();
+    HALTRACE_COLDSTART(AUDIO, OPEN_END);
+    return hw;
 }
 
 }; // namespace android
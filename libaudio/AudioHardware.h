@@ -27,6 +27,8 @@
 #include <hardware/audio_effect.h>
 
 #include "secril-client.h"
+#include "AudioTap.h"
+#include "SecVoiceProcessing.h"
 
 #include <audio_utils/resampler.h>
 #include <audio_utils/echo_reference.h>
@@ -41,6 +43,7 @@ namespace android_audio_legacy {
     using android::AutoMutex;
     using android::Mutex;
     using android::RefBase;
+    using android::SecVoiceProcessor;
     using android::SortedVector;
     using android::sp;
     using android::String16;
@@ -51,12 +54,18 @@ namespace android_audio_legacy {
 #define AUDIO_HW_OUT_LATENCY_MS 0
 // Default audio output sample rate
 #define AUDIO_HW_OUT_SAMPLERATE 44100
+// Native rate of most video and game content, so that AudioFlinger does not
+// have to resample it; the primary output opens at it when audio.output.rate
+// asks for it
+#define AUDIO_HW_OUT_SAMPLERATE_48K 48000
 // Default audio output channel mask
 #define AUDIO_HW_OUT_CHANNELS (AudioSystem::CHANNEL_OUT_STEREO)
 // Default audio output sample format
 #define AUDIO_HW_OUT_FORMAT (AudioSystem::PCM_16_BIT)
 // Kernel pcm out buffer size in frames at 44.1kHz
 #define AUDIO_HW_OUT_PERIOD_SZ 880
+// Same period duration (20ms) at 48kHz
+#define AUDIO_HW_OUT_PERIOD_SZ_48K 960
 #define AUDIO_HW_OUT_PERIOD_CNT 2
 // Default audio output buffer size in bytes
 #define AUDIO_HW_OUT_PERIOD_BYTES (AUDIO_HW_OUT_PERIOD_SZ * 2 * sizeof(int16_t))
@@ -70,6 +79,12 @@ namespace android_audio_legacy {
 // Kernel pcm in buffer size in frames at 44.1kHz (before resampling)
 #define AUDIO_HW_IN_PERIOD_SZ 1024
 #define AUDIO_HW_IN_PERIOD_CNT 4
+// Voice communication: ~6ms periods so AEC sees the signal early
+#define AUDIO_HW_IN_PERIOD_SZ_VOIP 256
+#define AUDIO_HW_IN_PERIOD_CNT_VOIP 4
+// Camcorder and recording: latency does not matter, wakeups do
+#define AUDIO_HW_IN_PERIOD_SZ_RECORD 2048
+#define AUDIO_HW_IN_PERIOD_CNT_RECORD 4
 // Default audio input buffer size in bytes (8kHz mono)
 #define AUDIO_HW_IN_PERIOD_BYTES ((AUDIO_HW_IN_PERIOD_SZ*sizeof(int16_t))/8)
 
@@ -128,12 +143,17 @@ public:
             void setVoiceVolume_l(float volume);
 
     static uint32_t    getInputSampleRate(uint32_t sampleRate);
+    static bool        isOutputSampleRateSupported(uint32_t sampleRate);
+    static size_t      getOutputPeriodSize(uint32_t sampleRate);
            sp <AudioStreamInALSA> getActiveInput_l();
 
            Mutex& lock() { return mLock; }
+           AudioTaps& taps() { return mTaps; }
 
-           struct pcm *openPcmOut_l();
+           struct pcm *openPcmOut_l(uint32_t sampleRate = AUDIO_HW_OUT_SAMPLERATE);
            void closePcmOut_l();
+           uint32_t pcmOutRate() { return mPcmOutRate; }
+           status_t probePcmOutRate_l(uint32_t sampleRate);
 
            struct mixer *openMixer_l();
            void closeMixer_l();
@@ -165,6 +185,7 @@ private:
     struct pcm*     mPcm;
     struct mixer*   mMixer;
     uint32_t        mPcmOpenCnt;
+    uint32_t        mPcmOutRate;
     uint32_t        mMixerOpenCnt;
     bool            mInCallAudioMode;
     float           mVoiceVol;
@@ -191,6 +212,8 @@ private:
     //  trace driver operations for dump
     int             mDriverOp;
 
+    AudioTaps       mTaps;
+
     static uint32_t         checkInputSampleRate(uint32_t sampleRate);
 
     // column index in inputConfigTable[][]
@@ -204,6 +227,29 @@ private:
     // between the kernel buffer size and audio hal buffer size for each sampling rate
     static const uint32_t  inputConfigTable[][INPUT_CONFIG_CNT];
 
+    // capture profiles, selected from the input source
+    enum input_profile {
+        INPUT_PROFILE_DEFAULT,
+        INPUT_PROFILE_VOIP,
+        INPUT_PROFILE_RECORD,
+        INPUT_PROFILE_CNT
+    };
+
+    // column index in inputProfileTable[][]
+    enum {
+        INPUT_PROFILE_PERIOD_SIZE,
+        INPUT_PROFILE_PERIOD_COUNT,
+        INPUT_PROFILE_CFG_CNT
+    };
+
+    // kernel period size (frames at 44.1kHz) and period count for each
+    // capture profile
+    static const uint32_t  inputProfileTable[][INPUT_PROFILE_CFG_CNT];
+
+    static input_profile   getInputProfile(audio_source source);
+    // profile an input opens with, before any input source is known
+    static input_profile   getInputProfile(uint32_t sampleRate, int channelCount);
+
     class AudioStreamOutALSA : public AudioStreamOut, public RefBase
     {
     public:
@@ -223,8 +269,7 @@ private:
         virtual int format()
             const { return AUDIO_HW_OUT_FORMAT; }
         virtual uint32_t latency()
-            const { return (1000 * AUDIO_HW_OUT_PERIOD_CNT *
-                            (bufferSize()/frameSize()))/sampleRate() +
+            const { return (1000 * mPeriodCount * mPeriodSize)/sampleRate() +
                 AUDIO_HW_OUT_LATENCY_MS; }
         virtual status_t setVolume(float left, float right)
         { return INVALID_OPERATION; }
@@ -237,6 +282,11 @@ private:
         virtual String8 getParameters(const String8& keys);
         uint32_t device() { return mDevices; }
         virtual status_t getRenderPosition(uint32_t *dspFrames);
+        // frames presented since the stream was opened and the
+        // CLOCK_MONOTONIC time the last of them left the DAC; reaches
+        // AudioFlinger through audio_hw_hal's get_presentation_position
+        virtual status_t getPresentationPosition(uint64_t *frames,
+                                                 struct timespec *timestamp);
 
                 void doStandby_l();
                 void close_l();
@@ -254,6 +304,8 @@ private:
 
                 int computeEchoReferenceDelay(size_t frames, struct timespec *echoRefRenderTime);
                 int getPlaybackDelay(size_t frames, struct echo_reference_buffer *buffer);
+                int getKernelFrames_l(size_t *frames, struct timespec *timestamp);
+                void setSampleRate_l(uint32_t rate);
 
         Mutex mLock;
         AudioHardware* mHardware;
@@ -266,6 +318,13 @@ private:
         uint32_t mChannels;
         uint32_t mSampleRate;
         size_t mBufferSize;
+        // kernel buffer geometry of the open pcm, in frames
+        size_t mPeriodSize;
+        size_t mPeriodCount;
+        // frames handed to the driver since the stream was opened, and
+        // since it last left standby (what getRenderPosition() counts from)
+        uint64_t mFramesWritten;
+        uint64_t mFramesWrittenActive;
         //  trace driver operations for dump
         int mDriverOp;
         int mStandbyCnt;
@@ -306,7 +365,10 @@ private:
                 status_t open_l();
                 int standbyCnt() { return mStandbyCnt; }
 
-        static size_t getBufferSize(uint32_t sampleRate, int channelCount);
+        static size_t getBufferSize(uint32_t sampleRate, int channelCount,
+                                    input_profile profile = INPUT_PROFILE_DEFAULT);
+        // capture latency of the kernel buffer for a profile, in ms
+        static uint32_t getLatency(input_profile profile);
 
         // resampler_buffer_provider
         static int getNextBufferStatic(struct resampler_buffer_provider *provider,
@@ -333,6 +395,9 @@ private:
         void getCaptureDelay(size_t frames, struct echo_reference_buffer *buffer);
         status_t setPreProcessorEchoDelay(effect_handle_t handle, int32_t delayUs);
         status_t setPreprocessorParam(effect_handle_t handle, effect_param_t *param);
+        status_t getPreprocessorParam(effect_handle_t handle, uint32_t paramId,
+                                      void *value, uint32_t size);
+        bool addBuiltinEffect_l(effect_handle_t effect, const effect_descriptor_t *desc);
 
         // BufferProvider
         status_t getNextBuffer(struct resampler_buffer* buffer);
@@ -353,6 +418,8 @@ private:
         struct resampler_itfe *mDownSampler;
         struct ResamplerBufferProvider mBufferProvider;
         status_t mReadStatus;
+        input_profile mProfile;
+        size_t mPeriodSize;
         size_t mInputFramesIn;
         int16_t *mInputBuf;
         //  trace driver operations for dump
@@ -368,6 +435,10 @@ private:
         size_t mRefFramesIn;
         struct echo_reference_itfe *mEchoReference;
         bool mNeedEchoReference;
+        // built-in NS and AGC, run inline after the other pre processors
+        SecVoiceProcessor mVoiceProc;
+        effect_handle_t mBuiltinNs;
+        effect_handle_t mBuiltinAgc;
     };
 
 };
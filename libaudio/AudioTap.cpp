@@ -0,0 +1,349 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AudioTap"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
+#include "AudioTap.h"
+
+namespace android_audio_legacy {
+
+// ~1.5s of 44.1kHz stereo per tap
+#define TAP_RING_SIZE       (256 * 1024)
+// a single write larger than this is dropped rather than stalling the ring
+#define TAP_MAX_CHUNK       (TAP_RING_SIZE / 4)
+#define TAP_DRAIN_US        50000
+#define TAP_DEFAULT_DIR     "/data/misc/audio"
+
+static const char *kTapNames[AUDIO_TAP_CNT] = {
+    "out_write",
+    "in_read",
+    "in_resampled",
+    "in_processed",
+    "echo_ref",
+};
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riffSize;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmtSize;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t rate;
+    uint32_t byteRate;
+    uint16_t blockAlign;
+    uint16_t bitsPerSample;
+    char data[4];
+    uint32_t dataSize;
+};
+
+AudioTaps::AudioTaps() :
+    mMask(0), mDebuggable(false), mExiting(false), mFileCnt(0)
+{
+    char dir[PROPERTY_VALUE_MAX];
+    char debuggable[PROPERTY_VALUE_MAX];
+
+    memset(mRings, 0, sizeof(mRings));
+    property_get("ro.debuggable", debuggable, "0");
+    mDebuggable = strcmp(debuggable, "1") == 0;
+    property_get("audio.tap.dir", dir, TAP_DEFAULT_DIR);
+    mDir = dir;
+}
+
+AudioTaps::~AudioTaps()
+{
+    android_atomic_release_store(0, &mMask);
+    if (mThread != 0) {
+        mLock.lock();
+        mExiting = true;
+        mWakeCond.signal();
+        mLock.unlock();
+        mThread->requestExitAndWait();
+        mThread.clear();
+    }
+    for (int i = 0; i < AUDIO_TAP_CNT; i++) {
+        drainRing(i, &mRings[i]);
+        closeFile(&mRings[i]);
+        delete[] mRings[i].buf;
+    }
+}
+
+status_t AudioTaps::setEnabled(const char *names)
+{
+    int32_t mask = 0;
+    String8 list(names);
+
+    if (list == "all") {
+        mask = (1 << AUDIO_TAP_CNT) - 1;
+    } else if (list != "" && list != "off") {
+        char *copy = strdup(names);
+        char *save;
+        for (char *name = strtok_r(copy, ",", &save); name != NULL;
+                name = strtok_r(NULL, ",", &save)) {
+            int i;
+            for (i = 0; i < AUDIO_TAP_CNT; i++) {
+                if (strcmp(name, kTapNames[i]) == 0) {
+                    mask |= 1 << i;
+                    break;
+                }
+            }
+            if (i == AUDIO_TAP_CNT) {
+                ALOGW("setEnabled() unknown tap %s", name);
+                free(copy);
+                return android::BAD_VALUE;
+            }
+        }
+        free(copy);
+    }
+
+    if (mask != 0 && !mDebuggable) {
+        ALOGW("setEnabled() taps are only available in debuggable builds");
+        return android::INVALID_OPERATION;
+    }
+
+    Mutex::Autolock lock(mLock);
+
+    // rings are never freed while the HAL runs, a producer may still be
+    // copying into a ring whose tap was just disabled
+    for (int i = 0; i < AUDIO_TAP_CNT; i++) {
+        if ((mask & (1 << i)) && mRings[i].buf == NULL) {
+            mRings[i].buf = new uint8_t[TAP_RING_SIZE];
+        }
+    }
+    if (mask != 0 && mThread == 0) {
+        mThread = new WriterThread(this);
+        mThread->run("AudioTapWriter", ANDROID_PRIORITY_BACKGROUND);
+    }
+
+    ALOGI("setEnabled() taps 0x%x -> 0x%x", mMask, mask);
+    android_atomic_release_store(mask, &mMask);
+    mWakeCond.signal();
+    return android::NO_ERROR;
+}
+
+String8 AudioTaps::getEnabled() const
+{
+    String8 list;
+    int32_t mask = mMask;
+
+    for (int i = 0; i < AUDIO_TAP_CNT; i++) {
+        if (mask & (1 << i)) {
+            if (list.length() != 0) {
+                list.append(",");
+            }
+            list.append(kTapNames[i]);
+        }
+    }
+    return list.length() != 0 ? list : String8("off");
+}
+
+void AudioTaps::write(int tap, const void *data, size_t bytes, uint32_t rate,
+                      uint32_t channels)
+{
+    Ring *ring = &mRings[tap];
+    ChunkHeader hdr = { (uint32_t)bytes, rate, channels };
+    // keep chunks 4 byte aligned so headers never straddle an odd offset
+    uint32_t total = sizeof(hdr) + ((bytes + 3) & ~3);
+
+    if (ring->buf == NULL || bytes == 0) {
+        return;
+    }
+
+    uint32_t wr = (uint32_t)ring->written;
+    uint32_t rd = (uint32_t)android_atomic_acquire_load(&ring->read);
+    if (bytes > TAP_MAX_CHUNK || TAP_RING_SIZE - (wr - rd) < total) {
+        android_atomic_inc(&ring->dropped);
+        return;
+    }
+
+    const uint8_t *src[2] = { (const uint8_t *)&hdr, (const uint8_t *)data };
+    size_t len[2] = { sizeof(hdr), bytes };
+    uint32_t pos = wr;
+    for (int i = 0; i < 2; i++) {
+        uint32_t offset = pos & (TAP_RING_SIZE - 1);
+        size_t first = TAP_RING_SIZE - offset;
+        if (first > len[i]) {
+            first = len[i];
+        }
+        memcpy(ring->buf + offset, src[i], first);
+        memcpy(ring->buf, src[i] + first, len[i] - first);
+        pos += len[i];
+    }
+
+    android_atomic_release_store((int32_t)(wr + total), &ring->written);
+}
+
+void AudioTaps::copyOut(const Ring *ring, uint32_t pos, void *dst, size_t bytes)
+{
+    uint32_t offset = pos & (TAP_RING_SIZE - 1);
+    size_t first = TAP_RING_SIZE - offset;
+    if (first > bytes) {
+        first = bytes;
+    }
+    memcpy(dst, ring->buf + offset, first);
+    memcpy((uint8_t *)dst + first, ring->buf, bytes - first);
+}
+
+void AudioTaps::openFile(int tap, Ring *ring, uint32_t rate, uint32_t channels)
+{
+    char path[PATH_MAX];
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(path, sizeof(path), "%s/%s-%s-%u.wav", mDir.string(), kTapNames[tap], stamp,
+             mFileCnt++);
+
+    ring->file = fopen(path, "wb");
+    if (ring->file == NULL) {
+        ALOGE("openFile() cannot create %s", path);
+        return;
+    }
+    ring->rate = rate;
+    ring->channels = channels;
+    ring->dataBytes = 0;
+
+    // sizes are patched in closeFile()
+    WavHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    fwrite(&hdr, sizeof(hdr), 1, ring->file);
+    ALOGI("openFile() %s, %u Hz, %u channels", path, rate, channels);
+}
+
+void AudioTaps::closeFile(Ring *ring)
+{
+    if (ring->file == NULL) {
+        return;
+    }
+
+    WavHeader hdr;
+    memcpy(hdr.riff, "RIFF", 4);
+    hdr.riffSize = sizeof(hdr) - 8 + ring->dataBytes;
+    memcpy(hdr.wave, "WAVE", 4);
+    memcpy(hdr.fmt, "fmt ", 4);
+    hdr.fmtSize = 16;
+    hdr.format = 1;     // PCM
+    hdr.channels = ring->channels;
+    hdr.rate = ring->rate;
+    hdr.blockAlign = ring->channels * sizeof(int16_t);
+    hdr.byteRate = ring->rate * hdr.blockAlign;
+    hdr.bitsPerSample = 16;
+    memcpy(hdr.data, "data", 4);
+    hdr.dataSize = ring->dataBytes;
+
+    fseek(ring->file, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, ring->file);
+    fclose(ring->file);
+    ring->file = NULL;
+}
+
+void AudioTaps::drainRing(int tap, Ring *ring)
+{
+    uint8_t chunk[4096];
+
+    if (ring->buf == NULL) {
+        return;
+    }
+
+    uint32_t rd = (uint32_t)ring->read;
+    uint32_t wr = (uint32_t)android_atomic_acquire_load(&ring->written);
+
+    while (wr - rd >= sizeof(ChunkHeader)) {
+        ChunkHeader hdr;
+        copyOut(ring, rd, &hdr, sizeof(hdr));
+
+        if (ring->file != NULL &&
+                (hdr.rate != ring->rate || hdr.channels != ring->channels)) {
+            closeFile(ring);
+        }
+        if (ring->file == NULL) {
+            openFile(tap, ring, hdr.rate, hdr.channels);
+        }
+
+        uint32_t pos = rd + sizeof(hdr);
+        size_t left = hdr.bytes;
+        while (left > 0) {
+            size_t count = left < sizeof(chunk) ? left : sizeof(chunk);
+            copyOut(ring, pos, chunk, count);
+            if (ring->file != NULL) {
+                fwrite(chunk, count, 1, ring->file);
+                ring->dataBytes += count;
+            }
+            pos += count;
+            left -= count;
+        }
+
+        rd += sizeof(hdr) + ((hdr.bytes + 3) & ~3);
+        android_atomic_release_store((int32_t)rd, &ring->read);
+    }
+}
+
+void AudioTaps::drain()
+{
+    int32_t mask = android_atomic_acquire_load(&mMask);
+
+    for (int i = 0; i < AUDIO_TAP_CNT; i++) {
+        Ring *ring = &mRings[i];
+        drainRing(i, ring);
+        // a disabled tap's file is complete once its ring is empty
+        if (!(mask & (1 << i)) && ring->file != NULL) {
+            closeFile(ring);
+        }
+    }
+
+    if (mask == 0) {
+        // everything is on disk, sleep until a tap is turned on again
+        Mutex::Autolock lock(mLock);
+        while (mMask == 0 && !mExiting) {
+            mWakeCond.wait(mLock);
+        }
+        return;
+    }
+    usleep(TAP_DRAIN_US);
+}
+
+String8 AudioTaps::dump() const
+{
+    String8 result;
+
+    result.appendFormat("\tAudio taps: %s (%s)\n", getEnabled().string(), mDir.string());
+    for (int i = 0; i < AUDIO_TAP_CNT; i++) {
+        const Ring *ring = &mRings[i];
+        if (ring->buf == NULL) {
+            continue;
+        }
+        result.appendFormat("\t\t%s: %u bytes queued, %d dropped, %u bytes in current file\n",
+                            kTapNames[i], (uint32_t)ring->written - (uint32_t)ring->read,
+                            ring->dropped, ring->dataBytes);
+    }
+    return result;
+}
+
+}; // namespace android_audio_legacy
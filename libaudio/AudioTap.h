@@ -0,0 +1,133 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_AUDIO_TAP_H
+#define ANDROID_AUDIO_TAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <cutils/compiler.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include <halsched.h>
+
+namespace android_audio_legacy {
+    using android::Condition;
+    using android::Mutex;
+    using android::sp;
+    using android::status_t;
+    using android::String8;
+    using android::Thread;
+
+// Points of the pipeline that can be recorded to WAV for debugging
+enum audio_tap_id {
+    AUDIO_TAP_OUT_WRITE,        // output, as handed to pcm_write()
+    AUDIO_TAP_IN_READ,          // capture, as returned by pcm_read()
+    AUDIO_TAP_IN_RESAMPLED,     // capture, after the resampler
+    AUDIO_TAP_IN_PROCESSED,     // capture, after pre processing
+    AUDIO_TAP_ECHO_REF,         // echo reference fed to the pre processors
+    AUDIO_TAP_CNT
+};
+
+// Tap a buffer if the tap is enabled. Costs one test when it is not.
+#define AUDIO_TAP(taps, id, data, bytes, rate, channels) \
+    do { \
+        if (CC_UNLIKELY((taps).isEnabled(id))) { \
+            (taps).write(id, data, bytes, rate, channels); \
+        } \
+    } while (0)
+
+/*
+ * Enabled taps copy into a per tap lock-free ring; a writer thread drains the
+ * rings to <dir>/<tap>-<time>.wav, starting a new file on format changes.
+ * write() never blocks: when the ring is full the buffer is dropped and
+ * counted. Each tap must only be written from one thread at a time.
+ *
+ * Taps are selected with the audio.tap property at boot, or the audio_tap
+ * parameter later: a comma separated list of tap names, "all" or "off".
+ * They record the microphone, so only debuggable builds (ro.debuggable=1)
+ * turn any on. The writer thread sleeps while all taps are off.
+ */
+class AudioTaps {
+public:
+    AudioTaps();
+    ~AudioTaps();
+
+    status_t setEnabled(const char *names);
+    String8 getEnabled() const;
+
+    inline bool isEnabled(int tap) const { return (mMask & (1 << tap)) != 0; }
+    void write(int tap, const void *data, size_t bytes, uint32_t rate, uint32_t channels);
+
+    String8 dump() const;
+
+private:
+    class WriterThread : public Thread {
+        AudioTaps *mTaps;
+    public:
+        WriterThread(AudioTaps *taps): Thread(false), mTaps(taps) { }
+        virtual status_t readyToRun() {
+            halsched_attach(HALSCHED_DEBUG);
+            return android::NO_ERROR;
+        }
+        virtual bool threadLoop() {
+            mTaps->drain();
+            return true;
+        }
+    };
+
+    struct ChunkHeader {
+        uint32_t bytes;
+        uint32_t rate;
+        uint32_t channels;
+    };
+
+    struct Ring {
+        uint8_t *buf;
+        // free running byte counts; write() advances written, drain() read
+        volatile int32_t written;
+        volatile int32_t read;
+        volatile int32_t dropped;
+        // writer thread state
+        FILE *file;
+        uint32_t rate;
+        uint32_t channels;
+        uint32_t dataBytes;
+    };
+
+    void drain();
+    void drainRing(int tap, Ring *ring);
+    void copyOut(const Ring *ring, uint32_t pos, void *dst, size_t bytes);
+    void openFile(int tap, Ring *ring, uint32_t rate, uint32_t channels);
+    void closeFile(Ring *ring);
+
+    volatile int32_t mMask;
+    bool mDebuggable;
+    mutable Mutex mLock;        // enable/disable and lazy allocation only
+    Condition mWakeCond;        // the writer waits here while mMask is 0
+    bool mExiting;
+    Ring mRings[AUDIO_TAP_CNT];
+    sp<WriterThread> mThread;
+    String8 mDir;
+    uint32_t mFileCnt;
+};
+
+}; // namespace android_audio_legacy
+
+#endif // ANDROID_AUDIO_TAP_H
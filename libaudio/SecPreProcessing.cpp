@@ -0,0 +1,378 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Effect descriptors for the built-in noise suppression and AGC.
+ *
+ * audio_effects.conf lists these ahead of the generic pre processors for
+ * voice capture. Our audio HAL recognizes the implementation UUIDs in
+ * addAudioEffect() and runs SecVoiceProcessor inline on its read buffer;
+ * process() below is only used when the effect ends up on a stream the
+ * HAL does not handle itself.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecPreProcessing"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Log.h>
+#include <hardware/audio_effect.h>
+#include <audio_effects/effect_agc.h>
+#include <audio_effects/effect_ns.h>
+
+#include "SecVoiceProcessing.h"
+
+namespace android {
+
+enum sec_preproc_id {
+    SEC_PREPROC_NS,
+    SEC_PREPROC_AGC,
+    SEC_PREPROC_CNT
+};
+
+enum sec_preproc_state {
+    SEC_PREPROC_STATE_INIT,
+    SEC_PREPROC_STATE_CONFIG,
+    SEC_PREPROC_STATE_ACTIVE,
+};
+
+static const effect_descriptor_t sNsDescriptor = {
+    { 0x58b4b260, 0x8e06, 0x11e0, 0xaa8e, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }, // FX_IID_NS
+    SEC_NS_UUID_INIT,
+    EFFECT_CONTROL_API_VERSION,
+    (EFFECT_FLAG_TYPE_PRE_PROC | EFFECT_FLAG_DEVICE_IND),
+    2,          // 0.2 MIPS at 16kHz
+    2,          // KB
+    "Noise Suppression",
+    "The CyanogenMod Project"
+};
+
+static const effect_descriptor_t sAgcDescriptor = {
+    { 0x0a8abfe0, 0x654c, 0x11e0, 0xba26, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }, // FX_IID_AGC
+    SEC_AGC_UUID_INIT,
+    EFFECT_CONTROL_API_VERSION,
+    (EFFECT_FLAG_TYPE_PRE_PROC | EFFECT_FLAG_DEVICE_IND),
+    2,
+    2,
+    "Automatic Gain Control",
+    "The CyanogenMod Project"
+};
+
+static const effect_descriptor_t *sDescriptors[SEC_PREPROC_CNT] = {
+    &sNsDescriptor,
+    &sAgcDescriptor
+};
+
+struct sec_preproc_effect {
+    const struct effect_interface_s *itfe;
+    sec_preproc_id id;
+    sec_preproc_state state;
+    SecVoiceProcessor proc;
+};
+
+static const effect_descriptor_t *getDescriptor(const effect_uuid_t *uuid)
+{
+    for (int i = 0; i < SEC_PREPROC_CNT; i++) {
+        if (memcmp(&sDescriptors[i]->uuid, uuid, sizeof(effect_uuid_t)) == 0) {
+            return sDescriptors[i];
+        }
+    }
+    return NULL;
+}
+
+static int setConfig(sec_preproc_effect *effect, effect_config_t *config)
+{
+    if (config->inputCfg.samplingRate != config->outputCfg.samplingRate ||
+            config->inputCfg.channels != AUDIO_CHANNEL_IN_MONO ||
+            config->outputCfg.channels != AUDIO_CHANNEL_IN_MONO ||
+            config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT ||
+            config->outputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        return -EINVAL;
+    }
+    if (effect->proc.init(config->inputCfg.samplingRate) != 0) {
+        ALOGV("setConfig() unsupported rate %u", config->inputCfg.samplingRate);
+        return -EINVAL;
+    }
+    if (effect->state == SEC_PREPROC_STATE_INIT) {
+        effect->state = SEC_PREPROC_STATE_CONFIG;
+    }
+    return 0;
+}
+
+static int getParameter(sec_preproc_effect *effect, effect_param_t *p, uint32_t *size)
+{
+    int32_t param = *(int32_t *)p->data;
+    void *value = p->data + ((p->psize - 1) / sizeof(int32_t) + 1) * sizeof(int32_t);
+
+    p->status = 0;
+    if (effect->id == SEC_PREPROC_NS && param == NS_PARAM_LEVEL) {
+        if (p->vsize < sizeof(uint32_t)) {
+            p->status = -EINVAL;
+        } else {
+            *(uint32_t *)value = effect->proc.nsLevel();
+            p->vsize = sizeof(uint32_t);
+        }
+    } else if (effect->id == SEC_PREPROC_AGC && param == AGC_PARAM_TARGET_LEVEL) {
+        if (p->vsize < sizeof(int16_t)) {
+            p->status = -EINVAL;
+        } else {
+            *(int16_t *)value = effect->proc.agcTargetLevel();
+            p->vsize = sizeof(int16_t);
+        }
+    } else if (effect->id == SEC_PREPROC_AGC && param == AGC_PARAM_COMP_GAIN) {
+        if (p->vsize < sizeof(int16_t)) {
+            p->status = -EINVAL;
+        } else {
+            *(int16_t *)value = effect->proc.agcMaxGain();
+            p->vsize = sizeof(int16_t);
+        }
+    } else {
+        p->status = -EINVAL;
+    }
+
+    *size = sizeof(effect_param_t) + ((p->psize - 1) / sizeof(int32_t) + 1) * sizeof(int32_t) +
+            p->vsize;
+    return 0;
+}
+
+static int setParameter(sec_preproc_effect *effect, effect_param_t *p)
+{
+    int32_t param = *(int32_t *)p->data;
+    void *value = p->data + ((p->psize - 1) / sizeof(int32_t) + 1) * sizeof(int32_t);
+
+    if (effect->id == SEC_PREPROC_NS && param == NS_PARAM_LEVEL) {
+        effect->proc.setNsLevel(*(uint32_t *)value);
+    } else if (effect->id == SEC_PREPROC_AGC && param == AGC_PARAM_TARGET_LEVEL) {
+        effect->proc.setAgcTargetLevel(*(int16_t *)value);
+    } else if (effect->id == SEC_PREPROC_AGC && param == AGC_PARAM_COMP_GAIN) {
+        effect->proc.setAgcMaxGain(*(int16_t *)value);
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Effect Control Interface
+//------------------------------------------------------------------------------
+
+static int SecPreProc_process(effect_handle_t self, audio_buffer_t *inBuffer,
+                              audio_buffer_t *outBuffer)
+{
+    sec_preproc_effect *effect = (sec_preproc_effect *)self;
+
+    if (effect == NULL || inBuffer == NULL || outBuffer == NULL ||
+            inBuffer->raw == NULL || outBuffer->raw == NULL) {
+        return -EINVAL;
+    }
+    if (effect->state != SEC_PREPROC_STATE_ACTIVE) {
+        return -ENODATA;
+    }
+
+    size_t frames = inBuffer->frameCount < outBuffer->frameCount ?
+            inBuffer->frameCount : outBuffer->frameCount;
+    if (inBuffer->s16 != outBuffer->s16) {
+        memcpy(outBuffer->s16, inBuffer->s16, frames * sizeof(int16_t));
+    }
+    effect->proc.process(outBuffer->s16, frames);
+
+    inBuffer->frameCount = frames;
+    outBuffer->frameCount = frames;
+    return 0;
+}
+
+static int SecPreProc_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
+                              void *pCmdData, uint32_t *replySize, void *pReplyData)
+{
+    sec_preproc_effect *effect = (sec_preproc_effect *)self;
+
+    if (effect == NULL) {
+        return -EINVAL;
+    }
+
+    switch (cmdCode) {
+    case EFFECT_CMD_INIT:
+        if (pReplyData == NULL || replySize == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        effect->proc.reset();
+        *(int *)pReplyData = 0;
+        break;
+
+    case EFFECT_CMD_SET_CONFIG:
+        if (pCmdData == NULL || cmdSize != sizeof(effect_config_t) ||
+                pReplyData == NULL || replySize == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        *(int *)pReplyData = setConfig(effect, (effect_config_t *)pCmdData);
+        break;
+
+    case EFFECT_CMD_RESET:
+        effect->proc.reset();
+        break;
+
+    case EFFECT_CMD_ENABLE:
+    case EFFECT_CMD_DISABLE: {
+        if (pReplyData == NULL || replySize == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        if (effect->state == SEC_PREPROC_STATE_INIT) {
+            *(int *)pReplyData = -ENOSYS;
+            break;
+        }
+        bool enable = cmdCode == EFFECT_CMD_ENABLE;
+        if (effect->id == SEC_PREPROC_NS) {
+            effect->proc.setNsEnabled(enable);
+        } else {
+            effect->proc.setAgcEnabled(enable);
+        }
+        effect->state = enable ? SEC_PREPROC_STATE_ACTIVE : SEC_PREPROC_STATE_CONFIG;
+        *(int *)pReplyData = 0;
+        break;
+    }
+
+    case EFFECT_CMD_GET_PARAM:
+        if (pCmdData == NULL || cmdSize < (int)sizeof(effect_param_t) ||
+                pReplyData == NULL || replySize == NULL ||
+                *replySize < (int)sizeof(effect_param_t)) {
+            return -EINVAL;
+        }
+        memcpy(pReplyData, pCmdData, sizeof(effect_param_t) + ((effect_param_t *)pCmdData)->psize);
+        return getParameter(effect, (effect_param_t *)pReplyData, replySize);
+
+    case EFFECT_CMD_SET_PARAM:
+        if (pCmdData == NULL || cmdSize < (int)sizeof(effect_param_t) ||
+                pReplyData == NULL || replySize == NULL || *replySize != sizeof(int32_t)) {
+            return -EINVAL;
+        }
+        *(int *)pReplyData = setParameter(effect, (effect_param_t *)pCmdData);
+        break;
+
+    case EFFECT_CMD_SET_DEVICE:
+    case EFFECT_CMD_SET_INPUT_DEVICE:
+    case EFFECT_CMD_SET_VOLUME:
+    case EFFECT_CMD_SET_AUDIO_MODE:
+        break;
+
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int SecPreProc_getDescriptor(effect_handle_t self, effect_descriptor_t *pDescriptor)
+{
+    sec_preproc_effect *effect = (sec_preproc_effect *)self;
+
+    if (effect == NULL || pDescriptor == NULL) {
+        return -EINVAL;
+    }
+    *pDescriptor = *sDescriptors[effect->id];
+    return 0;
+}
+
+static const struct effect_interface_s sEffectInterface = {
+    SecPreProc_process,
+    SecPreProc_command,
+    SecPreProc_getDescriptor,
+    NULL
+};
+
+//------------------------------------------------------------------------------
+// Effect Library Interface
+//------------------------------------------------------------------------------
+
+static int SecPreProcLib_queryNumberEffects(uint32_t *pNumEffects)
+{
+    if (pNumEffects == NULL) {
+        return -EINVAL;
+    }
+    *pNumEffects = SEC_PREPROC_CNT;
+    return 0;
+}
+
+static int SecPreProcLib_queryEffect(uint32_t index, effect_descriptor_t *pDescriptor)
+{
+    if (pDescriptor == NULL || index >= SEC_PREPROC_CNT) {
+        return -EINVAL;
+    }
+    *pDescriptor = *sDescriptors[index];
+    return 0;
+}
+
+static int SecPreProcLib_create(const effect_uuid_t *uuid, int32_t sessionId, int32_t ioId,
+                                effect_handle_t *pInterface)
+{
+    const effect_descriptor_t *desc;
+
+    if (uuid == NULL || pInterface == NULL || (desc = getDescriptor(uuid)) == NULL) {
+        return -EINVAL;
+    }
+
+    sec_preproc_effect *effect = new sec_preproc_effect;
+    effect->itfe = &sEffectInterface;
+    effect->id = desc == &sNsDescriptor ? SEC_PREPROC_NS : SEC_PREPROC_AGC;
+    effect->state = SEC_PREPROC_STATE_INIT;
+
+    ALOGV("SecPreProcLib_create() %s session %d io %d", desc->name, sessionId, ioId);
+    *pInterface = (effect_handle_t)effect;
+    return 0;
+}
+
+static int SecPreProcLib_release(effect_handle_t interface)
+{
+    sec_preproc_effect *effect = (sec_preproc_effect *)interface;
+
+    if (effect == NULL) {
+        return -EINVAL;
+    }
+    delete effect;
+    return 0;
+}
+
+static int SecPreProcLib_getDescriptor(const effect_uuid_t *uuid,
+                                       effect_descriptor_t *pDescriptor)
+{
+    const effect_descriptor_t *desc;
+
+    if (pDescriptor == NULL || uuid == NULL || (desc = getDescriptor(uuid)) == NULL) {
+        return -EINVAL;
+    }
+    *pDescriptor = *desc;
+    return 0;
+}
+
+}; // namespace android
+
+extern "C" {
+
+__attribute__ ((visibility ("default")))
+audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM = {
+    tag : AUDIO_EFFECT_LIBRARY_TAG,
+    version : EFFECT_LIBRARY_API_VERSION,
+    name : "Samsung Voice Pre Processing Library",
+    implementor : "The CyanogenMod Project",
+    query_num_effects : android::SecPreProcLib_queryNumberEffects,
+    query_effect : android::SecPreProcLib_queryEffect,
+    create_effect : android::SecPreProcLib_create,
+    release_effect : android::SecPreProcLib_release,
+    get_descriptor : android::SecPreProcLib_getDescriptor
+};
+
+}; // extern "C"
@@ -0,0 +1,319 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "SecVoiceProcessing.h"
+
+namespace android {
+
+#define Q15_ONE             32767
+#define Q12_ONE             4096
+
+// full scale mean square
+#define FULL_SCALE_ENERGY   (32767.0 * 32767.0)
+
+// blocks quieter than -60dBFS are never speech
+#define SPEECH_MIN_ENERGY   1073
+// a block is speech when its energy is this many times the noise floor
+#define SPEECH_SNR          4
+
+// the AGC never attenuates more than 6dB
+#define AGC_MIN_GAIN        (Q12_ONE / 2)
+// block peak the limiter aims for
+#define AGC_LIMIT           32000
+
+#define DEFAULT_NS_LEVEL        SEC_NS_LEVEL_MEDIUM
+#define DEFAULT_AGC_TARGET      (-2000)
+#define DEFAULT_AGC_MAX_GAIN    1800
+
+// Q15 minimum suppression gain for each NS level: -9, -15 and -21dB
+static const int32_t kNsMinGain[] = { 11627, 5827, 2920 };
+
+static inline int16_t clamp16(int32_t sample)
+{
+    if ((sample >> 15) ^ (sample >> 31))
+        sample = 0x7FFF ^ (sample >> 31);
+    return sample;
+}
+
+static uint32_t isqrt64(uint64_t x)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit != 0) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+SecVoiceProcessor::SecVoiceProcessor() :
+    mSampleRate(0), mBlockSize(0), mNsEnabled(false), mAgcEnabled(false),
+    mPrimed(false), mSplitCoef(0), mSplitState(0), mAgcGain(Q12_ONE)
+{
+    setNsLevel(DEFAULT_NS_LEVEL);
+    setAgcTargetLevel(DEFAULT_AGC_TARGET);
+    setAgcMaxGain(DEFAULT_AGC_MAX_GAIN);
+    reset();
+}
+
+int SecVoiceProcessor::init(uint32_t sampleRate)
+{
+    // one-pole low pass at 800Hz: 1 - exp(-2*pi*800/fs)
+    switch (sampleRate) {
+    case 8000:
+        mSplitCoef = 15414;
+        break;
+    case 16000:
+        mSplitCoef = 8833;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    mSampleRate = sampleRate;
+    mBlockSize = sampleRate / 100;
+    reset();
+    return 0;
+}
+
+void SecVoiceProcessor::reset()
+{
+    mPrimed = false;
+    mSplitState = 0;
+    for (int i = 0; i < BAND_CNT; i++) {
+        mBands[i].noise = 0;
+        mBands[i].gain = Q15_ONE;
+    }
+    mSpeechLevel = mAgcTarget;
+    mAgcGain = Q12_ONE;
+    mAgcApplied = Q12_ONE;
+}
+
+void SecVoiceProcessor::setNsLevel(int level)
+{
+    if (level < SEC_NS_LEVEL_LOW)
+        level = SEC_NS_LEVEL_LOW;
+    if (level > SEC_NS_LEVEL_HIGH)
+        level = SEC_NS_LEVEL_HIGH;
+    mNsLevel = level;
+    mNsMinGain = kNsMinGain[level];
+}
+
+void SecVoiceProcessor::setAgcTargetLevel(int32_t mB)
+{
+    if (mB > 0)
+        mB = 0;
+    if (mB < -9000)
+        mB = -9000;
+    mAgcTargetLevel = mB;
+    mAgcTarget = (uint32_t)(FULL_SCALE_ENERGY * pow(10.0, mB / 1000.0));
+    if (mAgcTarget == 0)
+        mAgcTarget = 1;
+}
+
+void SecVoiceProcessor::setAgcMaxGain(int32_t mB)
+{
+    // 24dB keeps sample * gain inside 32 bits
+    if (mB < 0)
+        mB = 0;
+    if (mB > 2400)
+        mB = 2400;
+    mAgcMaxGainMb = mB;
+    mAgcMaxGain = (int32_t)(Q12_ONE * pow(10.0, mB / 2000.0));
+    if (mAgcGain > mAgcMaxGain)
+        mAgcGain = mAgcMaxGain;
+}
+
+int32_t SecVoiceProcessor::agcGain() const
+{
+    return (int32_t)(2000.0 * log10((double)mAgcGain / Q12_ONE));
+}
+
+void SecVoiceProcessor::process(int16_t *buf, size_t frames)
+{
+    if (mBlockSize == 0 || !isEnabled())
+        return;
+
+    while (frames > 0) {
+        size_t count = frames < mBlockSize ? frames : mBlockSize;
+        processBlock(buf, count);
+        buf += count;
+        frames -= count;
+    }
+}
+
+void SecVoiceProcessor::updateNoise(Band *band, uint32_t energy)
+{
+    if (!mPrimed) {
+        band->noise = energy;
+    } else if (energy < band->noise) {
+        // follow dips quickly
+        band->noise -= (band->noise - energy) >> 2;
+    } else {
+        // and rise at ~3dB/s so that speech does not lift the floor
+        uint32_t step = (band->noise >> 7) + 1;
+        band->noise = (energy - band->noise < step) ? energy : band->noise + step;
+    }
+}
+
+int32_t SecVoiceProcessor::suppressionGain(const Band *band, uint32_t energy) const
+{
+    if (energy == 0)
+        return mNsMinGain;
+
+    // the tracked minimum sits below the mean noise level, oversubtract 2x
+    uint64_t ratio = ((uint64_t)band->noise << 16) / energy;
+    int32_t gain = ratio >= (1 << 15) ? 0 : Q15_ONE - (int32_t)ratio;
+    return gain < mNsMinGain ? mNsMinGain : gain;
+}
+
+void SecVoiceProcessor::suppress(int16_t *buf, size_t frames, const uint32_t *energy)
+{
+    int32_t prev[BAND_CNT];
+    int32_t step[BAND_CNT];
+    size_t i;
+
+    for (int b = 0; b < BAND_CNT; b++) {
+        Band *band = &mBands[b];
+        int32_t gain = suppressionGain(band, energy[b]);
+
+        prev[b] = band->gain;
+        // open fast on speech onsets, close slowly on decays
+        if (gain > band->gain)
+            band->gain += (gain - band->gain) >> 1;
+        else
+            band->gain -= (band->gain - gain) >> 2;
+        step[b] = (band->gain - prev[b]) / (int32_t)frames;
+    }
+
+    int32_t gLow = prev[BAND_LOW];
+    int32_t gHigh = prev[BAND_HIGH];
+    for (i = 0; i < frames; i++) {
+        gLow += step[BAND_LOW];
+        gHigh += step[BAND_HIGH];
+        // |high| < 2^16 and gains <= Q15_ONE, each product fits 32 bits
+        buf[i] = clamp16(((mLow[i] * gLow) >> 15) + ((mHigh[i] * gHigh) >> 15));
+    }
+}
+
+void SecVoiceProcessor::agc(int16_t *buf, size_t frames, bool speech)
+{
+    uint64_t sum = 0;
+    int32_t peak = 0;
+    size_t i;
+
+    for (i = 0; i < frames; i++) {
+        int32_t s = buf[i];
+        sum += s * s;
+        if (s < 0)
+            s = -s;
+        if (s > peak)
+            peak = s;
+    }
+    uint32_t energy = (uint32_t)(sum / frames);
+
+    if (speech && energy > 0) {
+        int64_t diff = (int64_t)energy - mSpeechLevel;
+        mSpeechLevel = (uint32_t)((int64_t)mSpeechLevel + diff / 8);
+        if (mSpeechLevel == 0)
+            mSpeechLevel = 1;
+
+        uint64_t want = ((uint64_t)mAgcTarget << 24) / mSpeechLevel;
+        int32_t wanted = want >= (1ULL << 32) ? mAgcMaxGain : (int32_t)isqrt64(want);
+        if (wanted > mAgcMaxGain)
+            wanted = mAgcMaxGain;
+        if (wanted < AGC_MIN_GAIN)
+            wanted = AGC_MIN_GAIN;
+
+        // ~7dB/s up, ~55dB/s down; held through pauses so noise is not pumped
+        if (wanted > mAgcGain) {
+            int32_t step = (mAgcGain >> 7) + 1;
+            mAgcGain = wanted - mAgcGain < step ? wanted : mAgcGain + step;
+        } else {
+            int32_t step = (mAgcGain >> 4) + 1;
+            mAgcGain = mAgcGain - wanted < step ? wanted : mAgcGain - step;
+        }
+    }
+
+    int32_t gain = mAgcGain;
+    if (peak > 0 && ((int64_t)peak * gain) >> 12 > AGC_LIMIT)
+        gain = (AGC_LIMIT << 12) / peak;
+
+    int32_t g = mAgcApplied;
+    int32_t step = (gain - g) / (int32_t)frames;
+    for (i = 0; i < frames; i++) {
+        g += step;
+        buf[i] = clamp16((buf[i] * g) >> 12);
+    }
+    mAgcApplied = gain;
+}
+
+void SecVoiceProcessor::processBlock(int16_t *buf, size_t frames)
+{
+    uint64_t sum[BAND_CNT] = { 0, 0 };
+    uint32_t energy[BAND_CNT];
+    uint32_t total = 0;
+    uint32_t noise = 0;
+    size_t i;
+
+    // band split; the high band is what the low pass leaves
+    int32_t state = mSplitState;
+    for (i = 0; i < frames; i++) {
+        int32_t x = buf[i];
+        state += (int32_t)((((x << 15) - state) * (int64_t)mSplitCoef) >> 15);
+        mLow[i] = state >> 15;
+        mHigh[i] = x - mLow[i];
+    }
+    mSplitState = state;
+
+    for (i = 0; i < frames; i++) {
+        sum[BAND_LOW] += (int64_t)mLow[i] * mLow[i];
+        sum[BAND_HIGH] += (int64_t)mHigh[i] * mHigh[i];
+    }
+    for (int b = 0; b < BAND_CNT; b++) {
+        energy[b] = (uint32_t)(sum[b] / frames);
+        total += energy[b];
+        noise += mBands[b].noise;
+    }
+
+    bool speech = mPrimed && total > SPEECH_MIN_ENERGY &&
+                  (uint64_t)total > (uint64_t)noise * SPEECH_SNR;
+
+    if (mNsEnabled)
+        suppress(buf, frames, energy);
+
+    // noise floors follow the input even when NS is off, the AGC uses them
+    for (int b = 0; b < BAND_CNT; b++)
+        updateNoise(&mBands[b], energy[b]);
+    mPrimed = true;
+
+    if (mAgcEnabled)
+        agc(buf, frames, speech);
+}
+
+}; // namespace android
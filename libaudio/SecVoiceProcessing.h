@@ -0,0 +1,127 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_SEC_VOICE_PROCESSING_H
+#define ANDROID_SEC_VOICE_PROCESSING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// Implementation UUIDs of the built-in pre processors, published by
+// libsecpreprocessing. The audio HAL runs them inline instead of calling
+// the effect's process().
+#define SEC_NS_UUID_INIT \
+    { 0x3e1c7c40, 0x4a7d, 0x11e4, 0x8d2c, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }
+#define SEC_AGC_UUID_INIT \
+    { 0x5b2b8fa0, 0x4a7d, 0x11e4, 0x9a01, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }
+
+// noise suppression levels, same values as NS_LEVEL_* in effect_ns.h
+enum {
+    SEC_NS_LEVEL_LOW,
+    SEC_NS_LEVEL_MEDIUM,
+    SEC_NS_LEVEL_HIGH,
+};
+
+/*
+ * Fixed-point noise suppression and AGC for mono 8kHz or 16kHz voice.
+ *
+ * The signal is split in two bands around 800Hz. Each band has its own
+ * minimum-tracking noise floor and a suppression gain of 1 - 2*noise/energy,
+ * floored by the NS level. The AGC then moves the speech level toward the
+ * target, updates only on frames well above the noise floor, and limits
+ * the gain so that the block peak does not clip. Work is done on 10ms
+ * blocks; gains ramp linearly across a block.
+ */
+class SecVoiceProcessor {
+public:
+    SecVoiceProcessor();
+
+    // returns 0, or -EINVAL for anything but 8000 or 16000
+    int init(uint32_t sampleRate);
+    void reset();
+
+    void setNsEnabled(bool enabled) { mNsEnabled = enabled; }
+    void setAgcEnabled(bool enabled) { mAgcEnabled = enabled; }
+    bool nsEnabled() const { return mNsEnabled; }
+    bool agcEnabled() const { return mAgcEnabled; }
+    bool isEnabled() const { return mNsEnabled || mAgcEnabled; }
+    uint32_t sampleRate() const { return mSampleRate; }
+
+    void setNsLevel(int level);
+    int nsLevel() const { return mNsLevel; }
+    // target speech level in millibel relative to full scale (<= 0)
+    void setAgcTargetLevel(int32_t mB);
+    int32_t agcTargetLevel() const { return mAgcTargetLevel; }
+    // maximum gain in millibel, 0 to 2400
+    void setAgcMaxGain(int32_t mB);
+    int32_t agcMaxGain() const { return mAgcMaxGainMb; }
+    // current AGC gain in millibel
+    int32_t agcGain() const;
+
+    // in place, mono
+    void process(int16_t *buf, size_t frames);
+
+private:
+    enum {
+        BAND_LOW,
+        BAND_HIGH,
+        BAND_CNT
+    };
+
+    // 10ms at 16kHz
+    static const size_t MAX_BLOCK = 160;
+
+    struct Band {
+        uint32_t noise;     // mean square noise floor
+        int32_t gain;       // Q15, gain at the end of the last block
+    };
+
+    void processBlock(int16_t *buf, size_t frames);
+    void suppress(int16_t *buf, size_t frames, const uint32_t *energy);
+    void updateNoise(Band *band, uint32_t energy);
+    int32_t suppressionGain(const Band *band, uint32_t energy) const;
+    void agc(int16_t *buf, size_t frames, bool speech);
+
+    uint32_t mSampleRate;
+    size_t mBlockSize;
+    bool mNsEnabled;
+    bool mAgcEnabled;
+    bool mPrimed;
+
+    // band split
+    int32_t mSplitCoef;     // Q15 one-pole low pass coefficient
+    int32_t mSplitState;    // Q15 scaled low band sample
+    int32_t mLow[MAX_BLOCK];
+    int32_t mHigh[MAX_BLOCK];
+
+    Band mBands[BAND_CNT];
+    int mNsLevel;
+    int32_t mNsMinGain;     // Q15
+
+    uint32_t mSpeechLevel;  // mean square of speech blocks after NS
+    uint32_t mAgcTarget;    // mean square target
+    int32_t mAgcTargetLevel;
+    int32_t mAgcMaxGainMb;
+    int32_t mAgcMaxGain;    // Q12
+    int32_t mAgcGain;       // Q12, the AGC's wanted gain
+    int32_t mAgcApplied;    // Q12, gain at the end of the last block
+};
+
+}; // namespace android
+
+#endif // ANDROID_SEC_VOICE_PROCESSING_H
@@ -0,0 +1,359 @@
+/*
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * voiceproc_bench: CPU cost and output quality of the built-in NS/AGC.
+ *
+ * Each vector is synthesized from a fixed seed: voiced bursts (1.2s on,
+ * 0.8s off) over a noise bed. For every rate and mode it prints the CPU
+ * time spent per second of audio, the noise level in the pauses and the
+ * speech level in the bursts before and after processing, the number of
+ * clipped samples, and a digest of the output.
+ *
+ * At the default length and block size the digests of the synthesized input
+ * and of every output are checked against kReferences: a vector whose input
+ * differs is reported as such (its output can't be judged), any other
+ * mismatch is a change in the processing. Either fails the run with exit
+ * code 2. A deliberate change to the processing updates the table with the
+ * digests it prints.
+ *
+ * Usage: voiceproc_bench [-s seconds] [-r 8000|16000] [-b block] [-w prefix]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "SecVoiceProcessing.h"
+
+using android::SecVoiceProcessor;
+
+#define DEFAULT_SECONDS 20
+// what AudioFlinger reads at a time from an 8kHz VoIP input
+#define DEFAULT_BLOCK   128
+#define BURST_MS        1200
+#define PAUSE_MS        800
+// pauses and bursts are measured past the edges, where gains are still moving
+#define SETTLE_MS       200
+#define WARMUP_MS       4000
+
+struct Vector {
+    const char *name;
+    double speechDb;    // burst rms, dBFS
+    double noiseDb;     // white noise rms, dBFS
+    double humDb;       // 100Hz hum rms, dBFS
+};
+
+static const Vector kVectors[] = {
+    { "quiet-speech",   -38.0, -55.0, -90.0 },
+    { "loud-speech",    -12.0, -60.0, -90.0 },
+    { "noisy-speech",   -26.0, -38.0, -90.0 },
+    { "hum",            -30.0, -65.0, -40.0 },
+};
+
+struct Mode {
+    const char *name;
+    bool ns;
+    bool agc;
+};
+
+static const Mode kModes[] = {
+    { "ns",     true,  false },
+    { "agc",    false, true  },
+    { "ns+agc", true,  true  },
+};
+
+#define NUM_VECTORS (sizeof(kVectors) / sizeof(kVectors[0]))
+#define NUM_MODES   (sizeof(kModes) / sizeof(kModes[0]))
+
+static const uint32_t kRates[] = { 8000, 16000 };
+#define NUM_RATES   (sizeof(kRates) / sizeof(kRates[0]))
+
+// digests at DEFAULT_SECONDS and DEFAULT_BLOCK, per rate and vector: the
+// input, then the output of each mode
+struct Reference {
+    uint32_t input;
+    uint32_t output[NUM_MODES];
+};
+
+static const Reference kReferences[NUM_RATES][NUM_VECTORS] = {
+    {   // 8000
+        { 0xdd4a9214, { 0xa2bc48b2, 0x66f1ae54, 0x6ff841b0 } },
+        { 0x2dcba9b5, { 0x675777b1, 0xb266c926, 0x43f6475c } },
+        { 0xf2817062, { 0x810e2495, 0x5f819c5c, 0xe9114781 } },
+        { 0xb6ed6a1b, { 0xeb80b056, 0x5228bb31, 0xdc519386 } },
+    },
+    {   // 16000
+        { 0x2eddfb0b, { 0x6d03aafb, 0x5fa8f6e0, 0x5489c146 } },
+        { 0x4cb74084, { 0x49b7252d, 0x109ea7d0, 0x0d5ab0b6 } },
+        { 0xc3b5fb84, { 0xac97aa0b, 0x1483a4e8, 0x88a389f6 } },
+        { 0x1b421289, { 0xe0ded0b5, 0x3a173e04, 0x7c292691 } },
+    },
+};
+
+struct Stats {
+    double pauseSum;
+    double burstSum;
+    size_t pauseCnt;
+    size_t burstCnt;
+};
+
+static uint32_t sSeed;
+
+static double noise()
+{
+    // uniform, unit variance
+    sSeed = sSeed * 1664525 + 1013904223;
+    return ((double)(sSeed >> 8) / (1 << 24) - 0.5) * sqrt(12.0);
+}
+
+static double dbToAmp(double db)
+{
+    return 32767.0 * pow(10.0, db / 20.0);
+}
+
+static bool inBurst(size_t i, uint32_t rate)
+{
+    size_t ms = (i * 1000 / rate) % (BURST_MS + PAUSE_MS);
+    return ms < BURST_MS;
+}
+
+static int region(size_t i, uint32_t rate)
+{
+    size_t t = i * 1000 / rate;
+    size_t ms = t % (BURST_MS + PAUSE_MS);
+    if (t < WARMUP_MS)
+        return 0;
+    if (ms >= SETTLE_MS && ms < BURST_MS - SETTLE_MS)
+        return 1;
+    if (ms >= BURST_MS + SETTLE_MS && ms < BURST_MS + PAUSE_MS - SETTLE_MS)
+        return -1;
+    return 0;
+}
+
+static void synthesize(const Vector *v, uint32_t rate, int16_t *out, size_t frames)
+{
+    // a 140Hz voice with five harmonics and a 4Hz syllable envelope
+    static const double kHarmonics[] = { 1.0, 0.7, 0.5, 0.35, 0.2 };
+    double norm = 0;
+    for (size_t h = 0; h < sizeof(kHarmonics) / sizeof(kHarmonics[0]); h++)
+        norm += kHarmonics[h] * kHarmonics[h] / 2;
+    double speechAmp = dbToAmp(v->speechDb) / sqrt(norm * 0.5);
+    double noiseAmp = dbToAmp(v->noiseDb);
+    double humAmp = dbToAmp(v->humDb) * sqrt(2.0);
+
+    sSeed = 0x5ec0ce;
+    for (size_t i = 0; i < frames; i++) {
+        double t = (double)i / rate;
+        double s = 0;
+        if (inBurst(i, rate)) {
+            double env = 0.5 - 0.5 * cos(2 * M_PI * 4.0 * t);
+            for (size_t h = 0; h < sizeof(kHarmonics) / sizeof(kHarmonics[0]); h++)
+                s += kHarmonics[h] * sin(2 * M_PI * 140.0 * (h + 1) * t);
+            s *= speechAmp * env;
+        }
+        s += noiseAmp * noise() + humAmp * sin(2 * M_PI * 100.0 * t);
+        if (s > 32767)
+            s = 32767;
+        if (s < -32768)
+            s = -32768;
+        out[i] = (int16_t)lrint(s);
+    }
+}
+
+static void measure(const int16_t *buf, size_t frames, uint32_t rate, Stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    for (size_t i = 0; i < frames; i++) {
+        double s = (double)buf[i] * buf[i];
+        switch (region(i, rate)) {
+        case 1:
+            st->burstSum += s;
+            st->burstCnt++;
+            break;
+        case -1:
+            st->pauseSum += s;
+            st->pauseCnt++;
+            break;
+        }
+    }
+}
+
+static double levelDb(double sum, size_t cnt)
+{
+    if (cnt == 0 || sum <= 0)
+        return -99.0;
+    return 10.0 * log10(sum / cnt / (32767.0 * 32767.0));
+}
+
+static double cpuSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t digest(const int16_t *buf, size_t frames)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < frames * sizeof(int16_t); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void writeRaw(const char *prefix, const char *vector, const char *mode,
+                     uint32_t rate, const int16_t *buf, size_t frames)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s-%s-%s-%u.raw", prefix, vector, mode, rate);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return;
+    }
+    fwrite(buf, sizeof(int16_t), frames, fp);
+    fclose(fp);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: voiceproc_bench [-s seconds] [-r 8000|16000] [-b block] "
+                    "[-w prefix]\n");
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = DEFAULT_SECONDS;
+    uint32_t onlyRate = 0;
+    size_t block = DEFAULT_BLOCK;
+    const char *prefix = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:r:b:w:")) != -1) {
+        switch (c) {
+        case 's': seconds = atoi(optarg); break;
+        case 'r': onlyRate = atoi(optarg); break;
+        case 'b': block = atoi(optarg); break;
+        case 'w': prefix = optarg; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (seconds * 1000 <= WARMUP_MS || block == 0) {
+        usage();
+        return 1;
+    }
+
+    bool check = seconds == DEFAULT_SECONDS && block == DEFAULT_BLOCK;
+    int mismatches = 0;
+
+    if (!check)
+        fprintf(stderr, "voiceproc_bench: digests are only checked at -s %d -b %d\n",
+                DEFAULT_SECONDS, DEFAULT_BLOCK);
+
+    printf("%-13s %-6s %5s %8s %8s %8s %8s %8s %6s %8s %s\n",
+           "vector", "mode", "rate", "ms/s", "pause_in", "pause", "burst_in", "burst",
+           "clip", "digest", "check");
+
+    for (size_t r = 0; r < NUM_RATES; r++) {
+        uint32_t rate = kRates[r];
+        if (onlyRate != 0 && rate != onlyRate)
+            continue;
+
+        size_t frames = (size_t)seconds * rate;
+        int16_t *in = new int16_t[frames];
+        int16_t *out = new int16_t[frames];
+
+        for (size_t v = 0; v < NUM_VECTORS; v++) {
+            const Vector *vec = &kVectors[v];
+            const Reference *ref = &kReferences[r][v];
+            Stats before;
+
+            synthesize(vec, rate, in, frames);
+            measure(in, frames, rate, &before);
+
+            bool inputOk = true;
+            if (check && digest(in, frames) != ref->input) {
+                fprintf(stderr, "voiceproc_bench: %s %u input %08x, expected %08x\n",
+                        vec->name, rate, digest(in, frames), ref->input);
+                inputOk = false;
+                mismatches++;
+            }
+
+            for (size_t m = 0; m < NUM_MODES; m++) {
+                SecVoiceProcessor proc;
+                Stats after;
+                size_t clipped = 0;
+
+                proc.init(rate);
+                proc.setNsEnabled(kModes[m].ns);
+                proc.setAgcEnabled(kModes[m].agc);
+                memcpy(out, in, frames * sizeof(int16_t));
+
+                double start = cpuSeconds();
+                for (size_t i = 0; i < frames; i += block) {
+                    size_t count = frames - i < block ? frames - i : block;
+                    proc.process(out + i, count);
+                }
+                double cpu = cpuSeconds() - start;
+
+                measure(out, frames, rate, &after);
+                for (size_t i = 0; i < frames; i++) {
+                    if (out[i] == 32767 || out[i] == -32768)
+                        clipped++;
+                }
+
+                uint32_t outDigest = digest(out, frames);
+                const char *result = "-";
+                if (check && inputOk) {
+                    if (outDigest == ref->output[m]) {
+                        result = "ok";
+                    } else {
+                        result = "FAIL";
+                        mismatches++;
+                    }
+                }
+
+                printf("%-13s %-6s %5u %8.3f %8.1f %8.1f %8.1f %8.1f %6zu %08x %s\n",
+                       vec->name, kModes[m].name, rate, cpu * 1000.0 / seconds,
+                       levelDb(before.pauseSum, before.pauseCnt),
+                       levelDb(after.pauseSum, after.pauseCnt),
+                       levelDb(before.burstSum, before.burstCnt),
+                       levelDb(after.burstSum, after.burstCnt),
+                       clipped, outDigest, result);
+
+                if (prefix != NULL)
+                    writeRaw(prefix, vec->name, kModes[m].name, rate, out, frames);
+            }
+        }
+
+        delete[] in;
+        delete[] out;
+    }
+
+    if (mismatches > 0) {
+        fprintf(stderr, "voiceproc_bench: %d digests differ from the references\n", mismatches);
+        return 2;
+    }
+    return 0;
+}
@@ -15,9 +15,10 @@ LOCAL_SRC_FILES:= \
 	SecCamera.cpp \
 	SecCameraHWInterface.cpp \
 	SecCameraUtils.cpp \
+	SecYuvTransform.cpp \
 
 LOCAL_SHARED_LIBRARIES:= libutils libcutils libbinder liblog libcamera_client libhardware
-LOCAL_SHARED_LIBRARIES+= libs3cjpeg
+LOCAL_SHARED_LIBRARIES+= libs3cjpeg libhaltrace libhalsched
 
 LOCAL_MODULE := camera.s5pc110
 
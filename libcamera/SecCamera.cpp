@@ -28,6 +28,7 @@
 #define LOG_TAG "SecCamera"
 
 #include <utils/Log.h>
+#include <cutils/atomic.h>
 
 #include <math.h>
 #include <string.h>
@@ -532,6 +533,8 @@ SecCamera::SecCamera() :
             m_camera_id(CAMERA_ID_BACK),
             m_cam_fd(-1),
             m_cam_fd2(-1),
+            m_record_buffers(MAX_BUFFERS),
+            m_record_held(0),
             m_preview_v4lformat(V4L2_PIX_FMT_NV21),
             m_preview_width      (0),
             m_preview_height     (0),
@@ -543,6 +546,7 @@ SecCamera::SecCamera() :
             m_snapshot_max_width  (MAX_BACK_CAMERA_SNAPSHOT_WIDTH),
             m_snapshot_max_height (MAX_BACK_CAMERA_SNAPSHOT_HEIGHT),
             m_angle(-1),
+            m_flip(SEC_YUV_FLIP_NONE),
             m_anti_banding(-1),
             m_wdr(-1),
             m_anti_shake(-1),
@@ -856,6 +860,59 @@ int SecCamera::startPreview(void)
     return 0;
 }
 
+/*
+ * Preview again right after a capture of the back camera. The capture ran
+ * S_FMT and REQBUFS for the JPEG on this same node, so the preview format
+ * and buffers are set up again; everything else startPreview() writes is
+ * still held by the ISP from before the capture and is skipped, as is the
+ * wait for the first frame, which the preview loop drops anyway. Only the
+ * frame rate, which the caller may have changed, and the stream parameters
+ * are written.
+ */
+int SecCamera::resumePreview(void)
+{
+    ALOGV("%s :", __func__);
+
+    if (m_flag_camera_start > 0) {
+        ALOGE("ERR(%s):Preview was already started\n", __func__);
+        return 0;
+    }
+
+    if (m_cam_fd <= 0 || m_camera_id != CAMERA_ID_BACK) {
+        ALOGE("ERR(%s):Camera was closed or isn't the back camera\n", __func__);
+        return -1;
+    }
+
+    int ret = fimc_v4l2_s_fmt(m_cam_fd, m_preview_width, m_preview_height,
+                              m_preview_v4lformat, 0);
+    CHECK(ret);
+    ret = fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, MAX_BUFFERS);
+    CHECK(ret);
+
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        ret = fimc_v4l2_qbuf(m_cam_fd, i);
+        CHECK(ret);
+    }
+
+    ret = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_FRAME_RATE,
+                           m_params->capture.timeperframe.denominator);
+    CHECK(ret);
+
+    ret = fimc_v4l2_streamon(m_cam_fd);
+    CHECK(ret);
+
+    m_flag_camera_start = 1;
+
+    ret = fimc_v4l2_s_parm(m_cam_fd, &m_streamparm);
+    CHECK(ret);
+
+    /* the lens is where the capture left it */
+    ret = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_RETURN_FOCUS, 0);
+    CHECK(ret);
+
+    return 0;
+}
+
 int SecCamera::stopPreview(void)
 {
     int ret;
@@ -927,14 +984,19 @@ int SecCamera::startRecord(void)
                             m_params->capture.timeperframe.denominator);
     CHECK(ret);
 
-    ret = fimc_v4l2_reqbufs(m_cam_fd2, V4L2_BUF_TYPE_VIDEO_CAPTURE, MAX_BUFFERS);
+    ret = fimc_v4l2_reqbufs(m_cam_fd2, V4L2_BUF_TYPE_VIDEO_CAPTURE, m_record_buffers);
     CHECK(ret);
+    if (ret < m_record_buffers) {
+        ALOGW("%s: %d record buffers instead of %d", __func__, ret, m_record_buffers);
+        m_record_buffers = ret;
+    }
 
     /* start with all buffers in queue */
-    for (i = 0; i < MAX_BUFFERS; i++) {
+    for (i = 0; i < m_record_buffers; i++) {
         ret = fimc_v4l2_qbuf(m_cam_fd2, i);
         CHECK(ret);
     }
+    android_atomic_release_store(0, &m_record_held);
 
     ret = fimc_v4l2_streamon(m_cam_fd2);
     CHECK(ret);
@@ -988,6 +1050,7 @@ int SecCamera::stopRecord(void)
     }
 
     m_flag_record_start = 0;
+    android_atomic_release_store(0, &m_record_held);
 
     ret = fimc_v4l2_streamoff(m_cam_fd2);
     CHECK(ret);
@@ -1096,7 +1159,10 @@ int SecCamera::getRecordFrame()
     }
 
     previewPoll(false);
-    return fimc_v4l2_dqbuf(m_cam_fd2);
+    int index = fimc_v4l2_dqbuf(m_cam_fd2);
+    if (index >= 0)
+        android_atomic_inc(&m_record_held);
+    return index;
 }
 
 int SecCamera::releaseRecordFrame(int index)
@@ -1112,7 +1178,32 @@ int SecCamera::releaseRecordFrame(int index)
         return 0;
     }
 
-    return fimc_v4l2_qbuf(m_cam_fd2, index);
+    int ret = fimc_v4l2_qbuf(m_cam_fd2, index);
+    if (ret == 0)
+        android_atomic_dec(&m_record_held);
+    return ret;
+}
+
+/* takes effect with the next startRecord() */
+int SecCamera::setRecordBufferCount(int count)
+{
+    if (count < 2 || count > MAX_BUFFERS) {
+        ALOGE("ERR(%s):Invalid record buffer count(%d)", __func__, count);
+        return -1;
+    }
+    m_record_buffers = count;
+    return 0;
+}
+
+int SecCamera::getRecordBufferCount(void)
+{
+    return m_record_buffers;
+}
+
+/* when it's m_record_buffers, fimc has nowhere to put the next frame */
+int SecCamera::getRecordFramesHeld(void)
+{
+    return android_atomic_acquire_load(&m_record_held);
 }
 
 int SecCamera::setPreviewSize(int width, int height, int pixel_format)
@@ -1434,7 +1525,7 @@ int SecCamera::getPostViewOffset(void)
 }
 
 int SecCamera::getSnapshotAndJpeg(unsigned char *yuv_buf, unsigned char *jpeg_buf,
-                                            unsigned int *output_size)
+                                            unsigned int jpeg_buf_size, unsigned int *output_size)
 {
     ALOGV("%s :", __func__);
 
@@ -1527,7 +1618,20 @@ int SecCamera::getSnapshotAndJpeg(unsigned char *yuv_buf, unsigned char *jpeg_bu
     LOG_CAMERA("getSnapshotAndJpeg intervals : stopPreview(%lu), prepare(%lu),"
                 " capture(%lu), memcpy(%lu), yuv2Jpeg(%lu), post(%lu)  us",
                     LOG_TIME(0), LOG_TIME(1), LOG_TIME(2), LOG_TIME(3), LOG_TIME(4), LOG_TIME(5));
-    /* JPEG encoding */
+
+    return encodeJpeg(yuv_buf, jpeg_buf, jpeg_buf_size, output_size);
+}
+
+/*
+ * Encodes a snapshot-sized YUV frame into jpeg_buf.  A JPEG that doesn't
+ * fit isn't copied: -1 comes back with *output_size set to what it needs,
+ * and the frame can be encoded again into a bigger buffer.
+ */
+int SecCamera::encodeJpeg(unsigned char *yuv_buf, unsigned char *jpeg_buf,
+                          unsigned int jpeg_buf_size, unsigned int *output_size)
+{
+    ALOGV("%s :", __func__);
+
     JpegEncoder jpgEnc;
     int inFormat = JPG_MODESEL_YCBCR;
     int outFormat = JPG_422;
@@ -1591,6 +1695,13 @@ int SecCamera::getSnapshotAndJpeg(unsigned char *yuv_buf, unsigned char *jpeg_bu
         return -1;
     }
 
+    *output_size = outbuf_size;
+    if (outbuf_size > jpeg_buf_size) {
+        ALOGW("WARN(%s):JPEG of %llu bytes doesn't fit in %u", __func__,
+             outbuf_size, jpeg_buf_size);
+        return -1;
+    }
+
     memcpy(jpeg_buf, pOutBuf, outbuf_size);
 
     return 0;
@@ -1801,13 +1912,6 @@ int SecCamera::SetRotate(int angle)
             ALOGE("ERR(%s):Invalid angle(%d)", __func__, angle);
             return -1;
         }
-
-        if (m_flag_camera_start) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_ROTATION, angle) < 0) {
-                ALOGE("ERR(%s):Fail on V4L2_CID_ROTATION", __func__);
-                return -1;
-            }
-        }
     }
 
     return 0;
@@ -1839,6 +1943,21 @@ int SecCamera::setFrameRate(int frame_rate)
     return 0;
 }
 
+int SecCamera::getFrameRate(void)
+{
+    return m_params->capture.timeperframe.denominator;
+}
+
+/* current exposure time in microseconds, -1 if the sensor can't tell */
+int SecCamera::getShutterSpeed(void)
+{
+    if (!m_flag_camera_start)
+        return -1;
+
+    int shutterSpeed = fimc_v4l2_g_ctrl(m_cam_fd, V4L2_CID_CAMERA_GET_SHT_TIME);
+    return shutterSpeed > 0 ? shutterSpeed : -1;
+}
+
 // -----------------------------------
 
 int SecCamera::setVerticalMirror(void)
@@ -1875,6 +1994,36 @@ int SecCamera::setHorizontalMirror(void)
     return 0;
 }
 
+int SecCamera::setMirror(int flip)
+{
+    ALOGV("%s(flip(%d))", __func__, flip);
+
+    if (flip & ~(SEC_YUV_FLIP_H | SEC_YUV_FLIP_V)) {
+        ALOGE("ERR(%s):Invalid flip(%d)", __func__, flip);
+        return -1;
+    }
+
+    m_flip = flip;
+    return 0;
+}
+
+int SecCamera::getMirror(void)
+{
+    return m_flip;
+}
+
+/*
+ * Rotation and mirroring of the preview callback frames. All of it is done
+ * by the HAL on the frames: the sensor's rotation and flip controls would
+ * also turn the display window, the front camera's snapshot and the
+ * picture EXIF already describes.
+ */
+void SecCamera::getSoftwareTransform(int *angle, int *flip)
+{
+    *angle = m_flag_camera_start && m_angle > 0 ? m_angle : 0;
+    *flip = m_flag_camera_start ? m_flip : SEC_YUV_FLIP_NONE;
+}
+
 // -----------------------------------
 
 int SecCamera::setWhiteBalance(int white_balance)
@@ -2728,12 +2877,26 @@ int SecCamera::setRecordingSize(int width, int height)
 {
      ALOGV("%s(width(%d), height(%d))", __func__, width, height);
 
+     /* fimc scales the record node from the sensor's preview output */
+     if (width <= 0 || height <= 0 ||
+         width > m_preview_max_width || height > m_preview_max_height) {
+         ALOGE("ERR(%s):Invalid recording size(%dx%d), max %dx%d", __func__,
+              width, height, m_preview_max_width, m_preview_max_height);
+         return -1;
+     }
+
      m_recording_width  = width;
      m_recording_height = height;
 
      return 0;
 }
 
+void SecCamera::getRecordingSize(int *width, int *height)
+{
+    *width  = m_recording_width;
+    *height = m_recording_height;
+}
+
 //======================================================================
 
 int SecCamera::setExifOrientationInfo(int orientationInfo)
@@ -41,6 +41,7 @@
 #include <utils/String8.h>
 
 #include "JpegEncoder.h"
+#include "SecYuvTransform.h"
 
 namespace android {
 
@@ -291,12 +292,16 @@ public:
     int             getCameraId(void);
 
     int             startPreview(void);
+    int             resumePreview(void);
     int             stopPreview(void);
 
     int             startRecord(void);
     int             stopRecord(void);
     int             getRecordFrame(void);
     int             releaseRecordFrame(int index);
+    int             setRecordBufferCount(int count);
+    int             getRecordBufferCount(void);
+    int             getRecordFramesHeld(void);
     unsigned int    getRecPhyAddrY(int);
     unsigned int    getRecPhyAddrC(int);
 
@@ -330,6 +335,9 @@ public:
 
     int             setVerticalMirror(void);
     int             setHorizontalMirror(void);
+    int             setMirror(int flip);
+    int             getMirror(void);
+    void            getSoftwareTransform(int *angle, int *flip);
 
     int             setWhiteBalance(int white_balance);
     int             getWhiteBalance(void);
@@ -408,6 +416,7 @@ public:
     int             setAntiBanding(int anti_banding);
     int             getPostview(void);
     int             setRecordingSize(int width, int height);
+    void            getRecordingSize(int *width, int *height);
     int             setGamma(int gamma);
     int             setSlowAE(int slow_ae);
     int             setExifOrientationInfo(int orientationInfo);
@@ -434,9 +443,13 @@ public:
 #endif // ENABLE_ESD_PREVIEW_CHECK
 
     int setFrameRate(int frame_rate);
+    int             getFrameRate(void);
+    int             getShutterSpeed(void);
     unsigned char*  getJpeg(int*, unsigned int*);
     int             getSnapshotAndJpeg(unsigned char *yuv_buf, unsigned char *jpeg_buf,
-                                        unsigned int *output_size);
+                                        unsigned int jpeg_buf_size, unsigned int *output_size);
+    int             encodeJpeg(unsigned char *yuv_buf, unsigned char *jpeg_buf,
+                               unsigned int jpeg_buf_size, unsigned int *output_size);
     int             getExif(unsigned char *pExifDst, unsigned char *pThumbSrc);
 
     void            getPostViewConfig(int*, int*, int*);
@@ -497,6 +510,8 @@ private:
     int             m_cam_fd2;
     struct pollfd   m_events_c2;
     int             m_flag_record_start;
+    int             m_record_buffers;   /* queued at startRecord() */
+    volatile int32_t m_record_held;     /* dequeued and not released yet */
 
     int             m_preview_v4lformat;
     int             m_preview_width;
@@ -511,6 +526,7 @@ private:
     int             m_snapshot_max_height;
 
     int             m_angle;
+    int             m_flip;         /* SEC_YUV_FLIP_* */
     int             m_anti_banding;
     int             m_wdr;
     int             m_anti_shake;
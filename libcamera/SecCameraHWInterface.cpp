@@ -26,9 +26,11 @@
 
 #include <utils/threads.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <camera/Camera.h>
 #include <MetadataBufferType.h>
+#include <haltrace.h>
 
 #define VIDEO_COMMENT_MARKER_H          0xFFBE
 #define VIDEO_COMMENT_MARKER_L          0xFFBF
@@ -55,6 +57,8 @@
 // -- we only support two preview color formats that client
 //    applications can set: NV21 and YUV420/YV12.
 
+HALTRACE_COLDSTART_MODULE(CAMERA)
+
 namespace android {
 
 struct addrs {
@@ -79,6 +83,32 @@ gralloc_module_t const* CameraHardwareSec::mGrallocHal;
 // Samsung-specific focus mode
 const char FOCUS_MODE_FACEDETECT[] = "facedetect";
 
+// orientation applied in software to preview callback frames only
+const char KEY_PREVIEW_FRAME_ROTATION[] = "preview-frame-rotation";
+const char KEY_PREVIEW_FRAME_MIRROR[] = "preview-frame-mirror";
+const char KEY_SUPPORTED_PREVIEW_FRAME_MIRROR[] = "preview-frame-mirror-values";
+
+// milliseconds between recorded frames, 0 for normal recording. Frames keep
+// their real timestamps, at least this far apart, so MediaRecorder's own
+// time lapse (CameraSourceTimeLapse) can still pick and respace them
+const char KEY_TIME_LAPSE_INTERVAL[] = "time-lapse-interval";
+
+// record buffers queued to fimc, more ride out a slow encoder for longer
+const char KEY_RECORD_BUFFER_COUNT[] = "record-buffer-count";
+const char KEY_MAX_RECORD_BUFFER_COUNT[] = "max-record-buffer-count";
+
+// viewfinder frames per second while recording, 0 for every sensor frame
+const char KEY_RECORDING_PREVIEW_FRAME_RATE[] = "recording-preview-frame-rate";
+
+// back camera, on by default: preview starts again by itself once a picture
+// is taken, the app's startPreview() after the JPEG callback then returns at
+// once
+const char KEY_PREVIEW_RESUME_AFTER_CAPTURE[] = "preview-resume-after-capture";
+
+// the front sensor has no zoom, these are cropped and scaled in software
+static const int kFrontZoomRatios[] = { 100, 125, 150, 175, 200 };
+static const int kFrontZoomLevels = sizeof(kFrontZoomRatios) / sizeof(kFrontZoomRatios[0]);
+
 CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
         :
           mCaptureInProgress(false),
@@ -91,9 +121,34 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
           mCallbackCookie(0),
           mMsgEnabled(0),
           mRecordRunning(false),
+          mTimeLapseInterval(0),
+          mTimeLapseNextCapture(0),
+          mTimeLapseFrames(0),
+          mTimeLapseSkipped(0),
+          mTimeLapseSavedFps(0),
+          mRecordSavedFps(0),
+          mRecordPreviewInterval(0),
+          mRecordPreviewNext(0),
+          mRecordPreviewSkipped(0),
           mPostViewWidth(0),
           mPostViewHeight(0),
           mPostViewSize(0),
+          mPreviewTransformBuf(NULL),
+          mPreviewTransformSize(0),
+          mCallbackHeap(NULL),
+          mCallbackFrames(0),
+          mCallbackDrops(0),
+          mDigitalZoomLevel(0),
+          mDigitalZoomRatio(100),
+          mPreviewResumeEnabled(false),
+          mPreviewResumePending(false),
+          mPreviewResumed(false),
+          mPreviewResumeStart(0),
+          mPreviewResumes(0),
+          mPreviewResumeFailures(0),
+          mPreviewResumeTotal(0),
+          mPreviewResumeMax(0),
+          mFpsRangeSet(false),
           mHalDevice(dev)
 {
     ALOGV("%s :", __func__);
@@ -163,14 +218,23 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
               "1280x720,800x480,720x480,640x480,592x480,352x288,176x144");
         p.set(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES,
               "2560x1920,2560x1536,2048x1536,2048x1232,1600x1200,1600x960,800x480,640x480");
+        /* the record node scales down from the sensor's preview output, so
+         * video can be smaller than the preview but never larger */
+        p.set(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES,
+              "1280x720,800x480,720x480,640x480,352x288,176x144");
+        p.set(CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, "1280x720");
     } else {
         p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
               "640x480,320x240,176x144");
         p.set(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES,
               "640x480");
+        p.set(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES,
+              "640x480,320x240,176x144");
+        p.set(CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, "640x480");
     }
 
     p.getSupportedPreviewSizes(mSupportedPreviewSizes);
+    p.getSupportedVideoSizes(mSupportedVideoSizes);
 
     // If these fail, then we are using an invalid cameraId and we'll leave the
     // sizes at zero to catch the error.
@@ -190,6 +254,7 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
     p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FORMATS, previewColorString.string());
     p.set(CameraParameters::KEY_VIDEO_FRAME_FORMAT, CameraParameters::PIXEL_FORMAT_YUV420P);
     p.setPreviewSize(preview_max_width, preview_max_height);
+    p.setVideoSize(preview_max_width, preview_max_height);
 
     p.setPictureFormat(CameraParameters::PIXEL_FORMAT_JPEG);
     p.setPictureSize(snapshot_max_width, snapshot_max_height);
@@ -282,11 +347,21 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
         p.set(CameraParameters::KEY_MAX_ZOOM, "12");
         p.set(CameraParameters::KEY_ZOOM_RATIOS, "100,125,150,175,200,225,250,275,300,325,350,375,400");
         p.set(CameraParameters::KEY_ZOOM_SUPPORTED, CameraParameters::TRUE);
+        p.set(CameraParameters::KEY_SMOOTH_ZOOM_SUPPORTED, CameraParameters::TRUE);
     } else {
         p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, "(7500,30000)");
         p.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, "7500,30000");
 
         p.set(CameraParameters::KEY_FOCAL_LENGTH, "0.9");
+
+        String8 ratios;
+        for (int i = 0; i < kFrontZoomLevels; i++)
+            ratios.appendFormat(i ? ",%d" : "%d", kFrontZoomRatios[i]);
+        p.set(CameraParameters::KEY_ZOOM, "0");
+        p.set(CameraParameters::KEY_MAX_ZOOM, kFrontZoomLevels - 1);
+        p.set(CameraParameters::KEY_ZOOM_RATIOS, ratios.string());
+        p.set(CameraParameters::KEY_ZOOM_SUPPORTED, CameraParameters::TRUE);
+        p.set(CameraParameters::KEY_SMOOTH_ZOOM_SUPPORTED, CameraParameters::TRUE);
     }
 
     parameterString = CameraParameters::WHITE_BALANCE_AUTO;
@@ -330,6 +405,17 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
     p.set("iso-values", "auto,ISO50,ISO100,ISO200,ISO400,ISO800,ISO1600,ISO_SPORTS,ISO_NIGHT");
     p.set("iso", "auto");
 
+    p.set(KEY_TIME_LAPSE_INTERVAL, 0);
+    p.set(KEY_RECORD_BUFFER_COUNT, kBufferCountForRecord);
+    p.set(KEY_MAX_RECORD_BUFFER_COUNT, kBufferCountForRecord);
+    p.set(KEY_RECORDING_PREVIEW_FRAME_RATE, 0);
+    if (cameraId == SecCamera::CAMERA_ID_BACK)
+        p.set(KEY_PREVIEW_RESUME_AFTER_CAPTURE, CameraParameters::TRUE);
+
+    p.set(KEY_PREVIEW_FRAME_ROTATION, 0);
+    p.set(KEY_SUPPORTED_PREVIEW_FRAME_MIRROR, "off,horizontal,vertical");
+    p.set(KEY_PREVIEW_FRAME_MIRROR, "off");
+
     p.set(CameraParameters::KEY_HORIZONTAL_VIEW_ANGLE, "51.2");
     p.set(CameraParameters::KEY_VERTICAL_VIEW_ANGLE, "39.4");
 
@@ -361,6 +447,7 @@ CameraHardwareSec::~CameraHardwareSec()
 {
     ALOGV("%s", __func__);
     mSecCamera->DeinitCamera();
+    free(mPreviewTransformBuf);
 }
 
 status_t CameraHardwareSec::setPreviewWindow(preview_stream_ops *w)
@@ -497,17 +584,68 @@ int CameraHardwareSec::previewThreadWrapper()
             mSecCamera->stopPreview();
             return 0;
         }
-        previewThread();
+        nsecs_t cpuStart = systemTime(SYSTEM_TIME_THREAD);
+        HALTRACE_BEGIN(CAMERA_PREVIEW_FRAME, 0, 0);
+        int err = previewThread();
+        HALTRACE_END(CAMERA_PREVIEW_FRAME, err, 0);
+        updatePreviewFrameRate(systemTime(SYSTEM_TIME_THREAD) - cpuStart);
+        updateZoom();
     }
 }
 
+void CameraHardwareSec::updatePreviewFrameRate(nsecs_t cpuTime)
+{
+    mRecordLock.lock();
+    bool recording = mRecordRunning;
+    mRecordLock.unlock();
+
+    Mutex::Autolock lock(mFpsGovernorLock);
+
+    /* recording runs at the rate the camcorder asked for */
+    if (recording || !mFpsGovernor.isEnabled())
+        return;
+
+    if (mFpsGovernor.needsExposure())
+        mFpsGovernor.onExposure(mSecCamera->getShutterSpeed());
+
+    int fps = mFpsGovernor.onFrame(systemTime(SYSTEM_TIME_MONOTONIC), cpuTime);
+    if (fps > 0) {
+        ALOGD("%s: preview frame rate %d -> %d", __func__,
+             mSecCamera->getFrameRate(), fps);
+        if (mSecCamera->setFrameRate(fps) < 0)
+            ALOGE("ERR(%s):Fail on mSecCamera->setFrameRate(%d)", __func__, fps);
+    }
+}
+
+void CameraHardwareSec::updateZoom()
+{
+    bool notify, stopped;
+
+    mZoomLock.lock();
+    int level = mZoom.onFrame(&notify, &stopped);
+    int reported = mZoom.getLevel();
+    mZoomLock.unlock();
+
+    if (level < 0) {
+        /* nothing to write */
+    } else if (mSecCamera->getCameraId() == SecCamera::CAMERA_ID_FRONT) {
+        /* read by the next frame of this same loop */
+        mDigitalZoomLevel = level < kFrontZoomLevels ? level : kFrontZoomLevels - 1;
+        mDigitalZoomRatio = kFrontZoomRatios[mDigitalZoomLevel];
+    } else if (mSecCamera->setZoom(level) < 0) {
+        ALOGE("ERR(%s):Fail on mSecCamera->setZoom(%d)", __func__, level);
+    }
+
+    if (notify && (mMsgEnabled & CAMERA_MSG_ZOOM))
+        mNotifyCb(CAMERA_MSG_ZOOM, reported, stopped, mCallbackCookie);
+}
+
 int CameraHardwareSec::previewThread()
 {
     int index;
     nsecs_t timestamp;
     unsigned int phyYAddr;
     unsigned int phyCAddr;
-    struct addrs *addrs;
 
     index = mSecCamera->getPreview();
     if (index < 0) {
@@ -528,6 +666,12 @@ int CameraHardwareSec::previewThread()
 
     timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
+    if (mPreviewResumeStart)
+        updatePreviewResume(timestamp);
+
+    if (skipPreviewWhileRecording(timestamp))
+        return recordFrame(timestamp);
+
     phyYAddr = mSecCamera->getPhyAddrY(index);
     phyCAddr = mSecCamera->getPhyAddrC(index);
 
@@ -559,7 +703,25 @@ int CameraHardwareSec::previewThread()
             char *frame = ((char *)mPreviewHeap->data) + offset;
 
             // the code below assumes YUV, not RGB
-            {
+            if (mDigitalZoomRatio > 100) {
+                // the zoom replaces the copy, same layout as below
+                SecYuvCrop crop, cropC;
+                secZoomCrop(width, height, mDigitalZoomRatio, &crop);
+                cropC.x = crop.x / 2;
+                cropC.y = crop.y / 2;
+                cropC.width = crop.width / 2;
+                cropC.height = crop.height / 2;
+
+                uint8_t *src = (uint8_t *)frame;
+                uint8_t *ptr = (uint8_t *)vaddr;
+                uint8_t *v = ptr + stride * height;
+                uint8_t *u = v + stride * height / 4;
+                secScalePlane8(src, width, crop, ptr, stride, width, height);
+                src += width * height;
+                secScalePlane8(src, width / 2, cropC, u, stride / 2, width / 2, height / 2);
+                src += width * height / 4;
+                secScalePlane8(src, width / 2, cropC, v, stride / 2, width / 2, height / 2);
+            } else {
                 int h;
                 char *src = frame;
                 char *ptr = (char *)vaddr;
@@ -604,34 +766,142 @@ int CameraHardwareSec::previewThread()
 callbacks:
     // Notify the client of a new frame.
     if (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) {
+        int angle, flip;
+        uint8_t *frame = (uint8_t *)mPreviewHeap->data + offset;
+        bool zoom = mDigitalZoomRatio > 100;
         const char * preview_format = mParameters.getPreviewFormat();
-        if (!strcmp(preview_format, CameraParameters::PIXEL_FORMAT_YUV420SP)) {
-            // Color conversion from YUV420 to NV21
-            char *vu = ((char *)mPreviewHeap->data) + offset + width * height;
-            const int uv_size = (width * height) >> 1;
-            char saved_uv[uv_size];
-            memcpy(saved_uv, vu, uv_size);
-            char *u = saved_uv;
-            char *v = u + (uv_size >> 1);
-
-            int h = 0;
-            while (h < width * height / 4) {
-                *vu++ = *v++;
-                *vu++ = *u++;
-                ++h;
+        int format = strcmp(preview_format, CameraParameters::PIXEL_FORMAT_YUV420SP) ?
+                     SEC_YUV_PLANAR : SEC_YUV_SEMIPLANAR;
+
+        // 90/270 deliver height x width
+        mSecCamera->getSoftwareTransform(&angle, &flip);
+        bool orient = angle || flip;
+
+        /* an oriented frame for the zoom to read, or the chroma packed
+         * into NV21 */
+        int scratch_size = (width * height) >> 2;
+        if (zoom && orient)
+            scratch_size = (width * height * 3) >> 1;
+        else if (orient)
+            scratch_size = (width * height) >> 1;
+        if (mPreviewTransformSize < scratch_size) {
+            free(mPreviewTransformBuf);
+            mPreviewTransformBuf = (uint8_t *)malloc(scratch_size);
+            mPreviewTransformSize = mPreviewTransformBuf ? scratch_size : 0;
+        }
+        if ((zoom || orient) && mCallbackHeap == NULL)
+            mCallbackHeap = mGetMemoryCb(-1, frame_size, kBufferCount, 0);
+
+        camera_memory_t *heap = mPreviewHeap;
+        if (mPreviewTransformBuf == NULL || ((zoom || orient) && mCallbackHeap == NULL)) {
+            /* nowhere to convert it, the frame is dropped */
+            heap = NULL;
+        } else if (zoom || orient) {
+            // crop, scale, orient and pack in one pass into frames of their own
+            uint8_t *dst = (uint8_t *)mCallbackHeap->data + offset;
+            if (zoom) {
+                const uint8_t *zoomSrc = frame;
+                int zoomWidth = width, zoomHeight = height;
+                // zooming reads the oriented frame where it is
+                if (orient && secYuvTransform(frame, mPreviewTransformBuf, width, height,
+                                              SEC_YUV_PLANAR, angle, flip) == 0) {
+                    zoomSrc = mPreviewTransformBuf;
+                    if (angle == 90 || angle == 270) {
+                        zoomWidth = height;
+                        zoomHeight = width;
+                    }
+                }
+                secYuvZoom(zoomSrc, dst, zoomWidth, zoomHeight, mDigitalZoomRatio, format);
+            } else {
+                secYuvOrient(frame, dst, mPreviewTransformBuf, width, height, format,
+                             angle, flip);
             }
+            heap = mCallbackHeap;
+            mCallbackFrames++;
+        } else if (format == SEC_YUV_SEMIPLANAR) {
+            // Color conversion from YUV420 to NV21
+            secYuvToNV21(frame, mPreviewTransformBuf, width, height);
+        }
+
+        if (heap != NULL) {
+            HALTRACE_BEGIN(CAMERA_PREVIEW_CALLBACK, index, 0);
+            mDataCb(CAMERA_MSG_PREVIEW_FRAME, heap, index, NULL, mCallbackCookie);
+            HALTRACE_END(CAMERA_PREVIEW_CALLBACK, index, 0);
+        } else {
+            mCallbackDrops++;
         }
-        mDataCb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, index, NULL, mCallbackCookie);
     }
 
+    return recordFrame(timestamp);
+}
+
+/*
+ * While recording, the viewfinder skips the copy and callbacks of frames
+ * that come sooner than its own rate asks; the record node still gets
+ * every one.
+ */
+bool CameraHardwareSec::skipPreviewWhileRecording(nsecs_t timestamp)
+{
+    Mutex::Autolock lock(mRecordLock);
+
+    if (!mRecordRunning || mRecordPreviewInterval == 0)
+        return false;
+
+    /* a quarter interval early still counts, frames come with jitter */
+    if (timestamp < mRecordPreviewNext - mRecordPreviewInterval / 4) {
+        mRecordPreviewSkipped++;
+        return true;
+    }
+    mRecordPreviewNext += mRecordPreviewInterval;
+    if (mRecordPreviewNext <= timestamp)
+        mRecordPreviewNext = timestamp + mRecordPreviewInterval;
+    return false;
+}
+
+int CameraHardwareSec::recordFrame(nsecs_t timestamp)
+{
+    int index;
+    unsigned int phyYAddr;
+    unsigned int phyCAddr;
+    struct addrs *addrs;
+
     Mutex::Autolock lock(mRecordLock);
     if (mRecordRunning == true) {
+        /* with every buffer out at the encoder fimc has nowhere to put this
+         * frame, don't hold preview up polling for it */
+        int held = mSecCamera->getRecordFramesHeld();
+        int fps = mRecordMonitor.onFrame(held);
+        if (fps > 0) {
+            ALOGW("%s: encoder %s, record frame rate %d -> %d", __func__,
+                 fps < mSecCamera->getFrameRate() ? "falling behind" : "caught up",
+                 mSecCamera->getFrameRate(), fps);
+            if (mSecCamera->setFrameRate(fps) < 0)
+                ALOGE("ERR(%s):Fail on mSecCamera->setFrameRate(%d)", __func__, fps);
+        }
+        if (mRecordMonitor.isStarved(held)) {
+            HALTRACE_INSTANT(CAMERA_RECORD_STARVED, held, 0);
+            return NO_ERROR;
+        }
+
         index = mSecCamera->getRecordFrame();
         if (index < 0) {
             ALOGE("ERR(%s):Fail on SecCamera->getRecord()", __func__);
             return UNKNOWN_ERROR;
         }
 
+        if (mTimeLapseInterval > 0) {
+            /* hand frames between captures straight back to the driver */
+            if (timestamp < mTimeLapseNextCapture) {
+                mSecCamera->releaseRecordFrame(index);
+                mTimeLapseSkipped++;
+                return NO_ERROR;
+            }
+            /* counted from the frame taken, not a fixed grid: a time lapse
+             * above us drops any frame closer than its interval to the last */
+            mTimeLapseNextCapture = timestamp + mTimeLapseInterval;
+            mTimeLapseFrames++;
+        }
+
         phyYAddr = mSecCamera->getRecPhyAddrY(index);
         phyCAddr = mSecCamera->getRecPhyAddrC(index);
 
@@ -665,6 +935,7 @@ status_t CameraHardwareSec::startPreview()
     int ret = 0;        //s1 [Apply factory standard]
 
     ALOGV("%s :", __func__);
+    HALTRACE_COLDSTART_USE(CAMERA);
 
     if (waitCaptureCompletion() != NO_ERROR) {
         return TIMED_OUT;
@@ -672,6 +943,12 @@ status_t CameraHardwareSec::startPreview()
 
     mPreviewLock.lock();
     if (mPreviewRunning) {
+        if (mPreviewResumed) {
+            /* the picture thread has started it again already */
+            mPreviewResumed = false;
+            mPreviewLock.unlock();
+            return NO_ERROR;
+        }
         // already running
         ALOGE("%s : preview thread already running", __func__);
         mPreviewLock.unlock();
@@ -696,26 +973,46 @@ status_t CameraHardwareSec::startPreview()
     return ret;
 }
 
-status_t CameraHardwareSec::startPreviewInternal()
+/* resume: right after a capture, see resumePreviewAfterCapture() */
+status_t CameraHardwareSec::startPreviewInternal(bool resume)
 {
-    ALOGV("%s", __func__);
+    ALOGV("%s(%d)", __func__, resume);
 
-    int ret  = mSecCamera->startPreview();
+    mFpsGovernorLock.lock();
+    mFpsGovernor.reset(mSecCamera->getFrameRate());
+    mSecCamera->setFrameRate(mFpsGovernor.getFps());
+    mFpsGovernorLock.unlock();
+
+    int ret  = resume ? mSecCamera->resumePreview() : mSecCamera->startPreview();
     ALOGV("%s : mSecCamera->startPreview() returned %d", __func__, ret);
 
     if (ret < 0) {
-        ALOGE("ERR(%s):Fail on mSecCamera->startPreview()", __func__);
+        ALOGE("ERR(%s):Fail on mSecCamera->%s()", __func__,
+             resume ? "resumePreview" : "startPreview");
         return UNKNOWN_ERROR;
     }
 
     setSkipFrame(INITIAL_SKIP_FRAME);
 
+    /* the sensor may have come up at another zoom, restore the app's */
+    mZoomLock.lock();
+    int zoom = mZoom.getLevel();
+    mZoom.reset(mSecCamera->getCameraId() == SecCamera::CAMERA_ID_FRONT ?
+                mDigitalZoomLevel : mSecCamera->getZoom());
+    if (mParameters.get(CameraParameters::KEY_ZOOM_SUPPORTED) &&
+        !strcmp(mParameters.get(CameraParameters::KEY_ZOOM_SUPPORTED), CameraParameters::TRUE))
+        mZoom.setLevel(zoom);
+    mZoomLock.unlock();
+
     int width, height, frame_size;
 
     mSecCamera->getPreviewSize(&width, &height, &frame_size);
 
     ALOGD("mPreviewHeap(fd(%d), size(%d), width(%d), height(%d))",
          mSecCamera->getCameraFd(), frame_size, width, height);
+    /* the same fimc buffers again unless the size changed during the capture */
+    if (resume && mPreviewHeap && mPreviewHeap->size == (size_t)frame_size * kBufferCount)
+        return NO_ERROR;
     if (mPreviewHeap) {
         mPreviewHeap->release(mPreviewHeap);
         mPreviewHeap = 0;
@@ -726,6 +1023,12 @@ status_t CameraHardwareSec::startPreviewInternal()
                                 kBufferCount,
                                 0); // no cookie
 
+    /* sized like mPreviewHeap, the preview loop allocates it again */
+    if (mCallbackHeap) {
+        mCallbackHeap->release(mCallbackHeap);
+        mCallbackHeap = 0;
+    }
+
     mSecCamera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
     ALOGV("CameraHardwareSec: mPostViewWidth = %d mPostViewHeight = %d mPostViewSize = %d",
          mPostViewWidth,mPostViewHeight,mPostViewSize);
@@ -737,6 +1040,9 @@ void CameraHardwareSec::stopPreviewInternal()
 {
     ALOGV("%s :", __func__);
 
+    mPreviewResumePending = false;
+    mPreviewResumed = false;
+
     /* request that the preview thread stop. */
     if (mPreviewRunning) {
         mPreviewRunning = false;
@@ -787,10 +1093,37 @@ status_t CameraHardwareSec::startRecording()
     }
 
     if (mRecordRunning == false) {
+        mRecordPreviewNext = 0;
+        mRecordPreviewSkipped = 0;
+        mTimeLapseNextCapture = 0;
+        mTimeLapseFrames = 0;
+        mTimeLapseSkipped = 0;
+        mTimeLapseSavedFps = 0;
+        if (mTimeLapseInterval > 0) {
+            /* run the sensor no faster than the captures need */
+            int fps = SecFpsGovernor::rateForInterval(mTimeLapseInterval);
+            mTimeLapseSavedFps = mSecCamera->getFrameRate();
+            ALOGD("%s: time-lapse every %lldms, sensor at %dfps", __func__,
+                 mTimeLapseInterval / 1000000LL, fps);
+            mSecCamera->setFrameRate(fps);
+        }
         if (mSecCamera->startRecord() < 0) {
             ALOGE("ERR(%s):Fail on mSecCamera->startRecord()", __func__);
             return UNKNOWN_ERROR;
         }
+
+        /* a slow encoder may take the sensor down to the bottom of the
+         * app's range; time-lapse already runs it as slow as it can */
+        int recordFps = mSecCamera->getFrameRate();
+        int minFps = recordFps;
+        if (mTimeLapseInterval == 0) {
+            int rangeMin, rangeMax;
+            mParameters.getPreviewFpsRange(&rangeMin, &rangeMax);
+            if (rangeMin > 0 && rangeMin / 1000 < recordFps)
+                minFps = rangeMin / 1000;
+        }
+        mRecordMonitor.reset(mSecCamera->getRecordBufferCount(), recordFps, minFps);
+        mRecordSavedFps = recordFps;
         mRecordRunning = true;
     }
     return NO_ERROR;
@@ -808,6 +1141,17 @@ void CameraHardwareSec::stopRecording()
             return;
         }
         mRecordRunning = false;
+        if (mRecordMonitor.getFps() != mRecordSavedFps) {
+            ALOGD("%s: encoder starved %u frames, sensor back to %dfps", __func__,
+                 mRecordMonitor.getStarved(), mRecordSavedFps);
+            mSecCamera->setFrameRate(mRecordSavedFps);
+        }
+        if (mTimeLapseSavedFps > 0) {
+            ALOGD("%s: time-lapse recorded %u frames, skipped %u", __func__,
+                 mTimeLapseFrames, mTimeLapseSkipped);
+            mSecCamera->setFrameRate(mTimeLapseSavedFps);
+            mTimeLapseSavedFps = 0;
+        }
     }
 }
 
@@ -1041,6 +1385,16 @@ bool CameraHardwareSec::YUY2toNV21(void *srcBuf, void *dstBuf, uint32_t srcWidth
     return true;
 }
 
+/* a heap the callback couldn't map is dropped here, *heap is NULL then */
+static bool jpegHeapValid(camera_memory_t **heap)
+{
+    if (*heap != NULL && ((*heap)->data == NULL || (*heap)->data == MAP_FAILED)) {
+        (*heap)->release(*heap);
+        *heap = NULL;
+    }
+    return *heap != NULL;
+}
+
 int CameraHardwareSec::pictureThread()
 {
     ALOGV("%s :", __func__);
@@ -1068,6 +1422,14 @@ int CameraHardwareSec::pictureThread()
         mJpegHeapSize = cap_frame_size * SecCamera::getJpegRatio();
     else
         mJpegHeapSize = cap_frame_size;
+    /* that's the most it can be, what recent captures needed is usually
+     * well under it */
+    int jpegQuality = mSecCamera->getJpegQuality();
+    mJpegSizeLock.lock();
+    mJpegHeapSize = mJpegSizer.estimate(cap_width, cap_height, jpegQuality, mJpegHeapSize);
+    mJpegSizeLock.unlock();
+    int jpegAllocated = mJpegHeapSize;
+    bool jpegRetried = false;
 
     LOG_TIME_DEFINE(0)
     LOG_TIME_START(0)
@@ -1089,6 +1451,11 @@ int CameraHardwareSec::pictureThread()
     int picture_size, picture_width, picture_height;
     mSecCamera->getSnapshotSize(&picture_width, &picture_height, &picture_size);
     int picture_format = mSecCamera->getSnapshotPixelFormat();
+    if (!jpegHeapValid(&JpegHeap)) {
+        ALOGE("ERR(%s):no memory for a %d byte JPEG", __func__, mJpegHeapSize);
+        ret = NO_MEMORY;
+        goto out;
+    }
 
     unsigned int phyAddr;
 
@@ -1106,11 +1473,48 @@ int CameraHardwareSec::pictureThread()
             ret = UNKNOWN_ERROR;
             goto out;
         }
+        if (jpeg_size > mJpegHeapSize) {
+            ALOGW("%s: %d byte JPEG, %d allocated for it", __func__, jpeg_size,
+                 mJpegHeapSize);
+            JpegHeap->release(JpegHeap);
+            mJpegHeapSize = jpeg_size;
+            jpegAllocated += mJpegHeapSize;
+            jpegRetried = true;
+            JpegHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
+            if (!jpegHeapValid(&JpegHeap)) {
+                ALOGE("ERR(%s):no memory for a %d byte JPEG", __func__, mJpegHeapSize);
+                ret = NO_MEMORY;
+                goto out;
+            }
+        }
+        /* out of the capture buffer, so preview can have the node back
+         * before the picture is even delivered */
+        memcpy(JpegHeap->data, jpeg_data, jpeg_size);
+        mSecCamera->endSnapshot();
+        resumePreviewAfterCapture();
     } else {
         if (mSecCamera->getSnapshotAndJpeg((unsigned char*)PostviewHeap->base(),
-                (unsigned char*)JpegHeap->data, &output_size) < 0) {
-            ret = UNKNOWN_ERROR;
-            goto out;
+                (unsigned char*)JpegHeap->data, mJpegHeapSize, &output_size) < 0) {
+            if (output_size <= (unsigned int)mJpegHeapSize) {
+                ret = UNKNOWN_ERROR;
+                goto out;
+            }
+            /* the snapshot is still in PostviewHeap, encode it again */
+            JpegHeap->release(JpegHeap);
+            mJpegHeapSize = output_size;
+            jpegAllocated += mJpegHeapSize;
+            jpegRetried = true;
+            JpegHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
+            if (!jpegHeapValid(&JpegHeap)) {
+                ALOGE("ERR(%s):no memory for a %d byte JPEG", __func__, mJpegHeapSize);
+                ret = NO_MEMORY;
+                goto out;
+            }
+            if (mSecCamera->encodeJpeg((unsigned char*)PostviewHeap->base(),
+                    (unsigned char*)JpegHeap->data, mJpegHeapSize, &output_size) < 0) {
+                ret = UNKNOWN_ERROR;
+                goto out;
+            }
         }
         ALOGI("snapshotandjpeg done\n");
     }
@@ -1120,11 +1524,14 @@ int CameraHardwareSec::pictureThread()
 
     if (mSecCamera->getCameraId() == SecCamera::CAMERA_ID_BACK) {
         // TODO: copy postview to PostviewHeap->base()
-        memcpy(JpegHeap->data, jpeg_data, jpeg_size);
         JpegImageSize = jpeg_size;
     } else {
         JpegImageSize = static_cast<int>(output_size);
     }
+    mJpegSizeLock.lock();
+    mJpegSizer.onCapture(cap_width, cap_height, jpegQuality, jpegAllocated, JpegImageSize,
+                         jpegRetried);
+    mJpegSizeLock.unlock();
     scaleDownYuv422((char *)PostviewHeap->base(), mPostViewWidth, mPostViewHeight,
                     (char *)ThumbnailHeap->base(), mThumbWidth, mThumbHeight);
 
@@ -1174,8 +1581,12 @@ int CameraHardwareSec::pictureThread()
     ALOGV("%s : pictureThread end", __func__);
 
 out:
-    JpegHeap->release(JpegHeap);
+    if (JpegHeap != NULL)
+        JpegHeap->release(JpegHeap);
     mSecCamera->endSnapshot();
+    mPreviewLock.lock();
+    mPreviewResumePending = false;
+    mPreviewLock.unlock();
     mCaptureLock.lock();
     mCaptureInProgress = false;
     mCaptureCondition.broadcast();
@@ -1184,6 +1595,53 @@ out:
     return ret;
 }
 
+/*
+ * Called by the picture thread once the JPEG is out of the capture buffer.
+ * With preview-resume-after-capture set (the default on the back camera)
+ * and preview running when the picture was taken, preview starts again from
+ * here rather than from the app's startPreview(), which then finds it
+ * running and returns. SecCamera::resumePreview() skips the control writes
+ * and the first frame wait of a full start, and the preview heap is kept.
+ */
+void CameraHardwareSec::resumePreviewAfterCapture()
+{
+    Mutex::Autolock lock(mPreviewLock);
+
+    if (!mPreviewResumePending || mPreviewRunning || mExitPreviewThread || !mPreviewWindow)
+        return;
+    mPreviewResumePending = false;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (startPreviewInternal(true) != NO_ERROR) {
+        /* left to the app's startPreview() */
+        mSecCamera->stopPreview();
+        mPreviewResumeFailures++;
+        return;
+    }
+
+    mPreviewResumeStart = start;
+    mPreviewResumed = true;
+    mPreviewRunning = true;
+    mPreviewStartDeferred = false;
+    mPreviewCondition.signal();
+}
+
+/* on the first frame shown after resumePreviewAfterCapture() */
+void CameraHardwareSec::updatePreviewResume(nsecs_t timestamp)
+{
+    nsecs_t latency = timestamp - mPreviewResumeStart;
+
+    mPreviewResumeStart = 0;
+    ALOGD("%s: preview back %lldms after the capture", __func__, latency / 1000000LL);
+    HALTRACE_INSTANT(CAMERA_PREVIEW_RESUME, latency / 1000, 0);
+
+    Mutex::Autolock lock(mPreviewLock);
+    mPreviewResumes++;
+    mPreviewResumeTotal += latency;
+    if (latency > mPreviewResumeMax)
+        mPreviewResumeMax = latency;
+}
+
 status_t CameraHardwareSec::waitCaptureCompletion() {
     // 5 seconds timeout
     nsecs_t endTime = 5000000000LL + systemTime(SYSTEM_TIME_MONOTONIC);
@@ -1203,6 +1661,14 @@ status_t CameraHardwareSec::waitCaptureCompletion() {
 status_t CameraHardwareSec::takePicture()
 {
     ALOGV("%s :", __func__);
+    HALTRACE_INSTANT(CAMERA_TAKE_PICTURE, 0, 0);
+
+    /* the back camera may bring preview back itself, see
+     * resumePreviewAfterCapture() */
+    mPreviewLock.lock();
+    bool resume = mPreviewResumeEnabled && mPreviewRunning && !mPreviewStartDeferred && !mRecordRunning &&
+                  mSecCamera->getCameraId() == SecCamera::CAMERA_ID_BACK;
+    mPreviewLock.unlock();
 
     stopPreview();
 
@@ -1219,8 +1685,15 @@ status_t CameraHardwareSec::takePicture()
         return TIMED_OUT;
     }
 
+    mPreviewLock.lock();
+    mPreviewResumePending = resume;
+    mPreviewLock.unlock();
+
     if (mPictureThread->run("CameraPictureThread", PRIORITY_DEFAULT) != NO_ERROR) {
         ALOGE("%s : couldn't run picture thread", __func__);
+        mPreviewLock.lock();
+        mPreviewResumePending = false;
+        mPreviewLock.unlock();
         return INVALID_OPERATION;
     }
     mCaptureLock.lock();
@@ -1303,10 +1776,42 @@ status_t CameraHardwareSec::dump(int fd) const
         mInternalParameters.dump(fd, args);
         snprintf(buffer, 255, " preview running(%s)\n", mPreviewRunning?"true": "false");
         result.append(buffer);
+        mPreviewLock.lock();
+        result.appendFormat(" preview resumed after capture(%u) failed(%u) avg(%.1fms) max(%.1fms)\n",
+                 mPreviewResumes, mPreviewResumeFailures,
+                 mPreviewResumes ? mPreviewResumeTotal / 1e6 / mPreviewResumes : 0.0,
+                 mPreviewResumeMax / 1e6);
+        mPreviewLock.unlock();
+        result.appendFormat(" preview callbacks in frames of their own(%u) dropped(%u)\n",
+                 mCallbackFrames, mCallbackDrops);
+        mFpsGovernorLock.lock();
+        result.appendFormat(" %s\n", mFpsGovernor.toString8().string());
+        mFpsGovernorLock.unlock();
+        mZoomLock.lock();
+        result.appendFormat(" %s\n", mZoom.toString8().string());
+        if (mSecCamera->getCameraId() == SecCamera::CAMERA_ID_FRONT)
+            result.appendFormat(" digital zoom ratio(%d)\n", mDigitalZoomRatio);
+        mZoomLock.unlock();
+        mRecordLock.lock();
+        result.appendFormat(" time-lapse interval(%lldms) frames(%u) skipped(%u)\n",
+                 mTimeLapseInterval / 1000000LL, mTimeLapseFrames, mTimeLapseSkipped);
+        result.appendFormat(" %s%s\n", mRecordMonitor.toString8().string(),
+                 mRecordRunning ? "" : " (stopped)");
+        int record_width, record_height;
+        mSecCamera->getRecordingSize(&record_width, &record_height);
+        result.appendFormat(" record stream %dx%d NV12T, viewfinder while recording(%lldfps)"
+                 " skipped(%u)\n", record_width, record_height,
+                 mRecordPreviewInterval ? seconds(1) / mRecordPreviewInterval : 0LL,
+                 mRecordPreviewSkipped);
+        mRecordLock.unlock();
+        mJpegSizeLock.lock();
+        result.appendFormat(" %s\n", mJpegSizer.toString8().string());
+        mJpegSizeLock.unlock();
     } else {
         result.append("No camera client yet.\n");
     }
     write(fd, result.string(), result.size());
+    halsched_dump(fd);
     return NO_ERROR;
 }
 
@@ -1324,6 +1829,20 @@ bool CameraHardwareSec::isSupportedPreviewSize(const int width,
     return false;
 }
 
+bool CameraHardwareSec::isSupportedVideoSize(const int width,
+                                             const int height) const
+{
+    unsigned int i;
+
+    for (i = 0; i < mSupportedVideoSizes.size(); i++) {
+        if (mSupportedVideoSizes[i].width == width &&
+                mSupportedVideoSizes[i].height == height)
+            return true;
+    }
+
+    return false;
+}
+
 bool CameraHardwareSec::isSupportedParameter(const char * const parm,
         const char * const supported_parm) const
 {
@@ -1528,6 +2047,43 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
+    // preview callback orientation
+    int new_frame_rotation = params.getInt(KEY_PREVIEW_FRAME_ROTATION);
+    if (0 <= new_frame_rotation) {
+        if (mSecCamera->SetRotate(new_frame_rotation) < 0) {
+            ALOGE("ERR(%s):Fail on mSecCamera->SetRotate(%d)", __func__, new_frame_rotation);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(KEY_PREVIEW_FRAME_ROTATION, new_frame_rotation);
+        }
+    }
+
+    const char *new_frame_mirror_str = params.get(KEY_PREVIEW_FRAME_MIRROR);
+    if (new_frame_mirror_str != NULL) {
+        int new_frame_mirror = -1;
+
+        if (!strcmp(new_frame_mirror_str, "off"))
+            new_frame_mirror = SEC_YUV_FLIP_NONE;
+        else if (!strcmp(new_frame_mirror_str, "horizontal"))
+            new_frame_mirror = SEC_YUV_FLIP_H;
+        else if (!strcmp(new_frame_mirror_str, "vertical"))
+            new_frame_mirror = SEC_YUV_FLIP_V;
+        else {
+            ALOGE("ERR(%s):Invalid %s(%s)", __func__, KEY_PREVIEW_FRAME_MIRROR,
+                 new_frame_mirror_str);
+            ret = UNKNOWN_ERROR;
+        }
+
+        if (0 <= new_frame_mirror) {
+            if (mSecCamera->setMirror(new_frame_mirror) < 0) {
+                ALOGE("ERR(%s):Fail on mSecCamera->setMirror(%d)", __func__, new_frame_mirror);
+                ret = UNKNOWN_ERROR;
+            } else {
+                mParameters.set(KEY_PREVIEW_FRAME_MIRROR, new_frame_mirror_str);
+            }
+        }
+    }
+
     // brightness
     int new_exposure_compensation = params.getInt(CameraParameters::KEY_EXPOSURE_COMPENSATION);
     int max_exposure_compensation = params.getInt(CameraParameters::KEY_MAX_EXPOSURE_COMPENSATION);
@@ -1582,6 +2138,72 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
+    // time-lapse
+    int new_time_lapse_interval = params.getInt(KEY_TIME_LAPSE_INTERVAL);
+    if (new_time_lapse_interval >= 0) {
+        Mutex::Autolock lock(mRecordLock);
+        if (mRecordRunning &&
+            milliseconds(new_time_lapse_interval) != mTimeLapseInterval) {
+            ALOGE("ERR(%s):Can't change %s while recording", __func__,
+                 KEY_TIME_LAPSE_INTERVAL);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mTimeLapseInterval = milliseconds(new_time_lapse_interval);
+            mParameters.set(KEY_TIME_LAPSE_INTERVAL, new_time_lapse_interval);
+        }
+    }
+
+    // record queue depth
+    int new_record_buffer_count = params.getInt(KEY_RECORD_BUFFER_COUNT);
+    if (new_record_buffer_count > 0) {
+        Mutex::Autolock lock(mRecordLock);
+        if (new_record_buffer_count != mSecCamera->getRecordBufferCount()) {
+            if (mRecordRunning) {
+                ALOGE("ERR(%s):Can't change %s while recording", __func__,
+                     KEY_RECORD_BUFFER_COUNT);
+                ret = UNKNOWN_ERROR;
+            } else if (mSecCamera->setRecordBufferCount(new_record_buffer_count) < 0) {
+                ALOGE("ERR(%s):Invalid %s(%d)", __func__, KEY_RECORD_BUFFER_COUNT,
+                     new_record_buffer_count);
+                ret = UNKNOWN_ERROR;
+            } else {
+                mParameters.set(KEY_RECORD_BUFFER_COUNT, new_record_buffer_count);
+            }
+        }
+    }
+
+    // viewfinder rate while recording
+    int new_recording_preview_fps = params.getInt(KEY_RECORDING_PREVIEW_FRAME_RATE);
+    if (new_recording_preview_fps >= 0) {
+        Mutex::Autolock lock(mRecordLock);
+        if (new_recording_preview_fps > mParameters.getPreviewFrameRate()) {
+            ALOGE("ERR(%s):Invalid %s(%d)", __func__, KEY_RECORDING_PREVIEW_FRAME_RATE,
+                 new_recording_preview_fps);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mRecordPreviewInterval = new_recording_preview_fps ?
+                                     seconds(1) / new_recording_preview_fps : 0;
+            mParameters.set(KEY_RECORDING_PREVIEW_FRAME_RATE, new_recording_preview_fps);
+        }
+    }
+
+    // preview back without the app's startPreview()
+    const char *new_resume_str = params.get(KEY_PREVIEW_RESUME_AFTER_CAPTURE);
+    if (new_resume_str != NULL &&
+        mSecCamera->getCameraId() == SecCamera::CAMERA_ID_BACK) {
+        bool new_resume = !strcmp(new_resume_str, CameraParameters::TRUE);
+
+        if (!new_resume && strcmp(new_resume_str, CameraParameters::FALSE)) {
+            ALOGE("ERR(%s):Invalid %s(%s)", __func__, KEY_PREVIEW_RESUME_AFTER_CAPTURE,
+                 new_resume_str);
+            ret = UNKNOWN_ERROR;
+        } else {
+            Mutex::Autolock lock(mPreviewLock);
+            mPreviewResumeEnabled = new_resume;
+            mParameters.set(KEY_PREVIEW_RESUME_AFTER_CAPTURE, new_resume_str);
+        }
+    }
+
     // whitebalance
     const char *new_white_str = params.get(CameraParameters::KEY_WHITE_BALANCE);
     ALOGV("%s : new_white_str %s", __func__, new_white_str);
@@ -1627,13 +2249,24 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
     int current_min_fps, current_max_fps;
     params.getPreviewFpsRange(&new_min_fps, &new_max_fps);
     mParameters.getPreviewFpsRange(&current_min_fps, &current_max_fps);
-    /* our fps range is determined by the sensor, reject any request
-     * that isn't exactly what we're already at.
+    if (new_min_fps != current_min_fps || new_max_fps != current_max_fps)
+        mFpsRangeSet = true;
+    /* the supported range is determined by the sensor and scene mode,
+     * reject any request that doesn't fit inside it.  within the range
+     * the preview frame rate governor picks the sensor rate.
      * but the check is performed when requesting only changing fps range
      */
+    int supported_min_fps = current_min_fps;
+    int supported_max_fps = current_max_fps;
+    const char *supported_fps_range =
+        mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE);
+    if (supported_fps_range != NULL)
+        sscanf(supported_fps_range, "(%d,%d)", &supported_min_fps, &supported_max_fps);
+
     if (new_scene_mode_str && current_scene_mode_str) {
         if (!strcmp(new_scene_mode_str, current_scene_mode_str)) {
-            if ((new_min_fps != current_min_fps) || (new_max_fps != current_max_fps)) {
+            if ((new_min_fps > new_max_fps) ||
+                (new_min_fps < supported_min_fps) || (new_max_fps > supported_max_fps)) {
                 ALOGW("%s : requested new_min_fps = %d, new_max_fps = %d not allowed",
                         __func__, new_min_fps, new_max_fps);
                 ALOGE("%s : current_min_fps = %d, current_max_fps = %d",
@@ -1868,20 +2501,6 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
                 ret = UNKNOWN_ERROR;
             }
         }
-
-        // zoom
-        int new_zoom = params.getInt(CameraParameters::KEY_ZOOM);
-        int max_zoom = params.getInt(CameraParameters::KEY_MAX_ZOOM);
-        ALOGV("%s : new_zoom %d", __func__, new_zoom);
-        if (0 <= new_zoom && new_zoom <= max_zoom) {
-            ALOGV("%s : set zoom:%d\n", __func__, new_zoom);
-            if (mSecCamera->setZoom(new_zoom) < 0) {
-                ALOGE("ERR(%s):Fail on mSecCamera->setZoom(%d)", __func__, new_zoom);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_ZOOM, new_zoom);
-            }
-        }
     } else {
         if (!isSupportedParameter(new_focus_mode_str,
                     mParameters.get(CameraParameters::KEY_SUPPORTED_FOCUS_MODES))) {
@@ -1890,6 +2509,23 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
+    // zoom
+    int new_zoom = params.getInt(CameraParameters::KEY_ZOOM);
+    int max_zoom = params.getInt(CameraParameters::KEY_MAX_ZOOM);
+    ALOGV("%s : new_zoom %d", __func__, new_zoom);
+    if (0 <= new_zoom && new_zoom <= max_zoom) {
+        ALOGV("%s : set zoom:%d\n", __func__, new_zoom);
+        /* the preview loop writes it, apps stepping zoom through
+         * setParameters() get at most one zoom change per frame */
+        mZoomLock.lock();
+        bool queued = mZoom.setLevel(new_zoom);
+        mZoomLock.unlock();
+        if (queued)
+            mParameters.set(CameraParameters::KEY_ZOOM, new_zoom);
+        else
+            ALOGV("%s : smooth zoom running, ignoring zoom %d", __func__, new_zoom);
+    }
+
     // ---------------------------------------------------------------------------
 
     // image effect
@@ -2043,12 +2679,40 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
     // Recording size
     int new_recording_width = mInternalParameters.getInt("recording-size-width");
     int new_recording_height= mInternalParameters.getInt("recording-size-height");
+    int new_video_width  = 0;
+    int new_video_height = 0;
+    params.getVideoSize(&new_video_width, &new_video_height);
 
     if (0 < new_recording_width && 0 < new_recording_height) {
         if (mSecCamera->setRecordingSize(new_recording_width, new_recording_height) < 0) {
             ALOGE("ERR(%s):Fail on mSecCamera->setRecordingSize(width(%d), height(%d))", __func__, new_recording_width, new_recording_height);
             ret = UNKNOWN_ERROR;
         }
+    } else if (0 < new_video_width && 0 < new_video_height) {
+        Mutex::Autolock lock(mRecordLock);
+        int current_video_width, current_video_height;
+        mSecCamera->getRecordingSize(&current_video_width, &current_video_height);
+        if (!isSupportedVideoSize(new_video_width, new_video_height)) {
+            ALOGE("%s: Invalid video size(%dx%d)",
+                 __func__, new_video_width, new_video_height);
+            ret = INVALID_OPERATION;
+        } else if (new_video_width > new_preview_width ||
+                   new_video_height > new_preview_height) {
+            /* it would be an upscale of the preview frame */
+            ALOGE("%s: video size(%dx%d) larger than preview size(%dx%d)", __func__,
+                 new_video_width, new_video_height, new_preview_width, new_preview_height);
+            ret = INVALID_OPERATION;
+        } else if (mRecordRunning && (new_video_width != current_video_width ||
+                                      new_video_height != current_video_height)) {
+            ALOGE("ERR(%s):Can't change %s while recording", __func__,
+                 CameraParameters::KEY_VIDEO_SIZE);
+            ret = INVALID_OPERATION;
+        } else if (mSecCamera->setRecordingSize(new_video_width, new_video_height) < 0) {
+            ALOGE("ERR(%s):Fail on mSecCamera->setRecordingSize(width(%d), height(%d))", __func__, new_video_width, new_video_height);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.setVideoSize(new_video_width, new_video_height);
+        }
     } else {
         if (mSecCamera->setRecordingSize(new_preview_width, new_preview_height) < 0) {
             ALOGE("ERR(%s):Fail on mSecCamera->setRecordingSize(width(%d), height(%d))", __func__, new_preview_width, new_preview_height);
@@ -2101,6 +2765,34 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
+    // keep the app's fps range if it fits the range of the (new) scene mode
+    if (ret == NO_ERROR) {
+        supported_fps_range = mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE);
+        if (supported_fps_range != NULL)
+            sscanf(supported_fps_range, "(%d,%d)", &supported_min_fps, &supported_max_fps);
+        if (supported_min_fps <= new_min_fps && new_min_fps <= new_max_fps &&
+            new_max_fps <= supported_max_fps)
+            mParameters.set(CameraParameters::KEY_PREVIEW_FPS_RANGE,
+                    String8::format("%d,%d", new_min_fps, new_max_fps).string());
+    }
+
+    /* the back camera keeps the rate its modes set until the app asks for
+     * a range of its own, the default one is what every app gets */
+    mParameters.getPreviewFpsRange(&new_min_fps, &new_max_fps);
+    bool governed = mFpsRangeSet || mSecCamera->getCameraId() != SecCamera::CAMERA_ID_BACK;
+    /* held across, so recording can't start between the check and the write */
+    mRecordLock.lock();
+    mFpsGovernorLock.lock();
+    if (governed)
+        mFpsGovernor.setRange(new_min_fps / 1000, new_max_fps / 1000);
+    else
+        mFpsGovernor.setRange(0, 0);
+    if (governed && !mRecordRunning && mFpsGovernor.getFps() &&
+        mFpsGovernor.getFps() != mSecCamera->getFrameRate())
+        mSecCamera->setFrameRate(mFpsGovernor.getFps());
+    mFpsGovernorLock.unlock();
+    mRecordLock.unlock();
+
     /*Camcorder fix fps*/
     int new_sensor_mode = mInternalParameters.getInt("cam_mode");
 
@@ -2159,7 +2851,15 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
 CameraParameters CameraHardwareSec::getParameters() const
 {
     ALOGV("%s :", __func__);
-    return mParameters;
+    CameraParameters params = mParameters;
+
+    /* smooth zoom moves the level behind setParameters()' back */
+    if (params.get(CameraParameters::KEY_ZOOM) != NULL) {
+        mZoomLock.lock();
+        params.set(CameraParameters::KEY_ZOOM, mZoom.getLevel());
+        mZoomLock.unlock();
+    }
+    return params;
 }
 
 status_t CameraHardwareSec::sendCommand(int32_t command, int32_t arg1, int32_t arg2)
@@ -2169,9 +2869,44 @@ status_t CameraHardwareSec::sendCommand(int32_t command, int32_t arg1, int32_t a
         // it in video mode. Allow the disable.
         return NO_ERROR;
     }
+    if (command == CAMERA_CMD_START_SMOOTH_ZOOM)
+        return startSmoothZoom(arg1);
+    if (command == CAMERA_CMD_STOP_SMOOTH_ZOOM) {
+        /* the stopped callback comes from the preview loop */
+        Mutex::Autolock lock(mZoomLock);
+        mZoom.stopSmooth();
+        return NO_ERROR;
+    }
     return BAD_VALUE;
 }
 
+status_t CameraHardwareSec::startSmoothZoom(int level)
+{
+    const char *supported = mParameters.get(CameraParameters::KEY_SMOOTH_ZOOM_SUPPORTED);
+
+    if (supported == NULL || strcmp(supported, CameraParameters::TRUE))
+        return BAD_VALUE;
+    if (level < 0 || level > mParameters.getInt(CameraParameters::KEY_MAX_ZOOM)) {
+        ALOGE("%s: invalid zoom level %d", __func__, level);
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock previewLock(mPreviewLock);
+    if (!mPreviewRunning) {
+        ALOGE("%s: preview not running", __func__);
+        return INVALID_OPERATION;
+    }
+
+    Mutex::Autolock lock(mZoomLock);
+    if (mZoom.isSmoothActive()) {
+        ALOGE("%s: smooth zoom already running", __func__);
+        return INVALID_OPERATION;
+    }
+    ALOGV("%s: %d -> %d", __func__, mZoom.getLevel(), level);
+    mZoom.startSmooth(level);
+    return NO_ERROR;
+}
+
 void CameraHardwareSec::release()
 {
     ALOGV("%s", __func__);
@@ -2219,6 +2954,10 @@ void CameraHardwareSec::release()
         mPreviewHeap->release(mPreviewHeap);
         mPreviewHeap = 0;
     }
+    if (mCallbackHeap) {
+        mCallbackHeap->release(mCallbackHeap);
+        mCallbackHeap = 0;
+    }
     if (mRecordHeap) {
         mRecordHeap->release(mRecordHeap);
         mRecordHeap = 0;
@@ -2607,6 +3346,8 @@ static int HAL_camera_device_open(const struct hw_module_t* module,
         return -EINVAL;
     }
 
+    HALTRACE_COLDSTART(CAMERA, OPEN_BEGIN);
+
     if (g_cam_device) {
         if (obj(g_cam_device)->getCameraId() == cameraId) {
             ALOGV("returning existing camera ID %s", id);
@@ -2635,6 +3376,7 @@ static int HAL_camera_device_open(const struct hw_module_t* module,
 
 done:
     *device = (hw_device_t *)g_cam_device;
+    HALTRACE_COLDSTART(CAMERA, OPEN_END);
     ALOGI("%s: opened camera %s (%p)", __func__, id, *device);
     return 0;
 }
@@ -20,6 +20,7 @@
 #define ANDROID_HARDWARE_CAMERA_HARDWARE_SEC_H
 
 #include "SecCamera.h"
+#include "SecCameraUtils.h"
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 #include <binder/MemoryBase.h>
@@ -27,6 +28,7 @@
 #include <hardware/camera.h>
 #include <hardware/gralloc.h>
 #include <camera/CameraParameters.h>
+#include <halsched.h>
 
 namespace android {
     class CameraHardwareSec : public virtual RefBase {
@@ -67,8 +69,10 @@ public:
     CameraHardwareSec(int cameraId, camera_device_t *dev);
     virtual             ~CameraHardwareSec();
 private:
-    status_t    startPreviewInternal();
+    status_t    startPreviewInternal(bool resume = false);
     void stopPreviewInternal();
+    void        resumePreviewAfterCapture();
+    void        updatePreviewResume(nsecs_t timestamp);
 
     static  const int   kBufferCount = MAX_BUFFERS;
     static  const int   kBufferCountForRecord = MAX_BUFFERS;
@@ -82,6 +86,10 @@ private:
         virtual void onFirstRef() {
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
+        virtual status_t readyToRun() {
+            halsched_attach(HALSCHED_CAMERA_CAPTURE);
+            return NO_ERROR;
+        }
         virtual bool threadLoop() {
             mHardware->previewThreadWrapper();
             return false;
@@ -94,6 +102,10 @@ private:
         PictureThread(CameraHardwareSec *hw):
         Thread(false),
         mHardware(hw) { }
+        virtual status_t readyToRun() {
+            halsched_attach(HALSCHED_ENCODE);
+            return NO_ERROR;
+        }
         virtual bool threadLoop() {
             mHardware->pictureThread();
             return false;
@@ -107,6 +119,10 @@ private:
         virtual void onFirstRef() {
             run("CameraAutoFocusThread", PRIORITY_DEFAULT);
         }
+        virtual status_t readyToRun() {
+            halsched_attach(HALSCHED_CAMERA_CONTROL);
+            return NO_ERROR;
+        }
         virtual bool threadLoop() {
             mHardware->autoFocusThread();
             return true;
@@ -119,6 +135,8 @@ private:
     sp<PreviewThread>   mPreviewThread;
             int         previewThread();
             int         previewThreadWrapper();
+            int         recordFrame(nsecs_t timestamp);
+            bool        skipPreviewWhileRecording(nsecs_t timestamp);
 
     sp<AutoFocusThread> mAutoFocusThread;
             int         autoFocusThread();
@@ -154,9 +172,14 @@ private:
             void        setSkipFrame(int frame);
             bool        isSupportedPreviewSize(const int width,
                                                const int height) const;
+            bool        isSupportedVideoSize(const int width,
+                                             const int height) const;
             bool        isSupportedParameter(const char * const parm,
                             const char * const supported_parm) const;
             status_t    waitCaptureCompletion();
+            void        updatePreviewFrameRate(nsecs_t cpuTime);
+            void        updateZoom();
+            status_t    startSmoothZoom(int level);
     /* used by auto focus thread to block until it's told to run */
     mutable Mutex       mFocusLock;
     mutable Condition   mFocusCondition;
@@ -170,8 +193,35 @@ private:
             bool        mPreviewStartDeferred;
             bool        mExitPreviewThread;
 
+    /* back camera with preview-resume-after-capture: the picture thread
+     * brings preview back itself after a capture taken with preview running;
+     * guarded by mPreviewLock, except mPreviewResumeStart which is the
+     * preview thread's once it's woken */
+            bool        mPreviewResumeEnabled;
+            bool        mPreviewResumePending;
+            bool        mPreviewResumed;
+            nsecs_t     mPreviewResumeStart;
+            uint32_t    mPreviewResumes;
+            uint32_t    mPreviewResumeFailures;
+            nsecs_t     mPreviewResumeTotal;
+            nsecs_t     mPreviewResumeMax;
+
             preview_stream_ops *mPreviewWindow;
 
+    /* picks the sensor frame rate within the app's preview-fps-range; on
+     * the back camera only once the app has changed the range */
+    mutable Mutex       mFpsGovernorLock;
+    SecFpsGovernor      mFpsGovernor;
+            bool        mFpsRangeSet;
+
+    /* zoom changes, written to the sensor from the preview loop */
+    mutable Mutex       mZoomLock;
+    SecZoomControl      mZoom;
+
+    /* sizes the picture thread's JPEG buffer from recent captures */
+    mutable Mutex       mJpegSizeLock;
+    SecJpegSizer        mJpegSizer;
+
     /* used to guard mCaptureInProgress */
     mutable Mutex       mCaptureLock;
     mutable Condition   mCaptureCondition;
@@ -180,6 +230,18 @@ private:
     CameraParameters    mInternalParameters;
 
     camera_memory_t     *mPreviewHeap;
+    /* scratch for orienting and packing preview callbacks in software */
+            uint8_t     *mPreviewTransformBuf;
+            int         mPreviewTransformSize;
+    /* zoomed or oriented preview callbacks are written straight into
+     * frames of their own, allocated when first needed */
+    camera_memory_t     *mCallbackHeap;
+            uint32_t    mCallbackFrames;
+            uint32_t    mCallbackDrops;
+    /* front camera digital zoom: the level and ratio the preview loop
+     * applies */
+            int         mDigitalZoomLevel;
+            int         mDigitalZoomRatio;
     camera_memory_t     *mRawHeap;
     camera_memory_t     *mRecordHeap;
 
@@ -199,11 +261,26 @@ private:
 
             bool        mRecordRunning;
     mutable Mutex       mRecordLock;
+
+    /* time-lapse recording, all guarded by mRecordLock */
+            nsecs_t     mTimeLapseInterval;
+            nsecs_t     mTimeLapseNextCapture;
+            uint32_t    mTimeLapseFrames;
+            uint32_t    mTimeLapseSkipped;
+            int         mTimeLapseSavedFps;
+    /* encoder backpressure on the record queue, guarded by mRecordLock */
+    SecRecordMonitor    mRecordMonitor;
+            int         mRecordSavedFps;
+    /* the viewfinder's own rate while recording, guarded by mRecordLock */
+            nsecs_t     mRecordPreviewInterval;
+            nsecs_t     mRecordPreviewNext;
+            uint32_t    mRecordPreviewSkipped;
             int         mPostViewWidth;
             int         mPostViewHeight;
             int         mPostViewSize;
 
             Vector<Size> mSupportedPreviewSizes;
+            Vector<Size> mSupportedVideoSizes;
 
     camera_device_t *mHalDevice;
     static gralloc_module_t const* mGrallocHal;
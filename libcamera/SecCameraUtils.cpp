@@ -69,4 +69,448 @@ String8 SecCameraArea::toString8() {
         m_left, m_top, m_right, m_bottom, m_weight);
 }
 
-}
\ No newline at end of file
+/* rates the sensors accept through V4L2_CID_CAMERA_FRAME_RATE */
+static const int kFpsSteps[] = { 7, 15, 30 };
+static const int kNumFpsSteps = sizeof(kFpsSteps) / sizeof(kFpsSteps[0]);
+
+/* the next step below fps that is at least minFps, or 0 */
+static int fpsStepDown(int fps, int minFps)
+{
+    for (int i = kNumFpsSteps - 1; i >= 0; i--) {
+        if (kFpsSteps[i] < fps)
+            return kFpsSteps[i] >= minFps ? kFpsSteps[i] : 0;
+    }
+    return 0;
+}
+
+/* the next step above fps that is at most maxFps, or 0 */
+static int fpsStepUp(int fps, int maxFps)
+{
+    for (int i = 0; i < kNumFpsSteps; i++) {
+        if (kFpsSteps[i] > fps)
+            return kFpsSteps[i] <= maxFps ? kFpsSteps[i] : 0;
+    }
+    return 0;
+}
+
+/* frames per evaluation window, and windows in a row before acting */
+static const int kFpsWindow = 30;
+static const int kFpsHysteresis = 2;
+
+SecFpsGovernor::SecFpsGovernor() :
+    mMinFps(0),
+    mMaxFps(0),
+    mFps(0),
+    mLastTimestamp(0),
+    mWindowFrames(0),
+    mWindowLate(0),
+    mWindowCpu(0),
+    mExposureUs(0),
+    mPendingDir(0),
+    mTotalFrames(0),
+    mTotalLate(0),
+    mChanges(0)
+{
+}
+
+void SecFpsGovernor::setRange(int minFps, int maxFps)
+{
+    mMinFps = minFps;
+    mMaxFps = maxFps;
+    if (mFps && !inRange(mFps))
+        reset(mFps);
+}
+
+bool SecFpsGovernor::inRange(int fps) const
+{
+    return fps >= mMinFps && fps <= mMaxFps;
+}
+
+void SecFpsGovernor::reset(int fps)
+{
+    /* start from the fastest rate in range that doesn't exceed fps */
+    int start = 0;
+    for (int i = 0; i < kNumFpsSteps; i++) {
+        if (inRange(kFpsSteps[i]) && (start == 0 || kFpsSteps[i] <= fps))
+            start = kFpsSteps[i];
+    }
+    mFps = start ? start : fps;
+    mLastTimestamp = 0;
+    mWindowFrames = 0;
+    mWindowLate = 0;
+    mWindowCpu = 0;
+    mExposureUs = 0;
+    mPendingDir = 0;
+}
+
+int SecFpsGovernor::stepDown() const
+{
+    return fpsStepDown(mFps, mMinFps);
+}
+
+int SecFpsGovernor::stepUp() const
+{
+    return fpsStepUp(mFps, mMaxFps);
+}
+
+void SecFpsGovernor::onExposure(int exposureUs)
+{
+    if (exposureUs > 0)
+        mExposureUs = exposureUs;
+}
+
+int SecFpsGovernor::onFrame(nsecs_t timestamp, nsecs_t cpuTime)
+{
+    if (!isEnabled() || mFps <= 0)
+        return 0;
+
+    nsecs_t period = seconds(1) / mFps;
+
+    if (mLastTimestamp && timestamp - mLastTimestamp > period + period / 2) {
+        mWindowLate++;
+        mTotalLate++;
+    }
+    mLastTimestamp = timestamp;
+    mWindowFrames++;
+    mWindowCpu += cpuTime;
+    mTotalFrames++;
+
+    if (mWindowFrames < kFpsWindow)
+        return 0;
+
+    nsecs_t avgCpu = mWindowCpu / mWindowFrames;
+    int late = mWindowLate;
+    mWindowFrames = 0;
+    mWindowLate = 0;
+    mWindowCpu = 0;
+
+    int dir = 0;
+    int down = stepDown();
+    int up = stepUp();
+
+    if (down && (late * 5 > kFpsWindow ||
+                 avgCpu > period * 4 / 5 ||
+                 (nsecs_t)mExposureUs * 1000 > period * 9 / 10)) {
+        dir = -1;
+    } else if (up) {
+        nsecs_t upPeriod = seconds(1) / up;
+        if (late * 20 <= kFpsWindow &&
+            avgCpu < upPeriod / 2 &&
+            (nsecs_t)mExposureUs * 1000 < upPeriod / 2)
+            dir = 1;
+    }
+
+    if (dir == 0 || (mPendingDir != 0 && dir != mPendingDir / abs(mPendingDir))) {
+        mPendingDir = dir;
+        return 0;
+    }
+
+    mPendingDir += dir;
+    if (abs(mPendingDir) < kFpsHysteresis)
+        return 0;
+
+    mPendingDir = 0;
+    mFps = dir < 0 ? down : up;
+    mLastTimestamp = 0;
+    mChanges++;
+    return mFps;
+}
+
+int SecFpsGovernor::rateForInterval(nsecs_t interval)
+{
+    for (int i = 0; i < kNumFpsSteps; i++) {
+        if (seconds(1) / kFpsSteps[i] <= interval)
+            return kFpsSteps[i];
+    }
+    return kFpsSteps[kNumFpsSteps - 1];
+}
+
+String8 SecFpsGovernor::toString8() const
+{
+    return String8::format("fps governor: range(%d,%d) fps(%d) frames(%u) late(%u) "
+        "exposure(%dus) changes(%u)",
+        mMinFps, mMaxFps, mFps, mTotalFrames, mTotalLate, mExposureUs, mChanges);
+}
+
+/* preview frames per smooth zoom level, ~1s for the full range at 30fps */
+static const int kZoomFramesPerStep = 2;
+
+SecZoomControl::SecZoomControl() :
+    mLevel(0),
+    mPending(-1),
+    mSmooth(false),
+    mStopRequested(false),
+    mTarget(0),
+    mFrames(0),
+    mRequests(0),
+    mWrites(0)
+{
+}
+
+void SecZoomControl::reset(int level)
+{
+    mLevel = level;
+    mPending = -1;
+    mSmooth = false;
+    mStopRequested = false;
+}
+
+bool SecZoomControl::setLevel(int level)
+{
+    if (mSmooth)
+        return false;
+    if (level != getLevel())
+        mRequests++;
+    mPending = level != mLevel ? level : -1;
+    return true;
+}
+
+void SecZoomControl::startSmooth(int target)
+{
+    mTarget = target;
+    mSmooth = true;
+    mStopRequested = false;
+    /* the first step goes out with the next frame */
+    mFrames = kZoomFramesPerStep - 1;
+    mRequests++;
+}
+
+bool SecZoomControl::stopSmooth()
+{
+    if (!mSmooth || mStopRequested)
+        return false;
+    mStopRequested = true;
+    return true;
+}
+
+int SecZoomControl::onFrame(bool *notify, bool *stopped)
+{
+    int next = mPending;
+
+    *notify = false;
+    *stopped = false;
+    mPending = -1;
+
+    if (mSmooth) {
+        int from = next >= 0 ? next : mLevel;
+        if (mStopRequested || from == mTarget) {
+            mSmooth = false;
+            *notify = true;
+            *stopped = true;
+        } else if (++mFrames >= kZoomFramesPerStep) {
+            mFrames = 0;
+            next = from + (mTarget > from ? 1 : -1);
+            *notify = true;
+            *stopped = next == mTarget;
+            mSmooth = !*stopped;
+        }
+    }
+
+    if (next < 0 || next == mLevel)
+        return -1;
+    mLevel = next;
+    mWrites++;
+    return next;
+}
+
+String8 SecZoomControl::toString8() const
+{
+    return String8::format("zoom: level(%d) smooth(%s, target %d) requests(%u) writes(%u)",
+        getLevel(), mSmooth ? "on" : "off", mTarget, mRequests, mWrites);
+}
+
+/* frames per window, starved frames in one that slow the sensor down, and
+ * windows without any before it speeds up again */
+static const int kRecordWindow = 30;
+static const int kRecordStarvedLimit = 3;
+static const int kRecordRecoverWindows = 10;
+
+SecRecordMonitor::SecRecordMonitor() :
+    mBuffers(0),
+    mRecordFps(0),
+    mMinFps(0),
+    mFps(0),
+    mWindowFrames(0),
+    mWindowStarved(0),
+    mCleanWindows(0),
+    mHeld(0),
+    mMaxHeld(0),
+    mFrames(0),
+    mStarved(0),
+    mChanges(0)
+{
+}
+
+void SecRecordMonitor::reset(int buffers, int fps, int minFps)
+{
+    mBuffers = buffers;
+    mRecordFps = fps;
+    mMinFps = minFps;
+    mFps = fps;
+    mWindowFrames = 0;
+    mWindowStarved = 0;
+    mCleanWindows = 0;
+    mHeld = 0;
+    mMaxHeld = 0;
+    mFrames = 0;
+    mStarved = 0;
+    mChanges = 0;
+}
+
+int SecRecordMonitor::onFrame(int held)
+{
+    mHeld = held;
+    if (held > mMaxHeld)
+        mMaxHeld = held;
+    mFrames++;
+    if (isStarved(held)) {
+        mStarved++;
+        mWindowStarved++;
+    }
+
+    if (++mWindowFrames < kRecordWindow)
+        return 0;
+
+    int starved = mWindowStarved;
+    mWindowFrames = 0;
+    mWindowStarved = 0;
+
+    int fps = 0;
+    if (starved >= kRecordStarvedLimit) {
+        mCleanWindows = 0;
+        fps = fpsStepDown(mFps, mMinFps);
+    } else if (starved > 0) {
+        mCleanWindows = 0;
+    } else if (mFps < mRecordFps && ++mCleanWindows >= kRecordRecoverWindows) {
+        mCleanWindows = 0;
+        fps = fpsStepUp(mFps, mRecordFps);
+        if (fps == 0)
+            fps = mRecordFps;
+    }
+
+    if (fps == 0)
+        return 0;
+    mFps = fps;
+    mChanges++;
+    return fps;
+}
+
+/* headroom over the 90th percentile, and the granularity of the estimate */
+static const int kJpegMarginShift = 3;
+static const int kJpegAlign = 4096;
+
+SecJpegSizer::SecJpegSizer() :
+    mNumConfigs(0),
+    mCaptures(0),
+    mRetries(0),
+    mAllocated(0),
+    mUsed(0)
+{
+}
+
+int SecJpegSizer::find(int width, int height, int quality) const
+{
+    for (int i = 0; i < mNumConfigs; i++) {
+        const Config &c = mConfigs[i];
+        if (c.width == width && c.height == height && c.quality == quality)
+            return i;
+    }
+    return -1;
+}
+
+int SecJpegSizer::percentile(const Config &c)
+{
+    int sorted[kSamples];
+    int n = c.count;
+
+    for (int i = 0; i < n; i++) {
+        int v = c.sizes[i], j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    return sorted[(n * 9 + 9) / 10 - 1];
+}
+
+int SecJpegSizer::estimate(int width, int height, int quality, int ceiling) const
+{
+    int64_t size = 0;
+
+    int i = find(width, height, quality);
+    if (i >= 0) {
+        size = percentile(mConfigs[i]);
+    } else {
+        for (i = 0; i < mNumConfigs; i++) {
+            const Config &o = mConfigs[i];
+            if (o.quality != quality)
+                continue;
+            int64_t scaled = (int64_t)percentile(o) * width * height / (o.width * o.height);
+            if (scaled > size)
+                size = scaled;
+        }
+    }
+    if (size == 0)
+        return ceiling;
+
+    size += size >> kJpegMarginShift;
+    size = (size + kJpegAlign - 1) & ~(int64_t)(kJpegAlign - 1);
+    return size < ceiling ? (int)size : ceiling;
+}
+
+void SecJpegSizer::onCapture(int width, int height, int quality, int allocated, int size,
+                             bool retried)
+{
+    mCaptures++;
+    if (retried)
+        mRetries++;
+    mAllocated += allocated;
+    mUsed += size;
+
+    int i = find(width, height, quality);
+    Config *c = i >= 0 ? &mConfigs[i] : NULL;
+    if (c == NULL) {
+        if (mNumConfigs < kConfigs) {
+            c = &mConfigs[mNumConfigs++];
+        } else {
+            /* the least recently used one makes room */
+            c = &mConfigs[0];
+            for (i = 1; i < kConfigs; i++)
+                if (mConfigs[i].lastUse < c->lastUse)
+                    c = &mConfigs[i];
+        }
+        c->width = width;
+        c->height = height;
+        c->quality = quality;
+        c->count = 0;
+        c->next = 0;
+    }
+
+    c->sizes[c->next] = size;
+    c->next = (c->next + 1) % kSamples;
+    if (c->count < kSamples)
+        c->count++;
+    c->lastUse = mCaptures;
+}
+
+String8 SecJpegSizer::toString8() const
+{
+    String8 s = String8::format("jpeg heap: captures(%u) retries(%u) allocated avg(%lldKB)"
+        " used avg(%lldKB)", mCaptures, mRetries,
+        mCaptures ? mAllocated / mCaptures / 1024 : 0LL,
+        mCaptures ? mUsed / mCaptures / 1024 : 0LL);
+    for (int i = 0; i < mNumConfigs; i++) {
+        const Config &c = mConfigs[i];
+        s.appendFormat("\n  %dx%d quality(%d) samples(%d) p90(%dKB)", c.width, c.height,
+            c.quality, c.count, percentile(c) / 1024);
+    }
+    return s;
+}
+
+String8 SecRecordMonitor::toString8() const
+{
+    return String8::format("record buffers(%d) held(%d) max held(%d) frames(%u) starved(%u) "
+        "fps(%d of %d) changes(%u)", mBuffers, mHeld, mMaxHeld, mFrames, mStarved,
+        mFps, mRecordFps, mChanges);
+}
+
+}
@@ -20,6 +20,7 @@
 #define ANDROID_HARDWARE_CAMERA_SEC_UTILS_H
 
 #include <utils/String8.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -39,6 +40,182 @@ struct SecCameraArea {
     String8 toString8();
 };
 
+/*
+ * Picks the preview sensor frame rate inside the app's preview-fps-range.
+ * The preview loop reports every delivered frame (timestamp and thread CPU
+ * time spent on it) and, periodically, the sensor exposure time.  Once per
+ * evaluation window the governor steps the rate down when frames arrive
+ * late, when the loop cannot keep up or when the exposure no longer fits
+ * the frame period, and steps it back up once there is headroom again.
+ */
+class SecFpsGovernor {
+public:
+    SecFpsGovernor();
+
+    void setRange(int minFps, int maxFps);
+    void reset(int fps);
+    int  getFps() const { return mFps; }
+    bool isEnabled() const { return mMinFps < mMaxFps; }
+    bool needsExposure() const { return mWindowFrames == 0; }
+
+    /* returns the new frame rate when a change is wanted, 0 otherwise */
+    int  onFrame(nsecs_t timestamp, nsecs_t cpuTime);
+    void onExposure(int exposureUs);
+
+    String8 toString8() const;
+
+    /* slowest sensor rate that still delivers a frame every interval */
+    static int rateForInterval(nsecs_t interval);
+
+private:
+    bool inRange(int fps) const;
+    int  stepDown() const;
+    int  stepUp() const;
+
+    int     mMinFps;
+    int     mMaxFps;
+    int     mFps;
+
+    nsecs_t mLastTimestamp;
+    int     mWindowFrames;
+    int     mWindowLate;
+    nsecs_t mWindowCpu;
+    int     mExposureUs;
+    int     mPendingDir;
+
+    uint32_t mTotalFrames;
+    uint32_t mTotalLate;
+    uint32_t mChanges;
+};
+
+/*
+ * Serializes zoom changes into the preview loop.  Direct changes from
+ * setParameters() and smooth zoom steps are both written from onFrame(),
+ * so the sensor sees at most one zoom write per preview frame however fast
+ * the app asks.  A smooth zoom moves one level every kZoomFramesPerStep
+ * frames until it reaches its target or is stopped; setParameters() zoom
+ * changes are ignored while it runs.
+ */
+class SecZoomControl {
+public:
+    SecZoomControl();
+
+    /* the sensor is at level, drops any pending change and smooth zoom */
+    void reset(int level);
+    /* level as last requested, what the app should see */
+    int  getLevel() const { return mPending >= 0 ? mPending : mLevel; }
+    bool isSmoothActive() const { return mSmooth; }
+
+    /* direct change, false if a smooth zoom is running */
+    bool setLevel(int level);
+    void startSmooth(int target);
+    /* false if no smooth zoom is running */
+    bool stopSmooth();
+
+    /* returns the level to write to the sensor, or -1.  notify is set when
+     * the app gets a zoom callback for getLevel(), stopped when the smooth
+     * zoom ended with this frame */
+    int  onFrame(bool *notify, bool *stopped);
+
+    String8 toString8() const;
+
+private:
+    int     mLevel;
+    int     mPending;
+    bool    mSmooth;
+    bool    mStopRequested;
+    int     mTarget;
+    int     mFrames;
+
+    uint32_t mRequests;
+    uint32_t mWrites;
+};
+
+/*
+ * Watches the record queue for an encoder that falls behind.  The preview
+ * loop reports every frame interval with the number of record buffers the
+ * client holds; with all of them held fimc has nowhere to write, and the
+ * interval is starved: its frame is lost.  Once per window the monitor
+ * steps the sensor down when too many frames were lost, within the app's
+ * preview-fps-range, and back towards the recording rate once the encoder
+ * has kept up for a while.
+ */
+class SecRecordMonitor {
+public:
+    SecRecordMonitor();
+
+    /* at record start: the queue depth, the recording rate and the slowest
+     * rate allowed, minFps == fps never changes it */
+    void reset(int buffers, int fps, int minFps);
+    int  getFps() const { return mFps; }
+    int  getRecordFps() const { return mRecordFps; }
+    uint32_t getStarved() const { return mStarved; }
+    bool isStarved(int held) const { return held >= mBuffers; }
+
+    /* returns the new frame rate when a change is wanted, 0 otherwise */
+    int  onFrame(int held);
+
+    String8 toString8() const;
+
+private:
+    int     mBuffers;
+    int     mRecordFps;
+    int     mMinFps;
+    int     mFps;
+
+    int     mWindowFrames;
+    int     mWindowStarved;
+    int     mCleanWindows;
+
+    int     mHeld;
+    int     mMaxHeld;
+    uint32_t mFrames;
+    uint32_t mStarved;
+    uint32_t mChanges;
+};
+
+/*
+ * Sizes the buffer a capture's JPEG is written to from the sizes recent
+ * captures at the same resolution and quality came out at, rather than
+ * from the raw frame.  A resolution not seen yet borrows the bytes per
+ * pixel of others at that quality; with nothing to go on, or past the
+ * ceiling the caller gives, the ceiling is what's allocated.  A JPEG that
+ * still doesn't fit is the caller's to retry, and is counted here.
+ */
+class SecJpegSizer {
+public:
+    SecJpegSizer();
+
+    int  estimate(int width, int height, int quality, int ceiling) const;
+    void onCapture(int width, int height, int quality, int allocated, int size,
+                   bool retried);
+
+    String8 toString8() const;
+
+private:
+    enum { kSamples = 16, kConfigs = 6 };
+
+    struct Config {
+        int      width;
+        int      height;
+        int      quality;
+        int      sizes[kSamples];
+        int      count;
+        int      next;
+        uint32_t lastUse;
+    };
+
+    int  find(int width, int height, int quality) const;
+    static int percentile(const Config &c);
+
+    Config   mConfigs[kConfigs];
+    int      mNumConfigs;
+    uint32_t mCaptures;
+    uint32_t mRetries;
+    int64_t  mAllocated;
+    int64_t  mUsed;
+};
+
 }; // namespace android
 
 #endif // ANDROID_HARDWARE_CAMERA_SEC_UTILS_H
\ No newline at end of file
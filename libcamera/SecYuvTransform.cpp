@@ -0,0 +1,571 @@
+/*
+**
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include "SecYuvTransform.h"
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace android {
+
+/*
+ * Every rotate/mirror combination is an optional transpose followed by
+ * optional flips of the output's columns (flipX) and rows (flipY).
+ */
+struct TransformOp {
+    bool transpose;
+    bool flipX;
+    bool flipY;
+};
+
+/* source tile edge; a 32x32 tile of the luma plane and its transposed
+ * destination rows stay within the Cortex-A8's 32KB L1 */
+static const int kTile = 32;
+
+static bool toTransformOp(int angle, int flip, TransformOp *op)
+{
+    static const TransformOp ops[4][2] = {
+        /*           plain                 mirrored */
+        /*   0 */ { { false, false, false }, { false, true,  false } },
+        /*  90 */ { { true,  true,  false }, { true,  true,  true  } },
+        /* 180 */ { { false, true,  true  }, { false, false, true  } },
+        /* 270 */ { { true,  false, true  }, { true,  false, false } },
+    };
+
+    if (angle < 0 || angle % 90)
+        return false;
+
+    /* a vertical flip is a horizontal one turned by 180 */
+    if (flip & SEC_YUV_FLIP_V) {
+        angle += 180;
+        flip ^= SEC_YUV_FLIP_V | SEC_YUV_FLIP_H;
+    }
+
+    *op = ops[(angle / 90) % 4][(flip & SEC_YUV_FLIP_H) ? 1 : 0];
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// row copy / reverse
+
+template <typename T>
+static void reverseRowC(const T *src, T *dst, int width)
+{
+    for (int x = 0; x < width; x++)
+        dst[width - 1 - x] = src[x];
+}
+
+static void reverseRow(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x = 0;
+#if defined(__ARM_NEON__)
+    for (; x + 8 <= width; x += 8)
+        vst1_u8(dst + width - 8 - x, vrev64_u8(vld1_u8(src + x)));
+#endif
+    reverseRowC(src + x, dst, width - x);
+}
+
+static void reverseRow(const uint16_t *src, uint16_t *dst, int width)
+{
+    int x = 0;
+#if defined(__ARM_NEON__)
+    for (; x + 4 <= width; x += 4)
+        vst1_u16(dst + width - 4 - x, vrev64_u16(vld1_u16(src + x)));
+#endif
+    reverseRowC(src + x, dst, width - x);
+}
+
+template <typename T>
+static void transformRows(const T *src, int srcStride, T *dst, int dstStride,
+                          int width, int height, const TransformOp &op)
+{
+    for (int y = 0; y < height; y++) {
+        const T *s = (const T *)((const uint8_t *)src + y * srcStride);
+        T *d = (T *)((uint8_t *)dst + (op.flipY ? height - 1 - y : y) * dstStride);
+
+        if (op.flipX)
+            reverseRow(s, d, width);
+        else
+            memcpy(d, s, width * sizeof(T));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// transpose
+
+/* scalar transpose of the source rectangle [x0,x1) x [y0,y1) */
+template <typename T>
+static void transposeRectC(const T *src, int srcStride, T *dst, int dstStride,
+                           int width, int height, const TransformOp &op,
+                           int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y < y1; y++) {
+        const T *s = (const T *)((const uint8_t *)src + y * srcStride);
+        int dx = op.flipX ? height - 1 - y : y;
+        for (int x = x0; x < x1; x++) {
+            int dy = op.flipY ? width - 1 - x : x;
+            *(T *)((uint8_t *)dst + dy * dstStride + dx * sizeof(T)) = s[x];
+        }
+    }
+}
+
+#if defined(__ARM_NEON__)
+static const int kBlock8 = 8;
+static const int kBlock16 = 4;
+
+static inline void transposeBlock(const uint8_t *src, int srcStride,
+                                  uint8_t *dst, int dstStride,
+                                  int width, int height, const TransformOp &op,
+                                  int x0, int y0)
+{
+    const uint8_t *s = src + y0 * srcStride + x0;
+    uint8x8_t r0 = vld1_u8(s); s += srcStride;
+    uint8x8_t r1 = vld1_u8(s); s += srcStride;
+    uint8x8_t r2 = vld1_u8(s); s += srcStride;
+    uint8x8_t r3 = vld1_u8(s); s += srcStride;
+    uint8x8_t r4 = vld1_u8(s); s += srcStride;
+    uint8x8_t r5 = vld1_u8(s); s += srcStride;
+    uint8x8_t r6 = vld1_u8(s); s += srcStride;
+    uint8x8_t r7 = vld1_u8(s);
+
+    uint8x8x2_t t0 = vtrn_u8(r0, r1);
+    uint8x8x2_t t1 = vtrn_u8(r2, r3);
+    uint8x8x2_t t2 = vtrn_u8(r4, r5);
+    uint8x8x2_t t3 = vtrn_u8(r6, r7);
+
+    uint16x4x2_t s0 = vtrn_u16(vreinterpret_u16_u8(t0.val[0]), vreinterpret_u16_u8(t1.val[0]));
+    uint16x4x2_t s1 = vtrn_u16(vreinterpret_u16_u8(t0.val[1]), vreinterpret_u16_u8(t1.val[1]));
+    uint16x4x2_t s2 = vtrn_u16(vreinterpret_u16_u8(t2.val[0]), vreinterpret_u16_u8(t3.val[0]));
+    uint16x4x2_t s3 = vtrn_u16(vreinterpret_u16_u8(t2.val[1]), vreinterpret_u16_u8(t3.val[1]));
+
+    uint32x2x2_t q0 = vtrn_u32(vreinterpret_u32_u16(s0.val[0]), vreinterpret_u32_u16(s2.val[0]));
+    uint32x2x2_t q1 = vtrn_u32(vreinterpret_u32_u16(s1.val[0]), vreinterpret_u32_u16(s3.val[0]));
+    uint32x2x2_t q2 = vtrn_u32(vreinterpret_u32_u16(s0.val[1]), vreinterpret_u32_u16(s2.val[1]));
+    uint32x2x2_t q3 = vtrn_u32(vreinterpret_u32_u16(s1.val[1]), vreinterpret_u32_u16(s3.val[1]));
+
+    /* out[r] is source column x0 + r */
+    uint8x8_t out[8] = {
+        vreinterpret_u8_u32(q0.val[0]), vreinterpret_u8_u32(q1.val[0]),
+        vreinterpret_u8_u32(q2.val[0]), vreinterpret_u8_u32(q3.val[0]),
+        vreinterpret_u8_u32(q0.val[1]), vreinterpret_u8_u32(q1.val[1]),
+        vreinterpret_u8_u32(q2.val[1]), vreinterpret_u8_u32(q3.val[1]),
+    };
+
+    int dx = op.flipX ? height - y0 - kBlock8 : y0;
+    for (int r = 0; r < kBlock8; r++) {
+        int dy = op.flipY ? width - 1 - (x0 + r) : x0 + r;
+        uint8x8_t v = op.flipX ? vrev64_u8(out[r]) : out[r];
+        vst1_u8(dst + dy * dstStride + dx, v);
+    }
+}
+
+static inline void transposeBlock(const uint16_t *src, int srcStride,
+                                  uint16_t *dst, int dstStride,
+                                  int width, int height, const TransformOp &op,
+                                  int x0, int y0)
+{
+    const uint8_t *s = (const uint8_t *)src + y0 * srcStride;
+    uint16x4_t r0 = vld1_u16((const uint16_t *)s + x0); s += srcStride;
+    uint16x4_t r1 = vld1_u16((const uint16_t *)s + x0); s += srcStride;
+    uint16x4_t r2 = vld1_u16((const uint16_t *)s + x0); s += srcStride;
+    uint16x4_t r3 = vld1_u16((const uint16_t *)s + x0);
+
+    uint16x4x2_t t0 = vtrn_u16(r0, r1);
+    uint16x4x2_t t1 = vtrn_u16(r2, r3);
+
+    uint32x2x2_t q0 = vtrn_u32(vreinterpret_u32_u16(t0.val[0]), vreinterpret_u32_u16(t1.val[0]));
+    uint32x2x2_t q1 = vtrn_u32(vreinterpret_u32_u16(t0.val[1]), vreinterpret_u32_u16(t1.val[1]));
+
+    uint16x4_t out[4] = {
+        vreinterpret_u16_u32(q0.val[0]), vreinterpret_u16_u32(q1.val[0]),
+        vreinterpret_u16_u32(q0.val[1]), vreinterpret_u16_u32(q1.val[1]),
+    };
+
+    int dx = op.flipX ? height - y0 - kBlock16 : y0;
+    for (int r = 0; r < kBlock16; r++) {
+        int dy = op.flipY ? width - 1 - (x0 + r) : x0 + r;
+        uint16x4_t v = op.flipX ? vrev64_u16(out[r]) : out[r];
+        vst1_u16((uint16_t *)((uint8_t *)dst + dy * dstStride) + dx, v);
+    }
+}
+#endif
+
+template <typename T>
+static void transposeTiled(const T *src, int srcStride, T *dst, int dstStride,
+                           int width, int height, const TransformOp &op, int block)
+{
+    for (int ty = 0; ty < height; ty += kTile) {
+        int ty1 = ty + kTile < height ? ty + kTile : height;
+        for (int tx = 0; tx < width; tx += kTile) {
+            int tx1 = tx + kTile < width ? tx + kTile : width;
+#if defined(__ARM_NEON__)
+            /* whole SIMD blocks first, the ragged edge of the tile after */
+            int bx1 = tx + (tx1 - tx) / block * block;
+            int by1 = ty + (ty1 - ty) / block * block;
+            for (int y = ty; y < by1; y += block)
+                for (int x = tx; x < bx1; x += block)
+                    transposeBlock(src, srcStride, dst, dstStride,
+                                   width, height, op, x, y);
+            transposeRectC(src, srcStride, dst, dstStride, width, height, op,
+                           bx1, ty, tx1, ty1);
+            transposeRectC(src, srcStride, dst, dstStride, width, height, op,
+                           tx, by1, bx1, ty1);
+#else
+            (void)block;
+            transposeRectC(src, srcStride, dst, dstStride, width, height, op,
+                           tx, ty, tx1, ty1);
+#endif
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+void secTransformPlane8(const uint8_t *src, int srcStride,
+                        uint8_t *dst, int dstStride,
+                        int width, int height, int angle, int flip)
+{
+    TransformOp op;
+    if (!toTransformOp(angle, flip, &op))
+        return;
+
+    if (!op.transpose)
+        transformRows(src, srcStride, dst, dstStride, width, height, op);
+    else
+#if defined(__ARM_NEON__)
+        transposeTiled(src, srcStride, dst, dstStride, width, height, op, kBlock8);
+#else
+        transposeTiled(src, srcStride, dst, dstStride, width, height, op, 1);
+#endif
+}
+
+void secTransformPlane16(const uint16_t *src, int srcStride,
+                         uint16_t *dst, int dstStride,
+                         int width, int height, int angle, int flip)
+{
+    TransformOp op;
+    if (!toTransformOp(angle, flip, &op))
+        return;
+
+    if (!op.transpose)
+        transformRows(src, srcStride, dst, dstStride, width, height, op);
+    else
+#if defined(__ARM_NEON__)
+        transposeTiled(src, srcStride, dst, dstStride, width, height, op, kBlock16);
+#else
+        transposeTiled(src, srcStride, dst, dstStride, width, height, op, 1);
+#endif
+}
+
+int secYuvTransform(const uint8_t *src, uint8_t *dst, int width, int height,
+                    int format, int angle, int flip)
+{
+    TransformOp op;
+
+    if (!toTransformOp(angle, flip, &op) || (width & 1) || (height & 1))
+        return -1;
+    if (format != SEC_YUV_PLANAR && format != SEC_YUV_SEMIPLANAR)
+        return -1;
+
+    /* destination strides follow the rotated geometry */
+    int dstWidth = op.transpose ? height : width;
+    int ySize = width * height;
+
+    secTransformPlane8(src, width, dst, dstWidth, width, height, angle, flip);
+
+    switch (format) {
+    case SEC_YUV_PLANAR: {
+        int cSize = ySize / 4;
+        for (int i = 0; i < 2; i++)
+            secTransformPlane8(src + ySize + i * cSize, width / 2,
+                               dst + ySize + i * cSize, dstWidth / 2,
+                               width / 2, height / 2, angle, flip);
+        break;
+    }
+    case SEC_YUV_SEMIPLANAR:
+        /* each chroma pair moves as one 16 bit sample */
+        secTransformPlane16((const uint16_t *)(src + ySize), width,
+                            (uint16_t *)(dst + ySize), dstWidth,
+                            width / 2, height / 2, angle, flip);
+        break;
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// pack
+
+/* a0 b0 a1 b1 ...; a may sit in dst as long as it's ahead of the writes,
+ * every sample is read before its pair is stored */
+static void interleave8(const uint8_t *a, const uint8_t *b, uint8_t *dst, int count)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x2_t ab;
+        ab.val[0] = vld1_u8(a + i);
+        ab.val[1] = vld1_u8(b + i);
+        vst2_u8(dst + 2 * i, ab);
+    }
+#endif
+    for (; i < count; i++) {
+        uint8_t s = a[i];
+        dst[2 * i] = s;
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+int secYuvOrient(const uint8_t *src, uint8_t *dst, uint8_t *scratch,
+                 int width, int height, int dstFormat, int angle, int flip)
+{
+    TransformOp op;
+
+    if (!toTransformOp(angle, flip, &op) || (width & 1) || (height & 1))
+        return -1;
+
+    switch (dstFormat) {
+    case SEC_YUV_PLANAR:
+        return secYuvTransform(src, dst, width, height, SEC_YUV_PLANAR, angle, flip);
+    case SEC_YUV_SEMIPLANAR:
+        break;
+    default:
+        return -1;
+    }
+
+    int dstWidth = op.transpose ? height : width;
+    int ySize = width * height;
+    int cSize = ySize / 4;
+    const uint8_t *u = src + ySize;
+    const uint8_t *v = u + cSize;
+
+    secTransformPlane8(src, width, dst, dstWidth, width, height, angle, flip);
+
+    /* NV21: V first; pack, then move the pairs as 16 bit samples */
+    if (!op.transpose && !op.flipX && !op.flipY) {
+        interleave8(v, u, dst + ySize, cSize);
+        return 0;
+    }
+    if (scratch == NULL)
+        return -1;
+    interleave8(v, u, scratch, cSize);
+    secTransformPlane16((const uint16_t *)scratch, width, (uint16_t *)(dst + ySize), dstWidth,
+                        width / 2, height / 2, angle, flip);
+    return 0;
+}
+
+void secYuvToNV21(uint8_t *frame, uint8_t *scratch, int width, int height)
+{
+    int ySize = width * height;
+    int cSize = ySize / 4;
+    uint8_t *c = frame + ySize;
+
+    /* the pairs overwrite U first, V is always read before it's reached */
+    memcpy(scratch, c, cSize);
+    interleave8(c + cSize, scratch, c, cSize);
+}
+
+// ---------------------------------------------------------------------------
+// crop and scale
+
+/* widest destination row; the front sensor tops out at 640 */
+static const int kMaxScaleWidth = 2048;
+
+void secZoomCrop(int width, int height, int ratio, SecYuvCrop *crop)
+{
+    if (ratio < 100)
+        ratio = 100;
+    crop->width = (width * 100 / ratio) & ~1;
+    crop->height = (height * 100 / ratio) & ~1;
+    crop->x = ((width - crop->width) / 2) & ~1;
+    crop->y = ((height - crop->height) / 2) & ~1;
+}
+
+/* source position of every destination column or row, 16.16 fixed point,
+ * sampling at pixel centers; split into an index and an 8 bit fraction */
+static void scaleSteps(int srcStart, int srcLen, int dstLen, uint16_t *index, uint8_t *frac)
+{
+    int step = (srcLen << 16) / dstLen;
+    int pos = step / 2 - 0x8000;
+    int last = (srcLen - 1) << 16;
+
+    for (int i = 0; i < dstLen; i++, pos += step) {
+        int p = pos < 0 ? 0 : pos > last ? last : pos;
+        index[i] = srcStart + (p >> 16);
+        frac[i] = (p >> 8) & 0xff;
+    }
+}
+
+/* dst[x] = a[x] + (b[x] - a[x]) * f / 256, for x in [0, width) */
+static void blendRows(const uint8_t *a, const uint8_t *b, uint8_t *dst, int width, int f)
+{
+    int x = 0;
+
+    if (f == 0) {
+        memcpy(dst, a, width);
+        return;
+    }
+#if defined(__ARM_NEON__)
+    uint8x8_t wa = vdup_n_u8(256 - f);
+    uint8x8_t wb = vdup_n_u8(f);
+    for (; x + 8 <= width; x += 8) {
+        uint16x8_t acc = vmull_u8(vld1_u8(a + x), wa);
+        acc = vmlal_u8(acc, vld1_u8(b + x), wb);
+        vst1_u8(dst + x, vrshrn_n_u16(acc, 8));
+    }
+#endif
+    for (; x < width; x++)
+        dst[x] = (a[x] * (256 - f) + b[x] * f + 128) >> 8;
+}
+
+static inline uint8_t lerp(const uint8_t *row, int i, int f)
+{
+    return (row[i] * (256 - f) + row[i + 1] * f + 128) >> 8;
+}
+
+struct ScaleSetup {
+    uint16_t xIndex[kMaxScaleWidth];
+    uint8_t  xFrac[kMaxScaleWidth];
+    /* one vertically blended source row, plus a copy of its last pixel */
+    uint8_t  rowA[kMaxScaleWidth + 1];
+    uint8_t  rowB[kMaxScaleWidth + 1];
+};
+
+static bool validCrop(const SecYuvCrop &crop, int srcStride, int dstWidth, int dstHeight)
+{
+    return crop.x >= 0 && crop.y >= 0 && crop.width > 0 && crop.height > 0 &&
+           crop.x + crop.width <= srcStride && crop.width <= kMaxScaleWidth &&
+           dstWidth > 0 && dstWidth <= kMaxScaleWidth && dstHeight > 0;
+}
+
+/*
+ * Every destination row blends its two source rows over the crop width with
+ * SIMD, then gathers the columns from that one row; the column positions
+ * are computed once per plane.
+ */
+int secScalePlane8(const uint8_t *src, int srcStride, const SecYuvCrop &crop,
+                   uint8_t *dst, int dstStride, int dstWidth, int dstHeight)
+{
+    ScaleSetup s;
+
+    if (!validCrop(crop, srcStride, dstWidth, dstHeight))
+        return -1;
+
+    scaleSteps(0, crop.width, dstWidth, s.xIndex, s.xFrac);
+
+    int yStep = (crop.height << 16) / dstHeight;
+    int yPos = yStep / 2 - 0x8000;
+    int yLast = (crop.height - 1) << 16;
+
+    for (int y = 0; y < dstHeight; y++, yPos += yStep) {
+        int p = yPos < 0 ? 0 : yPos > yLast ? yLast : yPos;
+        int y0 = crop.y + (p >> 16);
+        int y1 = y0 + 1 < crop.y + crop.height ? y0 + 1 : y0;
+        const uint8_t *a = src + y0 * srcStride + crop.x;
+        const uint8_t *b = src + y1 * srcStride + crop.x;
+
+        blendRows(a, b, s.rowA, crop.width, (p >> 8) & 0xff);
+        s.rowA[crop.width] = s.rowA[crop.width - 1];
+
+        uint8_t *d = dst + y * dstStride;
+        for (int x = 0; x < dstWidth; x++)
+            d[x] = lerp(s.rowA, s.xIndex[x], s.xFrac[x]);
+    }
+    return 0;
+}
+
+int secScalePlanes8x2(const uint8_t *srcA, const uint8_t *srcB, int srcStride,
+                      const SecYuvCrop &crop, uint8_t *dst, int dstStride,
+                      int dstWidth, int dstHeight)
+{
+    ScaleSetup s;
+
+    if (!validCrop(crop, srcStride, dstWidth, dstHeight))
+        return -1;
+
+    scaleSteps(0, crop.width, dstWidth, s.xIndex, s.xFrac);
+
+    int yStep = (crop.height << 16) / dstHeight;
+    int yPos = yStep / 2 - 0x8000;
+    int yLast = (crop.height - 1) << 16;
+
+    for (int y = 0; y < dstHeight; y++, yPos += yStep) {
+        int p = yPos < 0 ? 0 : yPos > yLast ? yLast : yPos;
+        int y0 = crop.y + (p >> 16);
+        int y1 = y0 + 1 < crop.y + crop.height ? y0 + 1 : y0;
+        int f = (p >> 8) & 0xff;
+        int offset0 = y0 * srcStride + crop.x;
+        int offset1 = y1 * srcStride + crop.x;
+
+        blendRows(srcA + offset0, srcA + offset1, s.rowA, crop.width, f);
+        blendRows(srcB + offset0, srcB + offset1, s.rowB, crop.width, f);
+        s.rowA[crop.width] = s.rowA[crop.width - 1];
+        s.rowB[crop.width] = s.rowB[crop.width - 1];
+
+        uint8_t *d = dst + y * dstStride;
+        for (int x = 0; x < dstWidth; x++) {
+            d[2 * x] = lerp(s.rowA, s.xIndex[x], s.xFrac[x]);
+            d[2 * x + 1] = lerp(s.rowB, s.xIndex[x], s.xFrac[x]);
+        }
+    }
+    return 0;
+}
+
+int secYuvZoom(const uint8_t *src, uint8_t *dst, int width, int height,
+               int ratio, int dstFormat)
+{
+    SecYuvCrop crop, cropC;
+
+    if ((width & 1) || (height & 1))
+        return -1;
+
+    secZoomCrop(width, height, ratio, &crop);
+    cropC.x = crop.x / 2;
+    cropC.y = crop.y / 2;
+    cropC.width = crop.width / 2;
+    cropC.height = crop.height / 2;
+
+    int ySize = width * height;
+    int cSize = ySize / 4;
+    const uint8_t *u = src + ySize;
+    const uint8_t *v = u + cSize;
+
+    if (secScalePlane8(src, width, crop, dst, width, width, height))
+        return -1;
+
+    switch (dstFormat) {
+    case SEC_YUV_PLANAR:
+        if (secScalePlane8(u, width / 2, cropC, dst + ySize, width / 2, width / 2, height / 2) ||
+            secScalePlane8(v, width / 2, cropC, dst + ySize + cSize, width / 2,
+                           width / 2, height / 2))
+            return -1;
+        break;
+    case SEC_YUV_SEMIPLANAR:
+        /* NV21: V first */
+        if (secScalePlanes8x2(v, u, width / 2, cropC, dst + ySize, width,
+                              width / 2, height / 2))
+            return -1;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+}; // namespace android
@@ -0,0 +1,97 @@
+/*
+**
+** Copyright 2014, The CyanogenMod Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_HARDWARE_CAMERA_SEC_YUV_TRANSFORM_H
+#define ANDROID_HARDWARE_CAMERA_SEC_YUV_TRANSFORM_H
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Rotate/mirror kernels for frames the sensor can't orient itself.
+ *
+ * angle is the clockwise rotation (0, 90, 180, 270), flip a mask of
+ * SEC_YUV_FLIP_* applied to the source before rotating.  For 90 and 270
+ * the destination is height x width.  src and dst must not overlap.
+ */
+enum {
+    SEC_YUV_FLIP_NONE = 0,
+    SEC_YUV_FLIP_H    = 1,
+    SEC_YUV_FLIP_V    = 2,
+};
+
+enum {
+    SEC_YUV_PLANAR = 0,     // YUV420 / YV12, three planes
+    SEC_YUV_SEMIPLANAR,     // NV12 / NV21, interleaved chroma
+};
+
+/* returns 0, or -1 for an unsupported angle, format or odd size */
+int secYuvTransform(const uint8_t *src, uint8_t *dst, int width, int height,
+                    int format, int angle, int flip);
+
+/* single planes; strides are in bytes */
+void secTransformPlane8(const uint8_t *src, int srcStride,
+                        uint8_t *dst, int dstStride,
+                        int width, int height, int angle, int flip);
+void secTransformPlane16(const uint16_t *src, int srcStride,
+                         uint16_t *dst, int dstStride,
+                         int width, int height, int angle, int flip);
+
+/* a YUV420 planar frame oriented into dst as YUV420 planar or, for
+ * SEC_YUV_SEMIPLANAR, NV21, reading the source once; NV21 chroma goes
+ * through scratch, width * height / 2 bytes, unless angle and flip are 0.
+ * src and dst must not overlap */
+int secYuvOrient(const uint8_t *src, uint8_t *dst, uint8_t *scratch,
+                 int width, int height, int dstFormat, int angle, int flip);
+
+/* YUV420 planar to NV21 where the frame is; scratch holds the U plane,
+ * width * height / 4 bytes */
+void secYuvToNV21(uint8_t *frame, uint8_t *scratch, int width, int height);
+
+/*
+ * Bilinear crop-and-scale kernels for digital zoom.
+ *
+ * ratio is the zoom in percent (100 is the full frame).  The crop is
+ * centered and even, so chroma planes use the luma crop halved.
+ */
+struct SecYuvCrop {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+void secZoomCrop(int width, int height, int ratio, SecYuvCrop *crop);
+
+/* crop of one plane, scaled to dstWidth x dstHeight; returns 0, or -1 for
+ * a crop outside the plane or a destination wider than the kernel handles */
+int secScalePlane8(const uint8_t *src, int srcStride, const SecYuvCrop &crop,
+                   uint8_t *dst, int dstStride, int dstWidth, int dstHeight);
+/* the same crop of two planes, written interleaved a0 b0 a1 b1 ... */
+int secScalePlanes8x2(const uint8_t *srcA, const uint8_t *srcB, int srcStride,
+                      const SecYuvCrop &crop, uint8_t *dst, int dstStride,
+                      int dstWidth, int dstHeight);
+
+/* zoom a YUV420 planar frame into dst at the same size, as YUV420 planar
+ * or, for SEC_YUV_SEMIPLANAR, NV21; src and dst must not overlap */
+int secYuvZoom(const uint8_t *src, uint8_t *dst, int width, int height,
+               int ratio, int dstFormat);
+
+}; // namespace android
+
+#endif // ANDROID_HARDWARE_CAMERA_SEC_YUV_TRANSFORM_H
@@ -0,0 +1,30 @@
+# Copyright (C) 2014 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+ifeq ($(TARGET_DEVICE),epicmtd)
+
+# Shared so that the budget monitor sees all HAL threads of a process
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := halsched.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_SHARED_LIBRARIES := liblog libcutils libhaltrace
+LOCAL_MODULE := libhalsched
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SHARED_LIBRARY)
+
+endif
@@ -0,0 +1,595 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HalSched"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <halsched.h>
+#include <haltrace.h>
+
+#ifndef SCHED_IDLE
+#define SCHED_IDLE          5
+#endif
+
+#define MAX_THREADS         32
+#define CONFIG_FILE         "/system/etc/halsched.conf"
+/* windows within budget before a demoted thread gets its policy back */
+#define RESTORE_WINDOWS     10
+
+enum {
+    POLICY_FIFO,
+    POLICY_OTHER,
+    POLICY_IDLE,
+};
+
+struct role_policy {
+    int policy;
+    int priority;           /* FIFO priority or nice */
+    int budget;             /* % of a window, 0 for none */
+    int fallback_nice;      /* FIFO roles where SCHED_FIFO is not permitted */
+};
+
+struct thread_slot {
+    int used;
+    int role;
+    pid_t tid;
+    clockid_t clock;
+    char name[16];
+    int owned;              /* the HAL's own thread, halsched may schedule it */
+    /* policy in effect: POLICY_*, and its priority */
+    int policy;
+    int priority;
+    /* what the thread ran at before its role, a demotion goes back to it */
+    int base_policy;
+    int base_priority;
+    int demoted;
+    int within;             /* windows within budget since demoted */
+    /* monitor state */
+    uint64_t last_cpu_ns;
+    uint64_t last_wait_ns;
+    uint64_t last_slices;
+    uint64_t cpu_ns;
+    int pct;
+    int max_pct;
+    int lat_us;             /* mean run queue wait per slice, -1 if unknown */
+    int max_lat_us;
+    int overruns;
+};
+
+static const char *role_names[HALSCHED_ROLE_CNT] = {
+    "audio_io",
+    "camera_capture",
+    "camera_control",
+    "encode",
+    "sensors",
+    "debug",
+};
+
+static const char *policy_names[] = {
+    "fifo",
+    "other",
+    "idle",
+};
+
+/* Defaults, the same as the shipped halsched.conf */
+static struct role_policy policies[HALSCHED_ROLE_CNT] = {
+    { POLICY_FIFO,  2,  40, -19 },      /* audio_io */
+    { POLICY_FIFO,  1,  60, -16 },      /* camera_capture */
+    { POLICY_OTHER, 0,  0,  0 },        /* camera_control */
+    { POLICY_OTHER, 0,  0,  0 },        /* encode */
+    { POLICY_OTHER, -8, 0,  0 },        /* sensors */
+    { POLICY_IDLE,  0,  0,  0 },        /* debug */
+};
+static int window_ms = 100;
+static int monitor_priority = 4;
+static int enabled = 1;
+
+static struct thread_slot slots[MAX_THREADS];
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slot_key;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t monitor_started = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t monitor_wake = PTHREAD_COND_INITIALIZER;
+static int monitor_running;
+static int fifo_denied;
+
+static uint64_t now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    if (clock_gettime(clock, &ts))
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+
+static int parse_policy(char *line, struct role_policy *p)
+{
+    char *save, *tok;
+    struct role_policy r = { POLICY_OTHER, 0, 0, 0 };
+    int i;
+
+    tok = strtok_r(line, " \t", &save);
+    if (tok == NULL)
+        return -EINVAL;
+    for (i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (!strcmp(tok, policy_names[i]))
+            break;
+    }
+    if (i == sizeof(policy_names) / sizeof(policy_names[0]))
+        return -EINVAL;
+    r.policy = i;
+
+    tok = strtok_r(NULL, " \t", &save);
+    if (tok == NULL)
+        return -EINVAL;
+    r.priority = atoi(tok);
+    if (r.policy == POLICY_FIFO && (r.priority < 1 || r.priority > 99))
+        return -EINVAL;
+    if (r.policy == POLICY_OTHER && (r.priority < -20 || r.priority > 19))
+        return -EINVAL;
+
+    tok = strtok_r(NULL, " \t", &save);
+    if (tok != NULL && strcmp(tok, "-"))
+        r.budget = atoi(tok);
+    if (r.budget < 0 || r.budget > 100)
+        return -EINVAL;
+
+    tok = strtok_r(NULL, " \t", &save);
+    if (tok != NULL)
+        r.fallback_nice = atoi(tok);
+
+    *p = r;
+    return 0;
+}
+
+static int find_role(const char *name)
+{
+    int i;
+
+    for (i = 0; i < HALSCHED_ROLE_CNT; i++) {
+        if (!strcmp(name, role_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+static void load_config(void)
+{
+    char line[128], value[PROPERTY_VALUE_MAX], key[PROPERTY_KEY_MAX];
+    FILE *f;
+    int i, n = 0;
+
+    f = fopen(CONFIG_FILE, "r");
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+        char *p = strchr(line, '#'), *rest;
+        int role;
+
+        n++;
+        if (p != NULL)
+            *p = '\0';
+        p = line + strspn(line, " \t\r\n");
+        if (*p == '\0')
+            continue;
+        p[strcspn(p, "\r\n")] = '\0';
+        rest = p + strcspn(p, " \t");
+        if (*rest != '\0')
+            *rest++ = '\0';
+
+        if (!strcmp(p, "window")) {
+            window_ms = atoi(rest);
+        } else if (!strcmp(p, "monitor")) {
+            monitor_priority = atoi(rest);
+        } else if ((role = find_role(p)) < 0 || parse_policy(rest, &policies[role])) {
+            ALOGW("%s:%d: ignoring bad line", CONFIG_FILE, n);
+        }
+    }
+    if (f != NULL)
+        fclose(f);
+
+    for (i = 0; i < HALSCHED_ROLE_CNT; i++) {
+        snprintf(key, sizeof(key), "persist.halsched.%s", role_names[i]);
+        if (property_get(key, value, NULL) > 0 && parse_policy(value, &policies[i]))
+            ALOGW("ignoring bad %s", key);
+    }
+    if (window_ms < 10)
+        window_ms = 10;
+
+    property_get("persist.halsched.enable", value, "1");
+    enabled = atoi(value) != 0;
+}
+
+/* Move a thread to a policy, returns the policy that took effect */
+static int set_policy(pid_t tid, int policy, int priority, int fallback_nice)
+{
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    if (policy == POLICY_FIFO) {
+        param.sched_priority = priority;
+        if (sched_setscheduler(tid, SCHED_FIFO, &param) == 0)
+            return POLICY_FIFO;
+        if (!fifo_denied) {
+            fifo_denied = 1;
+            ALOGW("SCHED_FIFO not permitted (%s), using nice levels", strerror(errno));
+        }
+        param.sched_priority = 0;
+        policy = POLICY_OTHER;
+        priority = fallback_nice;
+    }
+
+    if (policy == POLICY_IDLE) {
+        if (sched_setscheduler(tid, SCHED_IDLE, &param) == 0)
+            return POLICY_IDLE;
+        ALOGW("cannot set SCHED_IDLE on %d (%s)", tid, strerror(errno));
+        priority = 19;
+    }
+
+    if (sched_setscheduler(tid, SCHED_OTHER, &param) ||
+            setpriority(PRIO_PROCESS, tid, priority))
+        ALOGW("cannot set nice %d on %d (%s)", priority, tid, strerror(errno));
+    return POLICY_OTHER;
+}
+
+static void apply_role(struct thread_slot *slot)
+{
+    const struct role_policy *p = &policies[slot->role];
+
+    slot->policy = set_policy(slot->tid, p->policy, p->priority, p->fallback_nice);
+    slot->priority = slot->policy == p->policy ? p->priority :
+                     slot->policy == POLICY_OTHER ? p->fallback_nice : 0;
+    slot->demoted = 0;
+    slot->within = 0;
+}
+
+/* What the thread runs at before a role is applied */
+static void read_policy(struct thread_slot *slot)
+{
+    struct sched_param param;
+
+    switch (sched_getscheduler(slot->tid)) {
+    case SCHED_FIFO:
+    case SCHED_RR:
+        slot->policy = POLICY_FIFO;
+        slot->priority = sched_getparam(slot->tid, &param) ? 0 : param.sched_priority;
+        break;
+    case SCHED_IDLE:
+        slot->policy = POLICY_IDLE;
+        slot->priority = 0;
+        break;
+    default:
+        slot->policy = POLICY_OTHER;
+        slot->priority = getpriority(PRIO_PROCESS, slot->tid);
+        break;
+    }
+}
+
+/*
+ * Budgets only bound real-time threads, the ones that can starve the rest.
+ * A thread on its fallback nice level is left to the fair scheduler.
+ */
+static int elevated(const struct thread_slot *slot)
+{
+    return slot->owned && policies[slot->role].budget > 0 && slot->policy == POLICY_FIFO;
+}
+
+/* Called with slots_lock held */
+static int monitored(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (slots[i].used && (slots[i].demoted || elevated(&slots[i])))
+            return 1;
+    }
+    return 0;
+}
+
+/* Back to what the thread ran at before its role; below real-time if
+ * that was real-time already */
+static void demote(struct thread_slot *slot)
+{
+    if (slot->base_policy == POLICY_FIFO)
+        set_policy(slot->tid, POLICY_OTHER, policies[slot->role].fallback_nice, 0);
+    else
+        set_policy(slot->tid, slot->base_policy, slot->base_priority, 0);
+    slot->demoted = 1;
+}
+
+/* Run time and run queue wait in ns, and timeslices; needs CONFIG_SCHEDSTATS */
+static int read_schedstat(pid_t tid, uint64_t *wait, uint64_t *slices)
+{
+    char path[64], buf[96];
+    unsigned long long run, w, s;
+    int fd, n;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return -EIO;
+    buf[n] = '\0';
+    if (sscanf(buf, "%llu %llu %llu", &run, &w, &s) != 3)
+        return -EIO;
+    *wait = w;
+    *slices = s;
+    return 0;
+}
+
+/* Folds in CPU time used while the monitor slept, so its next window starts clean */
+static void catch_up(struct thread_slot *slot)
+{
+    uint64_t cpu = now_ns(slot->clock);
+
+    if (cpu == 0)
+        return;
+    slot->cpu_ns += cpu - slot->last_cpu_ns;
+    slot->last_cpu_ns = cpu;
+    read_schedstat(slot->tid, &slot->last_wait_ns, &slot->last_slices);
+}
+
+static void account(struct thread_slot *slot, uint64_t window_ns)
+{
+    const struct role_policy *p = &policies[slot->role];
+    uint64_t cpu, wait, slices;
+
+    cpu = now_ns(slot->clock);
+    if (cpu == 0)
+        return;         /* exiting */
+    slot->cpu_ns += cpu - slot->last_cpu_ns;
+    slot->pct = (cpu - slot->last_cpu_ns) * 100 / window_ns;
+    slot->last_cpu_ns = cpu;
+    if (slot->pct > slot->max_pct)
+        slot->max_pct = slot->pct;
+
+    if (read_schedstat(slot->tid, &wait, &slices) == 0) {
+        if (slices > slot->last_slices) {
+            slot->lat_us = (wait - slot->last_wait_ns) / (slices - slot->last_slices) / 1000;
+            if (slot->lat_us > slot->max_lat_us)
+                slot->max_lat_us = slot->lat_us;
+        }
+        slot->last_wait_ns = wait;
+        slot->last_slices = slices;
+    }
+
+    if (!enabled || !slot->owned)
+        return;
+    if (!slot->demoted && elevated(slot) && slot->pct > p->budget) {
+        slot->overruns++;
+        demote(slot);
+        HALTRACE_INSTANT(SCHED_OVERRUN, slot->tid, slot->pct);
+        ALOGW("%s (%d, %s) used %d%% of %d ms, budget %d%%: demoted", slot->name, slot->tid,
+              role_names[slot->role], slot->pct, window_ms, p->budget);
+    } else if (slot->demoted) {
+        slot->within = slot->pct <= p->budget ? slot->within + 1 : 0;
+        if (slot->within < RESTORE_WINDOWS)
+            return;
+        apply_role(slot);
+        ALOGI("%s (%d) back within budget: restored", slot->name, slot->tid);
+    }
+}
+
+static void *monitor_loop(void *arg)
+{
+    uint64_t last = now_ns(CLOCK_MONOTONIC);
+    int i;
+
+    prctl(PR_SET_NAME, "HalSchedMonitor", 0, 0, 0);
+    /* above every budgeted thread, or it could not demote them */
+    set_policy(syscall(__NR_gettid), POLICY_FIFO, monitor_priority, -20);
+
+    pthread_mutex_lock(&slots_lock);
+    monitor_running = 1;
+    pthread_cond_signal(&monitor_started);
+    pthread_mutex_unlock(&slots_lock);
+
+    for (;;) {
+        uint64_t now, window;
+
+        /* asleep for as long as no thread runs real-time */
+        pthread_mutex_lock(&slots_lock);
+        if (!monitored()) {
+            while (!monitored())
+                pthread_cond_wait(&monitor_wake, &slots_lock);
+            for (i = 0; i < MAX_THREADS; i++) {
+                if (slots[i].used)
+                    catch_up(&slots[i]);
+            }
+            last = now_ns(CLOCK_MONOTONIC);
+        }
+        pthread_mutex_unlock(&slots_lock);
+
+        usleep(window_ms * 1000);
+        now = now_ns(CLOCK_MONOTONIC);
+        window = now - last;
+        last = now;
+
+        pthread_mutex_lock(&slots_lock);
+        for (i = 0; i < MAX_THREADS; i++) {
+            if (slots[i].used)
+                account(&slots[i], window);
+        }
+        pthread_mutex_unlock(&slots_lock);
+    }
+    return NULL;
+}
+
+static void slot_release(void *arg)
+{
+    struct thread_slot *slot = arg;
+
+    pthread_mutex_lock(&slots_lock);
+    slot->used = 0;
+    pthread_mutex_unlock(&slots_lock);
+}
+
+static void halsched_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    pthread_key_create(&slot_key, slot_release);
+    load_config();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, monitor_loop, NULL)) {
+        ALOGE("cannot start monitor thread");
+    } else {
+        /* the first thread to attach could otherwise starve it at once */
+        pthread_mutex_lock(&slots_lock);
+        while (!monitor_running)
+            pthread_cond_wait(&monitor_started, &slots_lock);
+        pthread_mutex_unlock(&slots_lock);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static int attach(int role, int owned)
+{
+    struct thread_slot *slot;
+    clockid_t clock;
+    int i, err = 0;
+
+    if (role < 0 || role >= HALSCHED_ROLE_CNT)
+        return -EINVAL;
+
+    pthread_once(&init_once, halsched_init);
+    slot = pthread_getspecific(slot_key);
+    if (slot != NULL && slot->role == role && slot->owned == owned)
+        return 0;
+
+    err = pthread_getcpuclockid(pthread_self(), &clock);
+    if (err)
+        return -err;
+
+    pthread_mutex_lock(&slots_lock);
+    if (slot == NULL) {
+        for (i = 0; i < MAX_THREADS && slots[i].used; i++)
+            ;
+        if (i == MAX_THREADS) {
+            pthread_mutex_unlock(&slots_lock);
+            ALOGW("more than %d HAL threads, not accounting %s", MAX_THREADS, role_names[role]);
+            return -ENOSPC;
+        }
+        slot = &slots[i];
+        memset(slot, 0, sizeof(*slot));
+        slot->used = 1;
+        slot->tid = syscall(__NR_gettid);
+        slot->clock = clock;
+        slot->lat_us = -1;
+        slot->max_lat_us = -1;
+        prctl(PR_GET_NAME, slot->name, 0, 0, 0);
+        read_policy(slot);
+        slot->base_policy = slot->policy;
+        slot->base_priority = slot->priority;
+        slot->last_cpu_ns = now_ns(clock);
+        read_schedstat(slot->tid, &slot->last_wait_ns, &slot->last_slices);
+        pthread_setspecific(slot_key, slot);
+    }
+    slot->role = role;
+    slot->owned = owned;
+    if (enabled && owned) {
+        apply_role(slot);
+        if (slot->policy != policies[role].policy)
+            err = -EPERM;
+        if (elevated(slot))
+            pthread_cond_signal(&monitor_wake);
+    }
+    pthread_mutex_unlock(&slots_lock);
+
+    ALOGV("%s (%d) %s as %s", slot->name, slot->tid, owned ? "attached" : "accounted",
+          role_names[role]);
+    return err;
+}
+
+int halsched_attach(int role)
+{
+    return attach(role, 1);
+}
+
+int halsched_account(int role)
+{
+    return attach(role, 0);
+}
+
+void halsched_detach(void)
+{
+    struct thread_slot *slot;
+
+    pthread_once(&init_once, halsched_init);
+    slot = pthread_getspecific(slot_key);
+    if (slot == NULL)
+        return;
+    pthread_setspecific(slot_key, NULL);
+    slot_release(slot);
+}
+
+void halsched_dump(int fd)
+{
+    char buf[160];
+    int i, n, idle;
+
+    pthread_once(&init_once, halsched_init);
+
+    n = snprintf(buf, sizeof(buf), "HAL threads (%s, window %d ms):\n"
+                 "  %5s %-15s %-14s %-9s %8s %5s %5s %7s %7s %8s\n",
+                 enabled ? "policy applied" : "accounting only", window_ms,
+                 "tid", "name", "role", "sched", "cpu ms", "cpu%", "max%",
+                 "lat us", "max us", "overruns");
+    write(fd, buf, n);
+
+    pthread_mutex_lock(&slots_lock);
+    idle = !monitored();
+    for (i = 0; i < MAX_THREADS; i++) {
+        struct thread_slot *s = &slots[i];
+        char sched[16];
+
+        if (!s->used)
+            continue;
+        if (idle)
+            catch_up(s);
+        if (s->demoted)
+            strcpy(sched, "demoted");
+        else
+            snprintf(sched, sizeof(sched), "%s %d", policy_names[s->policy], s->priority);
+        n = snprintf(buf, sizeof(buf), "  %5d %-15s %-14s %-9s %8llu %5d %5d %7d %7d %8d\n",
+                     s->tid, s->name, role_names[s->role], sched,
+                     (unsigned long long)(s->cpu_ns / 1000000), s->pct, s->max_pct,
+                     s->lat_us, s->max_lat_us, s->overruns);
+        write(fd, buf, n);
+    }
+    pthread_mutex_unlock(&slots_lock);
+}
@@ -0,0 +1,39 @@
+# Copyright (C) 2014 The CyanogenMod Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+ifeq ($(TARGET_DEVICE),epicmtd)
+
+# Shared so that all HALs loaded in a process record into the same rings
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := haltrace.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_MODULE := libhaltrace
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := haltrace2json.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_MODULE := haltrace2json
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+endif
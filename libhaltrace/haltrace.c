@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HalTrace"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+
+#include <haltrace.h>
+
+#define MAX_THREADS         64
+/* ~100KB per thread that ever traced */
+#define RING_RECORDS        4096
+#define EXPORT_DIR          "/data/misc/haltrace"
+
+enum {
+    RING_LIVE,
+    RING_EXITED,
+};
+
+struct thread_ring {
+    volatile int32_t state;
+    int32_t tid;
+    char name[HALTRACE_NAME_LEN];
+    /* records ever written, only the owning thread advances it */
+    volatile int32_t written;
+    struct haltrace_record records[RING_RECORDS];
+};
+
+#define HALTRACE_NAME(name) #name,
+static const char *event_names[HALTRACE_EVENT_CNT] = {
+    HALTRACE_EVENTS(HALTRACE_NAME)
+};
+#undef HALTRACE_NAME
+
+static const char *hal_names[HALTRACE_HAL_CNT] = {
+    "audio",
+    "camera",
+    "sensors",
+    "lights",
+    "power",
+};
+
+volatile int32_t haltrace_enabled = 0;
+
+static struct thread_ring *rings[MAX_THREADS];
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int32_t threads_dropped;
+
+static volatile int32_t coldstart_set[HALTRACE_HAL_CNT][HALTRACE_COLDSTART_CNT];
+static uint64_t coldstart_ns[HALTRACE_HAL_CNT][HALTRACE_COLDSTART_CNT];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ring_release(void *arg)
+{
+    struct thread_ring *ring = arg;
+
+    /* the records stay around for the next export, the slot may be reused */
+    android_atomic_release_store(RING_EXITED, &ring->state);
+}
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static struct thread_ring *ring_claim(void)
+{
+    struct thread_ring *ring;
+    int i;
+
+    pthread_once(&ring_key_once, ring_key_create);
+
+    ring = calloc(1, sizeof(*ring));
+    if (ring == NULL)
+        return NULL;
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (rings[i] == NULL &&
+                __sync_bool_compare_and_swap(&rings[i], NULL, ring))
+            break;
+    }
+
+    if (i == MAX_THREADS) {
+        /* full: take over the ring of a thread that has exited */
+        free(ring);
+        ring = NULL;
+        for (i = 0; i < MAX_THREADS; i++) {
+            if (android_atomic_cmpxchg(RING_EXITED, RING_LIVE, &rings[i]->state) == 0) {
+                ring = rings[i];
+                android_atomic_release_store(0, &ring->written);
+                break;
+            }
+        }
+        if (ring == NULL) {
+            if (android_atomic_inc(&threads_dropped) == 0)
+                ALOGW("more than %d traced threads, dropping records", MAX_THREADS);
+            return NULL;
+        }
+    }
+
+    ring->tid = syscall(__NR_gettid);
+    prctl(PR_GET_NAME, ring->name, 0, 0, 0);
+    android_atomic_release_store(RING_LIVE, &ring->state);
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+void haltrace_record(int event, int type, int32_t arg0, int32_t arg1)
+{
+    struct thread_ring *ring;
+    struct haltrace_record *rec;
+    uint32_t n;
+
+    pthread_once(&ring_key_once, ring_key_create);
+    ring = pthread_getspecific(ring_key);
+    if (ring == NULL) {
+        ring = ring_claim();
+        if (ring == NULL)
+            return;
+    }
+
+    n = (uint32_t)ring->written;
+    rec = &ring->records[n & (RING_RECORDS - 1)];
+    rec->timestamp = now_ns();
+    rec->event = event;
+    rec->type = type;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    android_atomic_release_store((int32_t)(n + 1), &ring->written);
+}
+
+static int read_proc(const char *path, char *buf, size_t len)
+{
+    int fd, n;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n <= 0)
+        return -EIO;
+    buf[n] = '\0';
+    return 0;
+}
+
+/*
+ * How long ago the process started. starttime in /proc/self/stat and
+ * /proc/uptime both count from boot including suspend, unlike
+ * CLOCK_MONOTONIC, so the age comes from the two of them; it is off by any
+ * suspend since the process started.
+ */
+static uint64_t process_age_ns(void)
+{
+    char buf[512];
+    char *p;
+    unsigned long long start;
+    unsigned long up_s, up_cs;
+    uint64_t up;
+    int field;
+
+    if (read_proc("/proc/uptime", buf, sizeof(buf)) ||
+            sscanf(buf, "%lu.%lu", &up_s, &up_cs) != 2)
+        return 0;
+    up = up_s * 1000000000ULL + up_cs * 10000000ULL;
+    if (read_proc("/proc/self/stat", buf, sizeof(buf)))
+        return 0;
+
+    /* starttime is field 22, counted after the parenthesized comm */
+    p = strrchr(buf, ')');
+    for (field = 2; p != NULL && field < 22; field++)
+        p = strchr(p + 1, ' ');
+    if (p == NULL || sscanf(p + 1, "%llu", &start) != 1)
+        return 0;
+    start *= 1000000000ULL / sysconf(_SC_CLK_TCK);
+    return up > start ? up - start : 0;
+}
+
+static void coldstart_report(int hal)
+{
+    uint64_t *t = coldstart_ns[hal];
+    char loaded[32], open[32], use[32];
+    uint64_t age, now, start = 0;
+
+#define COLDSTART_MS(buf, set, ns) \
+    do { \
+        if (set) \
+            snprintf(buf, sizeof(buf), "%.1f ms", (ns) / 1000000.0); \
+        else \
+            strcpy(buf, "-"); \
+    } while (0)
+
+    /* the process start on CLOCK_MONOTONIC, where the milestones are; only
+     * to a clock tick, so a module loaded right away may come out before it */
+    age = process_age_ns();
+    now = now_ns();
+    if (age && age < now)
+        start = now - age;
+    COLDSTART_MS(loaded, coldstart_set[hal][HALTRACE_COLDSTART_LOADED] && start,
+                 t[HALTRACE_COLDSTART_LOADED] > start ? t[HALTRACE_COLDSTART_LOADED] - start : 0);
+    COLDSTART_MS(open, coldstart_set[hal][HALTRACE_COLDSTART_OPEN_BEGIN] &&
+                 coldstart_set[hal][HALTRACE_COLDSTART_OPEN_END],
+                 t[HALTRACE_COLDSTART_OPEN_END] - t[HALTRACE_COLDSTART_OPEN_BEGIN]);
+    COLDSTART_MS(use, 1, t[HALTRACE_COLDSTART_USE_END] - t[HALTRACE_COLDSTART_USE_BEGIN]);
+#undef COLDSTART_MS
+
+    ALOGI("coldstart %s: loaded %s%s, open %s, first use %s", hal_names[hal],
+          loaded[0] == '-' ? "" : "+", loaded, open, use);
+}
+
+void haltrace_coldstart(int hal, int milestone)
+{
+    uint64_t ns;
+
+    if (hal < 0 || hal >= HALTRACE_HAL_CNT || milestone < 0 ||
+            milestone >= HALTRACE_COLDSTART_CNT || coldstart_set[hal][milestone])
+        return;
+
+    ns = now_ns();
+    /* the end of the first use only counts if its begin did */
+    if (milestone == HALTRACE_COLDSTART_USE_END &&
+            !coldstart_set[hal][HALTRACE_COLDSTART_USE_BEGIN])
+        return;
+    if (android_atomic_cmpxchg(0, 1, &coldstart_set[hal][milestone]))
+        return;
+    coldstart_ns[hal][milestone] = ns;
+
+    if (milestone == HALTRACE_COLDSTART_USE_END)
+        coldstart_report(hal);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void process_name(char *name, size_t len)
+{
+    int fd = open("/proc/self/cmdline", O_RDONLY);
+    ssize_t n = -1;
+
+    if (fd >= 0) {
+        n = read(fd, name, len - 1);
+        close(fd);
+    }
+    name[n > 0 ? n : 0] = '\0';
+}
+
+int haltrace_export(const char *path)
+{
+    static struct haltrace_record snapshot[RING_RECORDS];
+    struct haltrace_file_header hdr;
+    char names[HALTRACE_EVENT_CNT][HALTRACE_NAME_LEN];
+    int fd, i, err = 0;
+
+    pthread_mutex_lock(&export_lock);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        err = -errno;
+        ALOGE("cannot create %s (%s)", path, strerror(errno));
+        pthread_mutex_unlock(&export_lock);
+        return err;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HALTRACE_MAGIC;
+    hdr.version = HALTRACE_VERSION;
+    hdr.pid = getpid();
+    hdr.event_count = HALTRACE_EVENT_CNT;
+    hdr.record_size = sizeof(struct haltrace_record);
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (rings[i] != NULL)
+            hdr.thread_count++;
+    }
+    process_name(hdr.process, sizeof(hdr.process));
+
+    memset(names, 0, sizeof(names));
+    for (i = 0; i < HALTRACE_EVENT_CNT; i++)
+        strncpy(names[i], event_names[i], HALTRACE_NAME_LEN - 1);
+
+    err = write_all(fd, &hdr, sizeof(hdr));
+    if (!err)
+        err = write_all(fd, names, sizeof(names));
+
+    for (i = 0; i < (int)hdr.thread_count && !err; i++) {
+        struct thread_ring *ring = rings[i];
+        struct haltrace_thread_header th;
+        uint32_t start, end, first, n;
+
+        /* copy the ring while its owner keeps writing, then drop whatever
+         * the owner may have overwritten in the meantime */
+        end = (uint32_t)android_atomic_acquire_load(&ring->written);
+        start = end > RING_RECORDS ? end - RING_RECORDS : 0;
+        for (n = start; n != end; n++)
+            snapshot[n - start] = ring->records[n & (RING_RECORDS - 1)];
+        first = (uint32_t)android_atomic_acquire_load(&ring->written) + 1;
+        first = first > RING_RECORDS ? first - RING_RECORDS : 0;
+        if (first < start || first > end)
+            first = first > end ? end : start;
+
+        memset(&th, 0, sizeof(th));
+        th.tid = ring->tid;
+        th.record_count = end - first;
+        th.lost = first;
+        memcpy(th.name, ring->name, sizeof(th.name));
+
+        err = write_all(fd, &th, sizeof(th));
+        if (!err)
+            err = write_all(fd, &snapshot[first - start],
+                            th.record_count * sizeof(struct haltrace_record));
+    }
+
+    close(fd);
+    pthread_mutex_unlock(&export_lock);
+
+    if (err)
+        ALOGE("error writing %s (%s)", path, strerror(-err));
+    else
+        ALOGI("exported %u threads to %s", hdr.thread_count, path);
+    return err;
+}
+
+/*
+ * Sleeps until a system property is set anywhere, then looks at its own two;
+ * a device that isn't tracing sets few properties, so this rarely wakes.
+ */
+static void *control_loop(void *arg)
+{
+    char value[PROPERTY_VALUE_MAX];
+    char exported[PROPERTY_VALUE_MAX];
+    char path[PATH_MAX];
+    unsigned int serial = 0;
+
+    /* only export on a change, not for a value left from an earlier run */
+    property_get("debug.haltrace.export", exported, "");
+
+    for (;;) {
+        int on;
+
+        serial = __system_property_wait_any(serial);
+
+        property_get("debug.haltrace.enable", value, "0");
+        on = atoi(value) != 0;
+        if (on != haltrace_enabled) {
+            ALOGI("tracing %s", on ? "enabled" : "disabled");
+            android_atomic_release_store(on, &haltrace_enabled);
+        }
+
+        property_get("debug.haltrace.export", value, "");
+        if (strcmp(value, exported)) {
+            strcpy(exported, value);
+            if (value[0] != '\0') {
+                snprintf(path, sizeof(path), "%s/%d-%s.htrc", EXPORT_DIR, getpid(), value);
+                haltrace_export(path);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void __attribute__((constructor)) haltrace_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, control_loop, NULL))
+        ALOGE("cannot start control thread");
+    pthread_attr_destroy(&attr);
+}
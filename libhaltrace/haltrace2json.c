@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * haltrace2json: merge HAL trace exports into one Chrome trace.
+ *
+ * Usage: haltrace2json file.htrc... > trace.json
+ *
+ * Open the result in chrome://tracing. Timestamps are shifted so the
+ * earliest record of all files is at 0.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haltrace.h>
+
+struct trace_thread {
+    struct haltrace_thread_header hdr;
+    struct haltrace_record *records;
+};
+
+struct trace_file {
+    struct haltrace_file_header hdr;
+    char (*names)[HALTRACE_NAME_LEN];
+    struct trace_thread *threads;
+};
+
+static int read_exact(FILE *fp, void *buf, size_t len)
+{
+    return fread(buf, 1, len, fp) == len ? 0 : -1;
+}
+
+static int load(const char *path, struct trace_file *tf)
+{
+    FILE *fp = fopen(path, "rb");
+    uint32_t i;
+
+    memset(tf, 0, sizeof(*tf));
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (read_exact(fp, &tf->hdr, sizeof(tf->hdr)) ||
+            tf->hdr.magic != HALTRACE_MAGIC || tf->hdr.version != HALTRACE_VERSION ||
+            tf->hdr.record_size != sizeof(struct haltrace_record)) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, HALTRACE_VERSION);
+        goto fail;
+    }
+    tf->hdr.process[HALTRACE_NAME_LEN - 1] = '\0';
+
+    tf->names = calloc(tf->hdr.event_count, HALTRACE_NAME_LEN);
+    tf->threads = calloc(tf->hdr.thread_count, sizeof(struct trace_thread));
+    if (read_exact(fp, tf->names, (size_t)tf->hdr.event_count * HALTRACE_NAME_LEN))
+        goto truncated;
+
+    for (i = 0; i < tf->hdr.thread_count; i++) {
+        struct trace_thread *th = &tf->threads[i];
+        if (read_exact(fp, &th->hdr, sizeof(th->hdr)))
+            goto truncated;
+        th->hdr.name[HALTRACE_NAME_LEN - 1] = '\0';
+        th->records = calloc(th->hdr.record_count, sizeof(struct haltrace_record));
+        if (read_exact(fp, th->records,
+                       (size_t)th->hdr.record_count * sizeof(struct haltrace_record)))
+            goto truncated;
+    }
+
+    fclose(fp);
+    return 0;
+
+truncated:
+    fprintf(stderr, "%s: truncated\n", path);
+fail:
+    fclose(fp);
+    return -1;
+}
+
+static void print_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static const char *event_name(const struct trace_file *tf, uint16_t event)
+{
+    static char unknown[16];
+
+    if (event < tf->hdr.event_count)
+        return tf->names[event];
+    snprintf(unknown, sizeof(unknown), "event%u", event);
+    return unknown;
+}
+
+int main(int argc, char **argv)
+{
+    struct trace_file *files;
+    uint64_t base = UINT64_MAX;
+    int nfiles = 0, first = 1;
+    int i;
+    uint32_t t, r;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: haltrace2json file.htrc... > trace.json\n");
+        return 1;
+    }
+
+    files = calloc(argc - 1, sizeof(*files));
+    for (i = 1; i < argc; i++) {
+        if (load(argv[i], &files[nfiles]) == 0)
+            nfiles++;
+    }
+    if (nfiles == 0)
+        return 1;
+
+    for (i = 0; i < nfiles; i++) {
+        for (t = 0; t < files[i].hdr.thread_count; t++) {
+            struct trace_thread *th = &files[i].threads[t];
+            if (th->hdr.record_count && th->records[0].timestamp < base)
+                base = th->records[0].timestamp;
+        }
+    }
+
+    printf("{\"traceEvents\":[\n");
+    for (i = 0; i < nfiles; i++) {
+        struct trace_file *tf = &files[i];
+        int pid = tf->hdr.pid;
+
+        printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":",
+               first ? "" : ",\n", pid);
+        print_string(tf->hdr.process);
+        printf("}}");
+        first = 0;
+
+        for (t = 0; t < tf->hdr.thread_count; t++) {
+            struct trace_thread *th = &tf->threads[t];
+            int tid = th->hdr.tid;
+
+            printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                   "\"args\":{\"name\":", pid, tid);
+            print_string(th->hdr.name);
+            printf("}}");
+            if (th->hdr.lost)
+                fprintf(stderr, "%s/%d: %u older records were overwritten\n",
+                        tf->hdr.process, tid, th->hdr.lost);
+
+            for (r = 0; r < th->hdr.record_count; r++) {
+                const struct haltrace_record *rec = &th->records[r];
+                double ts = (rec->timestamp - base) / 1000.0;
+
+                printf(",\n{\"name\":");
+                print_string(event_name(tf, rec->event));
+                printf(",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,", pid, tid, ts);
+                switch (rec->type) {
+                case HALTRACE_TYPE_BEGIN:
+                case HALTRACE_TYPE_END:
+                    printf("\"ph\":\"%c\",\"args\":{\"arg0\":%d,\"arg1\":%d}}",
+                           rec->type == HALTRACE_TYPE_BEGIN ? 'B' : 'E', rec->arg0, rec->arg1);
+                    break;
+                case HALTRACE_TYPE_COUNTER:
+                    printf("\"ph\":\"C\",\"args\":{\"value\":%d}}", rec->arg0);
+                    break;
+                default:
+                    printf("\"ph\":\"i\",\"s\":\"t\",\"args\":{\"arg0\":%d,\"arg1\":%d}}",
+                           rec->arg0, rec->arg1);
+                    break;
+                }
+            }
+        }
+    }
+    printf("\n]}\n");
+    return 0;
+}
@@ -24,7 +24,9 @@ LOCAL_SRC_FILES := lights.c
 
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+
+LOCAL_SHARED_LIBRARIES := liblog libhaltrace
 
 LOCAL_MODULE := lights.$(TARGET_BOARD_PLATFORM)
 
@@ -27,6 +27,9 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <hardware/lights.h>
+#include <haltrace.h>
+
+HALTRACE_COLDSTART_MODULE(LIGHTS)
 
 static pthread_once_t g_init = PTHREAD_ONCE_INIT;
 static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -223,8 +226,12 @@ static int set_light_backlight(struct light_device_t *dev,
 	int err = 0;
 	int brightness = rgb_to_brightness(state);
 
+	HALTRACE_COLDSTART(LIGHTS, USE_BEGIN);
+	HALTRACE_BEGIN(LIGHTS_SET, brightness, 0);
 	pthread_mutex_lock(&g_lock);
 	err = write_int(LCD_FILE, brightness);
+	HALTRACE_END(LIGHTS_SET, brightness, err);
+	HALTRACE_COLDSTART(LIGHTS, USE_END);
 
 	pthread_mutex_unlock(&g_lock);
 	return err;
@@ -289,6 +296,7 @@ static int open_lights(const struct hw_module_t *module, char const *name,
 		struct light_state_t const *state);
 
 	ALOGV("open_lights: open with %s", name);
+	HALTRACE_COLDSTART(LIGHTS, OPEN_BEGIN);
 
 	if (0 == strcmp(LIGHT_ID_BACKLIGHT, name))
 		set_light = set_light_backlight;
@@ -315,6 +323,7 @@ static int open_lights(const struct hw_module_t *module, char const *name,
 	dev->set_light = set_light;
 
 	*device = (struct hw_device_t *)dev;
+	HALTRACE_COLDSTART(LIGHTS, OPEN_END);
 
 	return 0;
 }
@@ -36,12 +36,25 @@ LOCAL_SRC_FILES := 						\
 				Bma023Sensor.cpp         \
 				CompassSensor.cpp	\
 				OrientationSensor.cpp	\
+				MotionSensor.cpp	\
+				StepDetector.cpp	\
 	            InputEventReader.cpp
 
-LOCAL_SHARED_LIBRARIES := liblog libcutils libdl
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils libdl libhaltrace libhalsched
 LOCAL_PRELINK_MODULE := false
 
 include $(BUILD_SHARED_LIBRARY)
 
+# step detector accuracy against synthesized or recorded traces
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := stepreplay.cpp StepDetector.cpp
+LOCAL_MODULE := stepreplay
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
 endif
@@ -28,9 +28,10 @@
 
 
 /*****************************************************************************/
-Bma023Sensor::Bma023Sensor()
+Bma023Sensor::Bma023Sensor(bool passive)
     : SensorBase(NULL, "accelerometer_sensor"),
       mEnabled(0),
+      mPassive(passive),
 
       mInputReader(4),
       mHasPendingEvent(false)
@@ -68,6 +69,10 @@ int Bma023Sensor::enable(int32_t, int en) {
 	   
     ALOGD("Bma023Sensor::~enable(0, %d)", en);
     int flags = en ? 1 : 0;
+    if (mPassive) {
+        mEnabled = flags;
+        return 0;
+    }
     if (flags != mEnabled) {
         int fd;
         strcpy(&input_sysfs_path[input_sysfs_path_len], "enable");
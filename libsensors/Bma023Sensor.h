@@ -48,6 +48,9 @@ struct input_event;
 
 class Bma023Sensor : public SensorBase {
     int mEnabled;
+    // a passive instance only listens: enable() gates its events but leaves
+    // the chip's power to whoever owns the active instance
+    bool mPassive;
     InputEventCircularReader mInputReader;
     sensors_event_t mPendingEvent;
     bool mHasPendingEvent;
@@ -56,7 +59,7 @@ class Bma023Sensor : public SensorBase {
 
 
 public:
-            Bma023Sensor();
+            Bma023Sensor(bool passive = false);
     virtual ~Bma023Sensor();
     virtual int readEvents(sensors_event_t* data, int count);
     virtual bool hasPendingEvents() const;
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "MotionSensor.h"
+
+/*****************************************************************************/
+
+MotionSensor::MotionSensor()
+    : SensorBase(NULL, NULL),
+      mEnabled(false),
+      mAccel(true),
+      mQueueHead(0),
+      mQueueCnt(0)
+{
+    // readEvents() is also called for queued detections with nothing to read
+    int fd = mAccel.getFd();
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+MotionSensor::~MotionSensor() {
+}
+
+int MotionSensor::getFd() const {
+    return mAccel.getFd();
+}
+
+int MotionSensor::setDelay(int32_t handle, int64_t ns) {
+    // detections are reported when they happen, the sample rate is our own
+    return 0;
+}
+
+int MotionSensor::enable(int32_t handle, int en) {
+    if (handle != ID_SD)
+        return -EINVAL;
+
+    bool enabled = en ? true : false;
+    if (enabled == mEnabled)
+        return 0;
+
+    if (enabled) {
+        // the accelerometer may have been off, start the averages over
+        mDetector.reset();
+    }
+    mAccel.enable(ID_A, enabled);
+    mEnabled = enabled;
+    return 0;
+}
+
+bool MotionSensor::hasPendingEvents() const {
+    return mQueueCnt > 0;
+}
+
+void MotionSensor::queueStep(int64_t timestamp) {
+    if (mQueueCnt == MOTION_QUEUE_SIZE) {
+        ALOGE("MotionSensor: event queue full, dropping a step");
+        return;
+    }
+
+    sensors_event_t* ev = &mQueue[(mQueueHead + mQueueCnt) % MOTION_QUEUE_SIZE];
+    memset(ev, 0, sizeof(*ev));
+    ev->version = sizeof(sensors_event_t);
+    ev->sensor = ID_SD;
+    ev->type = SENSOR_TYPE_STEP_DETECTOR;
+    ev->timestamp = timestamp;
+    ev->data[0] = 1.0f;
+    mQueueCnt++;
+}
+
+int MotionSensor::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+
+    sensors_event_t samples[4];
+    int64_t steps[STEP_CONFIRM];
+    int n;
+    // bounded, the fd is non-blocking and runs dry well before that
+    for (int i = 0; i < 16; i++) {
+        n = mAccel.readEvents(samples, ARRAY_SIZE(samples));
+        if (n < 0)
+            break;
+        for (int j = 0; j < n && mEnabled; j++) {
+            const sensors_vec_t& a = samples[j].acceleration;
+            int found = mDetector.process(samples[j].timestamp, a.x, a.y, a.z, steps);
+            for (int k = 0; k < found; k++) {
+                queueStep(steps[k]);
+            }
+        }
+    }
+
+    int numEventReceived = 0;
+    while (count && mQueueCnt) {
+        *data++ = mQueue[mQueueHead];
+        mQueueHead = (mQueueHead + 1) % MOTION_QUEUE_SIZE;
+        mQueueCnt--;
+        count--;
+        numEventReceived++;
+    }
+    return numEventReceived;
+}
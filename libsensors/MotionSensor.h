@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MOTION_SENSOR_H
+#define ANDROID_MOTION_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "Bma023Sensor.h"
+#include "StepDetector.h"
+
+/*****************************************************************************/
+
+// internal rate the detector runs at
+#define MOTION_PERIOD_NS            STEP_DETECTOR_PERIOD_NS
+
+/*
+ * Worst case between two reads: one pass of readEvents() feeds at most 64
+ * samples, 1.3 s at the detector rate, so a 4 step confirmation burst plus up
+ * to 6 more steps: 10.
+ */
+#define MOTION_QUEUE_SIZE           16
+
+/*
+ * Step detector, computed from the accelerometer. The samples come from a
+ * passive accelerometer instance, so the poll context decides when the chip
+ * is powered and at which rate. Events are only reported on detection.
+ *
+ * The detector runs in the poll loop and holds no wake lock: like any
+ * continuous sensor it stops while the device is suspended. That is why the
+ * HAL offers no step counter or significant motion, both of which must keep
+ * going (or wake the device) with the screen off.
+ */
+class MotionSensor : public SensorBase {
+    bool mEnabled;
+    Bma023Sensor mAccel;
+    StepDetector mDetector;
+
+    sensors_event_t mQueue[MOTION_QUEUE_SIZE];
+    int mQueueHead;
+    int mQueueCnt;
+
+    void queueStep(int64_t timestamp);
+
+public:
+            MotionSensor();
+    virtual ~MotionSensor();
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int getFd() const;
+    virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int enable(int32_t handle, int enabled);
+
+    bool accelNeeded() const { return mEnabled; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_MOTION_SENSOR_H
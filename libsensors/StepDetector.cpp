@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "StepDetector.h"
+
+/*****************************************************************************/
+
+#define COUNTS_PER_MS2          (256.0f / 9.80665f)
+
+// all levels in BMA023 counts, 256 per g
+#define STEP_PEAK               22      // ~0.09g above the running average
+#define STEP_VALLEY             (-12)   // must dip below this between two steps
+#define STEP_MIN_INTERVAL_NS    250000000LL
+#define STEP_MAX_INTERVAL_NS    2000000000LL
+
+static uint32_t isqrt(uint32_t x)
+{
+    uint32_t r = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+StepDetector::StepDetector()
+{
+    reset();
+}
+
+void StepDetector::reset() {
+    mLastSample = 0;
+    mGravity = 0;
+    mSmooth = 0;
+    mArmed = false;
+    mLastStep = 0;
+    mCandidates = 0;
+}
+
+int StepDetector::process(int64_t t, float ax, float ay, float az, int64_t *steps) {
+    if (mLastSample && t - mLastSample < STEP_DETECTOR_PERIOD_NS - STEP_DETECTOR_PERIOD_NS / 4)
+        return 0;
+
+    int32_t x = lrintf(ax * COUNTS_PER_MS2);
+    int32_t y = lrintf(ay * COUNTS_PER_MS2);
+    int32_t z = lrintf(az * COUNTS_PER_MS2);
+    int32_t mag = isqrt(x*x + y*y + z*z) << 4;
+
+    if (!mLastSample) {
+        mGravity = mSmooth = mag;
+        mLastStep = t - STEP_MAX_INTERVAL_NS;
+    }
+    mLastSample = t;
+
+    // ~1.3s and ~80ms time constants at 50Hz
+    mGravity += (mag - mGravity) >> 6;
+    mSmooth += (mag - mSmooth) >> 2;
+    int32_t d = (mSmooth - mGravity) >> 4;
+
+    if (d < STEP_VALLEY) {
+        mArmed = true;
+        return 0;
+    }
+    if (!mArmed || d <= STEP_PEAK)
+        return 0;
+
+    mArmed = false;
+    int64_t dt = t - mLastStep;
+    if (dt < STEP_MIN_INTERVAL_NS)
+        return 0;
+    mLastStep = t;
+    if (dt > STEP_MAX_INTERVAL_NS) {
+        mCandidates = 0;
+    }
+    if (mCandidates == STEP_CONFIRM) {
+        steps[0] = t;
+        return 1;
+    }
+    mCandidateTime[mCandidates++] = t;
+    if (mCandidates < STEP_CONFIRM)
+        return 0;
+    for (int i = 0; i < STEP_CONFIRM; i++) {
+        steps[i] = mCandidateTime[i];
+    }
+    return STEP_CONFIRM;
+}
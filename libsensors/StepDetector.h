@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STEP_DETECTOR_H
+#define ANDROID_STEP_DETECTOR_H
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+// rate the detector runs at, faster accelerometer samples are skipped
+#define STEP_DETECTOR_PERIOD_NS     20000000LL
+
+// a walk starts counting after this many regular steps, isolated bumps never do
+#define STEP_CONFIRM                4
+
+/*
+ * Step detection on the magnitude of the acceleration, in fixed point BMA023
+ * counts (256 per g). Knows nothing of the HAL, so that recorded or
+ * synthesized traces can be replayed through it off the device (stepreplay).
+ */
+class StepDetector {
+    int64_t mLastSample;
+    int32_t mGravity;           // Q4, slow average of |a|
+    int32_t mSmooth;            // Q4, fast average of |a|
+    bool mArmed;                // went below the valley threshold since the last step
+    int64_t mLastStep;
+    int mCandidates;            // unconfirmed steps in the current walk
+    int64_t mCandidateTime[STEP_CONFIRM];
+
+public:
+            StepDetector();
+
+    // start the averages over, after a gap in the samples
+    void reset();
+
+    // feed one sample in m/s^2; returns the steps it completes, at most
+    // STEP_CONFIRM, and stores their timestamps in steps
+    int process(int64_t timestamp, float x, float y, float z, int64_t *steps);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_STEP_DETECTOR_H
@@ -31,6 +31,9 @@
 #include <utils/Atomic.h>
 #include <utils/Log.h>
 
+#include <halsched.h>
+#include <haltrace.h>
+
 #include "sensors.h"
 
 #include "LightSensor.h"
@@ -38,6 +41,9 @@
 #include "Bma023Sensor.h"
 #include "CompassSensor.h"
 #include "OrientationSensor.h"
+#include "MotionSensor.h"
+
+HALTRACE_COLDSTART_MODULE(SENSORS)
 
 /*****************************************************************************/
 
@@ -59,6 +65,7 @@
 #define SENSORS_LIGHT_HANDLE            3
 #define SENSORS_PROXIMITY_HANDLE        4
 #define SENSORS_GYROSCOPE_HANDLE        5
+#define SENSORS_STEP_DETECTOR_HANDLE    6
 
 #define AKM_FTRACE 0
 #define AKM_DEBUG 0
@@ -89,6 +96,10 @@ static const struct sensor_t sSensorList[] = {
           "Sharp",
           1, SENSORS_PROXIMITY_HANDLE,
           SENSOR_TYPE_PROXIMITY, 5.0f, 5.0f, 0.75f, 0, 0, 0, { } },
+        { "Step Detector",
+          "CM Team",
+          1, SENSORS_STEP_DETECTOR_HANDLE,
+          SENSOR_TYPE_STEP_DETECTOR, 1.0f, 1.0f, 0.20f, 0, 0, 0, { } },
 };
 
 
@@ -136,6 +147,7 @@ private:
         bosch           = 2,
         yamaha          = 3,
 	orientation 	= 4,        
+        motion          = 5,
 	numSensorDrivers,
         numFds,
     };
@@ -150,8 +162,16 @@ private:
     bool mAccelActive;
     bool mMagnetActive;
     bool mOrientationActive;
+    int64_t mAccelDelay;
+
+    // activation and rates; pollEvents() does not take it
+    pthread_mutex_t mLock;
 
+    int activate_l(int handle, int enabled);
     int real_activate(int handle, int enabled);
+    bool motionActive() const;
+    int updateAccelPower_l();
+    int updateAccelDelay_l();
 
     int handleToDriver(int handle) const {
         switch (handle) {
@@ -166,6 +186,8 @@ private:
                 return proximity;
             case ID_L:
                 return light;
+            case ID_SD:
+                return motion;
                  
         }
         return -EINVAL;
@@ -201,6 +223,11 @@ sensors_poll_context_t::sensors_poll_context_t()
     mPollFds[orientation].events = POLLIN;
     mPollFds[orientation].revents = 0;
 
+    mSensors[motion] = new MotionSensor();
+    mPollFds[motion].fd = mSensors[motion]->getFd();
+    mPollFds[motion].events = POLLIN;
+    mPollFds[motion].revents = 0;
+
     int wakeFds[2];
     int result = pipe(wakeFds);
     ALOGE_IF(result<0, "error creating wake pipe (%s)", strerror(errno));
@@ -215,6 +242,9 @@ sensors_poll_context_t::sensors_poll_context_t()
     mAccelActive = false;
     mMagnetActive = false;
     mOrientationActive = false;
+    mAccelDelay = 0;
+
+    pthread_mutex_init(&mLock, NULL);
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
@@ -223,18 +253,26 @@ sensors_poll_context_t::~sensors_poll_context_t() {
     }
     close(mPollFds[wake].fd);
     close(mWritePipeFd);
+    pthread_mutex_destroy(&mLock);
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled) {
+    HALTRACE_INSTANT(SENSORS_ACTIVATE, handle, enabled);
+    HALTRACE_COLDSTART_USE(SENSORS);
+    pthread_mutex_lock(&mLock);
+    int err = activate_l(handle, enabled);
+    pthread_mutex_unlock(&mLock);
+    return err;
+}
+
+int sensors_poll_context_t::activate_l(int handle, int enabled) {
     int err;
 
     // Orientation requires accelerometer and magnetic sensor
     if (handle == ID_O) {
         mOrientationActive = enabled ? true : false;
-        if (!mAccelActive) {
-            err = real_activate(ID_A, enabled);
-            if (err) return err;
-        }
+        err = updateAccelPower_l();
+        if (err) return err;
         if (!mMagnetActive) {
             err = real_activate(ID_M, enabled);
             if (err) return err;
@@ -243,8 +281,8 @@ int sensors_poll_context_t::activate(int handle, int enabled) {
     // Keep track of magnetic and accelerometer use from system
     else if (handle == ID_A) {
         mAccelActive = enabled ? true : false;
-        // No need to enable or disable if orientation sensor is active as that will handle it
-        if (mOrientationActive) return 0;
+        updateAccelDelay_l();
+        return updateAccelPower_l();
     }
     else if (handle == ID_M) {
         mMagnetActive = enabled ? true : false;
@@ -252,6 +290,14 @@ int sensors_poll_context_t::activate(int handle, int enabled) {
         if (mOrientationActive) return 0;
     }
 
+    // The step detector runs off the accelerometer
+    else if (handleToDriver(handle) == motion) {
+        err = real_activate(handle, enabled);
+        if (err) return err;
+        updateAccelDelay_l();
+        return updateAccelPower_l();
+    }
+
     return real_activate(handle, enabled);
 }
 
@@ -271,7 +317,38 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
 
     int index = handleToDriver(handle);
     if (index < 0) return index;
-    return mSensors[index]->setDelay(handle, ns);
+
+    pthread_mutex_lock(&mLock);
+    int err;
+    if (handle == ID_A) {
+        mAccelDelay = ns;
+        err = updateAccelDelay_l();
+    } else {
+        err = mSensors[index]->setDelay(handle, ns);
+    }
+    pthread_mutex_unlock(&mLock);
+    return err;
+}
+
+bool sensors_poll_context_t::motionActive() const {
+    return static_cast<MotionSensor*>(mSensors[motion])->accelNeeded();
+}
+
+// The accelerometer is powered as long as anything reads it. Its own events
+// only reach poll() while the system has it enabled, see pollEvents().
+int sensors_poll_context_t::updateAccelPower_l() {
+    bool needed = mAccelActive || mOrientationActive || motionActive();
+    return real_activate(ID_A, needed);
+}
+
+// The accelerometer has a single rate, run it at the fastest one requested
+int sensors_poll_context_t::updateAccelDelay_l() {
+    int64_t ns = mAccelActive ? mAccelDelay : 0;
+    if (motionActive() && (!ns || MOTION_PERIOD_NS < ns)) {
+        ns = MOTION_PERIOD_NS;
+    }
+    if (!ns) return 0;
+    return mSensors[bosch]->setDelay(ID_A, ns);
 }
 
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
@@ -289,6 +366,10 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                     // no more data for this sensor
                     mPollFds[i].revents = 0;
                 }
+                if (i == bosch && !mAccelActive) {
+                    // powered for the orientation or motion readers only
+                    nb = 0;
+                }
                 count -= nb;
                 nbEvents += nb;
                 data += nb;
@@ -347,7 +428,11 @@ static int poll__setDelay(struct sensors_poll_device_t *dev,
 static int poll__poll(struct sensors_poll_device_t *dev,
         sensors_event_t* data, int count) {
     sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
-    return ctx->pollEvents(data, count);
+    halsched_account(HALSCHED_SENSORS);
+    int nb = ctx->pollEvents(data, count);
+    // the wait is in there, only the work after it is of interest
+    HALTRACE_INSTANT(SENSORS_POLL, nb, nb > 0 ? data[0].sensor : -1);
+    return nb;
 }
 
 /*****************************************************************************/
@@ -357,7 +442,10 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
                         struct hw_device_t** device)
 {
         int status = -EINVAL;
+        // the drivers look up their input devices here
+        HALTRACE_COLDSTART(SENSORS, OPEN_BEGIN);
         sensors_poll_context_t *dev = new sensors_poll_context_t();
+        HALTRACE_COLDSTART(SENSORS, OPEN_END);
 
         memset(&dev->device, 0, sizeof(sensors_poll_device_t));
 
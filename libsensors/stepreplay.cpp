@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2014 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * stepreplay: accuracy of the step detector of the sensors HAL.
+ *
+ * Accelerometer traces are replayed through StepDetector and the steps it
+ * finds are compared to the steps actually taken. Without -f the traces are
+ * synthesized from a fixed seed at the accelerometer's 50 Hz, with jitter:
+ * walks at several cadences and strengths, a run, a walk with stops, and
+ * the cases that must not count anything (a phone on a desk, in a hand while
+ * sitting, in a moving bus, isolated bumps). -w writes them out.
+ *
+ * -f replays a recorded trace instead, one sample per line as
+ * "timestamp_ns x y z" in m/s^2 ('#' starts a comment), against the -e
+ * steps counted by hand.
+ *
+ * A trace passes when the count is within STEP_TOLERANCE_PCT of the steps
+ * taken, or STEP_TOLERANCE_MIN steps for short walks; any failure exits
+ * with 2.
+ *
+ * Usage: stepreplay [-w prefix]
+ *        stepreplay -f trace -e steps
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "StepDetector.h"
+
+#define GRAVITY             9.80665f
+#define SAMPLE_NS           20000000LL
+#define JITTER_NS           2000000LL
+#define STEP_TOLERANCE_PCT  5
+#define STEP_TOLERANCE_MIN  2
+
+struct Trace {
+    const char *name;
+    double seconds;
+    double cadence;     // steps per second, 0 for none
+    double stepG;       // peak vertical acceleration of a step, g
+    double noiseG;      // white noise rms on every axis, g
+    double vibHz;       // vehicle vibration
+    double vibG;
+    double bumpEvery;   // seconds between isolated bumps, 0 for none
+    double pauseEvery;  // seconds of walking between pauses, 0 for none
+    double pauseFor;    // seconds of each pause
+};
+
+static const Trace kTraces[] = {
+    //  name             s    steps/s  step  noise  vib Hz  vib  bump  walk  pause
+    { "walk-pocket",     120, 1.8,     0.30, 0.02,  0,      0,   0,    0,    0 },
+    { "walk-slow",       120, 1.3,     0.15, 0.02,  0,      0,   0,    0,    0 },
+    { "walk-brisk",      120, 2.2,     0.45, 0.03,  0,      0,   0,    0,    0 },
+    { "run",             60,  2.9,     1.10, 0.05,  0,      0,   0,    0,    0 },
+    { "walk-stops",      120, 1.8,     0.30, 0.02,  0,      0,   0,    15,   8 },
+    { "desk",            120, 0,       0,    0.01,  0,      0,   0,    0,    0 },
+    { "hand-sitting",    120, 0,       0,    0.04,  0,      0,   0,    0,    0 },
+    { "bus",             120, 0,       0,    0.03,  12,     0.08, 0,   0,    0 },
+    { "bumps",           120, 0,       0,    0.02,  0,      0,   3.1,  0,    0 },
+};
+
+#define NUM_TRACES (sizeof(kTraces) / sizeof(kTraces[0]))
+
+/*****************************************************************************/
+
+static unsigned int sSeed;
+
+// uniform in [0, 1), same sequence on every host
+static double frand()
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return ((sSeed >> 8) & 0xffffff) / 16777216.0;
+}
+
+static double gauss()
+{
+    double u = frand() + 1e-9, v = frand();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int check(int steps, int counted)
+{
+    int tolerance = steps * STEP_TOLERANCE_PCT / 100;
+    if (tolerance < STEP_TOLERANCE_MIN)
+        tolerance = STEP_TOLERANCE_MIN;
+    return abs(counted - steps) <= tolerance;
+}
+
+static void report(const char *name, int steps, int counted)
+{
+    int ok = check(steps, counted);
+    printf("%-16s %6d %8d %+6d  %s\n", name, steps, counted, counted - steps,
+           ok ? "ok" : "FAIL");
+}
+
+/*
+ * The phone hangs tilted in a pocket: gravity and the vertical push of each
+ * step along one direction, the sway of the hips across it at half the
+ * cadence. A step is a raised cosine bump with a short heel strike after
+ * it, and every step varies a little in length and strength.
+ */
+static int synthesize(const Trace& tr, FILE *out, int *counted)
+{
+    static const float up[3] = { 0.36f, 0.48f, 0.80f };
+    static const float side[3] = { 0.80f, -0.60f, 0.0f };
+    StepDetector detector;
+    int64_t found[STEP_CONFIRM];
+    int64_t end = (int64_t)(tr.seconds * 1e9);
+    double period = tr.cadence > 0 ? 1.0 / tr.cadence : 0;
+    double stepStart = 0.5, stepLen = period, stepG = tr.stepG;
+    double walked = 0, pauseUntil = -1, nextBump = tr.bumpEvery;
+    int steps = 0;
+
+    sSeed = 20140101;
+    *counted = 0;
+    for (int64_t t = 0; t < end; t += SAMPLE_NS) {
+        int64_t ts = t + (int64_t)((frand() - 0.5) * 2 * JITTER_NS);
+        double s = t / 1e9;
+        double v = 0, lateral = 0;
+
+        if (period > 0 && s >= pauseUntil) {
+            while (s >= stepStart + stepLen) {
+                stepStart += stepLen;
+                walked += stepLen;
+                steps++;
+                if (tr.pauseEvery > 0 && walked >= tr.pauseEvery) {
+                    walked = 0;
+                    pauseUntil = stepStart + tr.pauseFor;
+                    stepStart = pauseUntil;
+                    break;
+                }
+                stepLen = period * (1 + 0.06 * (frand() - 0.5));
+                stepG = tr.stepG * (1 + 0.3 * (frand() - 0.5));
+            }
+            if (s >= stepStart && s >= pauseUntil) {
+                double phase = (s - stepStart) / stepLen;
+                v = stepG * -cos(2 * M_PI * phase);
+                if (phase < 0.15)
+                    v += stepG * 0.5 * sin(M_PI * phase / 0.15);
+                lateral = 0.3 * stepG * sin(M_PI * (s - 0.5) / period);
+            }
+        }
+        if (tr.vibG > 0) {
+            v += tr.vibG * sin(2 * M_PI * tr.vibHz * s) +
+                 0.5 * tr.vibG * sin(2 * M_PI * 0.4 * s);
+        }
+        if (nextBump > 0 && s >= nextBump) {
+            v += 0.8;
+            nextBump += tr.bumpEvery * (1 + 0.2 * (frand() - 0.5));
+        }
+
+        float a[3];
+        for (int k = 0; k < 3; k++) {
+            a[k] = GRAVITY * (float)((1 + v) * up[k] + lateral * side[k] +
+                                     tr.noiseG * gauss());
+        }
+        if (out)
+            fprintf(out, "%lld %.4f %.4f %.4f\n", (long long)ts, a[0], a[1], a[2]);
+        *counted += detector.process(ts, a[0], a[1], a[2], found);
+    }
+    return steps;
+}
+
+static int replay(const char *path, int *counted)
+{
+    FILE *in = fopen(path, "r");
+    StepDetector detector;
+    int64_t found[STEP_CONFIRM];
+    char line[256];
+    int lines = 0;
+
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    *counted = 0;
+    while (fgets(line, sizeof(line), in)) {
+        long long ts;
+        float x, y, z;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%lld %f %f %f", &ts, &x, &y, &z) != 4) {
+            fprintf(stderr, "%s: bad sample: %s", path, line);
+            fclose(in);
+            return -1;
+        }
+        *counted += detector.process(ts, x, y, z, found);
+        lines++;
+    }
+    fclose(in);
+    return lines;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: stepreplay [-w prefix]\n"
+                    "       stepreplay -f trace -e steps\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *prefix = NULL, *trace = NULL;
+    int expected = -1;
+    int failed = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:f:e:")) != -1) {
+        switch (c) {
+        case 'w':
+            prefix = optarg;
+            break;
+        case 'f':
+            trace = optarg;
+            break;
+        case 'e':
+            expected = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if ((trace != NULL) != (expected >= 0))
+        usage();
+
+    printf("%-16s %6s %8s %6s\n", "trace", "steps", "counted", "error");
+    if (trace) {
+        int counted;
+        if (replay(trace, &counted) < 0)
+            return 1;
+        report(trace, expected, counted);
+        return check(expected, counted) ? 0 : 2;
+    }
+
+    for (size_t i = 0; i < NUM_TRACES; i++) {
+        FILE *out = NULL;
+        int steps, counted;
+
+        if (prefix) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s%s.txt", prefix, kTraces[i].name);
+            out = fopen(path, "w");
+            if (out == NULL) {
+                perror(path);
+                return 1;
+            }
+        }
+        steps = synthesize(kTraces[i], out, &counted);
+        if (out)
+            fclose(out);
+        report(kTraces[i].name, steps, counted);
+        failed += !check(steps, counted);
+    }
+    return failed ? 2 : 0;
+}
@@ -26,6 +26,10 @@
 #include <hardware/hardware.h>
 #include <hardware/power.h>
 
+#include <haltrace.h>
+
+HALTRACE_COLDSTART_MODULE(POWER)
+
 #define SCALING_GOVERNOR_PATH "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"
 #define BOOSTPULSE_ONDEMAND "/sys/devices/system/cpu/cpufreq/ondemand/boostpulse"
 #define BOOSTPULSE_INTERACTIVE "/sys/devices/system/cpu/cpufreq/interactive/boostpulse"
@@ -121,6 +125,9 @@ static void epicmtd_power_hint(struct power_module *module, power_hint_t hint,
     int len;
     int duration = 1;
 
+    HALTRACE_INSTANT(POWER_HINT, hint, (int) data);
+    HALTRACE_COLDSTART(POWER, USE_BEGIN);
+
     switch (hint) {
     case POWER_HINT_INTERACTION:
     case POWER_HINT_CPU_BOOST:
@@ -150,15 +157,21 @@ static void epicmtd_power_hint(struct power_module *module, power_hint_t hint,
     default:
         break;
     }
+
+    HALTRACE_COLDSTART(POWER, USE_END);
 }
 
 static void epicmtd_power_set_interactive(struct power_module *module, int on)
 {
+    HALTRACE_INSTANT(POWER_INTERACTIVE, on, 0);
     return;
 }
 
 static void epicmtd_power_init(struct power_module *module)
 {
+    /* the power HAL has no device to open, init stands in for it */
+    HALTRACE_COLDSTART(POWER, OPEN_BEGIN);
+    HALTRACE_COLDSTART(POWER, OPEN_END);
     return;
 }
 